@@ -21,7 +21,16 @@ mkdir -p -v $buildDir
 
 t=0.25
 # -g = debug, -Os = Optimize Size
-Compile=(avr-gcc -Wall -g -Os -I "includes/sd" -I "includes/avrio" -I "includes/hlpr" -DF_CPU=16000000 -mmcu=atmega1280 -c -o)
+# SPI module. avr_spi uses the SPI port. avr_usart_spi uses USART1 in Master
+# SPI Mode, whose double-buffered transmitter clocks block bytes back-to-back.
+spiMod=avr_spi
+spiDef=()
+if [ "$spiMod" = avr_usart_spi ]
+then
+    spiDef=(-DSD_USART_SPI)
+fi
+
+Compile=(avr-gcc -Wall -g -Os -I "includes/sd" -I "includes/avrio" -I "includes/hlpr" -DF_CPU=16000000 "${spiDef[@]}" -mmcu=atmega1280 -c -o)
 Link=(avr-gcc -Wall -g -mmcu=atmega1280 -o)
 IHex=(avr-objcopy -j .text -j .data -O ihex)
 
@@ -54,17 +63,17 @@ else
 fi
 
 
-echo -e "\n\r>> COMPILE: "${Compile[@]}" "$buildDir"/avr_spi.o" $ioDir"/avr_spi.c"
-"${Compile[@]}" $buildDir/avr_spi.o $ioDir/avr_spi.c
+echo -e "\n\r>> COMPILE: "${Compile[@]}" "$buildDir"/"$spiMod".o" $ioDir"/"$spiMod".c"
+"${Compile[@]}" $buildDir/$spiMod.o $ioDir/$spiMod.c
 status=$?
 sleep $t
 if [ $status -gt 0 ]
 then
-    echo -e "error compiling avr_spi.c"
+    echo -e "error compiling $spiMod.c"
     echo -e "program exiting with code $status"
     exit $status
 else
-    echo -e "Compiling avr_SPI.C successful"
+    echo -e "Compiling $spiMod.c successful"
 fi
 
 
@@ -96,6 +105,20 @@ else
 fi
 
 
+echo -e "\n\r>> COMPILE: "${Compile[@]}" "$buildDir"/sd_spi_info.o" $sdDir"/sd_spi_info.c"
+"${Compile[@]}" $buildDir/sd_spi_info.o $sdDir/sd_spi_info.c
+status=$?
+sleep $t
+if [ $status -gt 0 ]
+then
+    echo -e "error compiling SD_SPI_INFO.C"
+    echo -e "program exiting with code $status"
+    exit $status
+else
+    echo -e "Compiling SD_SPI_INFO.C successful"
+fi
+
+
 echo -e "\n\r>> COMPILE: "${Compile[@]}" "$buildDir"/sd_spi_misc.o" $sdDir"/sd_spi_misc.c"
 "${Compile[@]}" $buildDir/sd_spi_misc.o $sdDir/sd_spi_misc.c
 status=$?
@@ -124,6 +147,104 @@ else
 fi
 
 
+echo -e "\n\r>> COMPILE: "${Compile[@]}" "$buildDir"/sd_spi_stats.o " $sdDir"/sd_spi_stats.c"
+"${Compile[@]}" $buildDir/sd_spi_stats.o $sdDir/sd_spi_stats.c
+status=$?
+sleep $t
+if [ $status -gt 0 ]
+then
+    echo -e "error compiling SD_SPI_STATS.C"
+    echo -e "program exiting with code $status"
+    exit $status
+else
+    echo -e "Compiling SD_SPI_STATS.C successful"
+fi
+
+
+echo -e "\n\r>> COMPILE: "${Compile[@]}" "$buildDir"/sd_spi_crc.o " $sdDir"/sd_spi_crc.c"
+"${Compile[@]}" $buildDir/sd_spi_crc.o $sdDir/sd_spi_crc.c
+status=$?
+sleep $t
+if [ $status -gt 0 ]
+then
+    echo -e "error compiling SD_SPI_CRC.C"
+    echo -e "program exiting with code $status"
+    exit $status
+else
+    echo -e "Compiling SD_SPI_CRC.C successful"
+fi
+
+
+echo -e "\n\r>> COMPILE: "${Compile[@]}" "$buildDir"/sd_spi_cache.o " $sdDir"/sd_spi_cache.c"
+"${Compile[@]}" $buildDir/sd_spi_cache.o $sdDir/sd_spi_cache.c
+status=$?
+sleep $t
+if [ $status -gt 0 ]
+then
+    echo -e "error compiling SD_SPI_CACHE.C"
+    echo -e "program exiting with code $status"
+    exit $status
+else
+    echo -e "Compiling SD_SPI_CACHE.C successful"
+fi
+
+
+echo -e "\n\r>> COMPILE: "${Compile[@]}" "$buildDir"/sd_spi_async.o " $sdDir"/sd_spi_async.c"
+"${Compile[@]}" $buildDir/sd_spi_async.o $sdDir/sd_spi_async.c
+status=$?
+sleep $t
+if [ $status -gt 0 ]
+then
+    echo -e "error compiling SD_SPI_ASYNC.C"
+    echo -e "program exiting with code $status"
+    exit $status
+else
+    echo -e "Compiling SD_SPI_ASYNC.C successful"
+fi
+
+
+echo -e "\n\r>> COMPILE: "${Compile[@]}" "$buildDir"/sd_spi_card.o " $sdDir"/sd_spi_card.c"
+"${Compile[@]}" $buildDir/sd_spi_card.o $sdDir/sd_spi_card.c
+status=$?
+sleep $t
+if [ $status -gt 0 ]
+then
+    echo -e "error compiling SD_SPI_CARD.C"
+    echo -e "program exiting with code $status"
+    exit $status
+else
+    echo -e "Compiling SD_SPI_CARD.C successful"
+fi
+
+
+echo -e "\n\r>> COMPILE: "${Compile[@]}" "$buildDir"/sd_spi_mirror.o " $sdDir"/sd_spi_mirror.c"
+"${Compile[@]}" $buildDir/sd_spi_mirror.o $sdDir/sd_spi_mirror.c
+status=$?
+sleep $t
+if [ $status -gt 0 ]
+then
+    echo -e "error compiling SD_SPI_MIRROR.C"
+    echo -e "program exiting with code $status"
+    exit $status
+else
+    echo -e "Compiling SD_SPI_MIRROR.C successful"
+fi
+
+
+echo -e "\n\r>> COMPILE: "${Compile[@]}" "$buildDir"/sd_spi_log.o " $sdDir"/sd_spi_log.c"
+"${Compile[@]}" $buildDir/sd_spi_log.o $sdDir/sd_spi_log.c
+status=$?
+sleep $t
+if [ $status -gt 0 ]
+then
+    echo -e "error compiling SD_SPI_LOG.C"
+    echo -e "program exiting with code $status"
+    exit $status
+else
+    echo -e "Compiling SD_SPI_LOG.C successful"
+fi
+
+
 echo -e "\n\r>> COMPILE: "${Compile[@]}" "$buildDir"/sd_test.o " $testDir"/sd_test.c"
 "${Compile[@]}" $buildDir/sd_test.o $testDir/sd_test.c
 status=$?
@@ -138,8 +259,8 @@ else
 fi
 
 
-echo -e "\n\r>> LINK: "${Link[@]}" "$buildDir"/sd_test.elf "$buildDir"/sd_test.o  "$buildDir"/avr_spi.o "$buildDir"/sd_spi_base.o "$buildDir"/sd_spi_rwe.o "$buildDir"/sd_spi_misc.o "$buildDir"/sd_spi_print.o "$buildDir"/avr_usart.o "$buildDir"/prints.o"
-"${Link[@]}" $buildDir/sd_test.elf $buildDir/sd_test.o $buildDir/avr_spi.o $buildDir/sd_spi_base.o $buildDir/sd_spi_rwe.o $buildDir/sd_spi_misc.o $buildDir/sd_spi_print.o $buildDir/avr_usart.o $buildDir/prints.o
+echo -e "\n\r>> LINK: "${Link[@]}" "$buildDir"/sd_test.elf "$buildDir"/sd_test.o  "$buildDir"/"$spiMod".o "$buildDir"/sd_spi_base.o "$buildDir"/sd_spi_rwe.o "$buildDir"/sd_spi_info.o "$buildDir"/sd_spi_misc.o "$buildDir"/sd_spi_print.o "$buildDir"/sd_spi_stats.o "$buildDir"/sd_spi_crc.o "$buildDir"/sd_spi_cache.o "$buildDir"/sd_spi_async.o "$buildDir"/sd_spi_card.o "$buildDir"/sd_spi_mirror.o "$buildDir"/sd_spi_log.o "$buildDir"/avr_usart.o "$buildDir"/prints.o"
+"${Link[@]}" $buildDir/sd_test.elf $buildDir/sd_test.o $buildDir/$spiMod.o $buildDir/sd_spi_base.o $buildDir/sd_spi_rwe.o $buildDir/sd_spi_info.o $buildDir/sd_spi_misc.o $buildDir/sd_spi_print.o $buildDir/sd_spi_stats.o $buildDir/sd_spi_crc.o $buildDir/sd_spi_cache.o $buildDir/sd_spi_async.o $buildDir/sd_spi_card.o $buildDir/sd_spi_mirror.o $buildDir/sd_spi_log.o $buildDir/avr_usart.o $buildDir/prints.o
 status=$?
 sleep $t
 if [ $status -gt 0 ]
@@ -0,0 +1,70 @@
+
+#directory to store build/compiled files
+buildDir=../untracked/sim_build
+
+#directory for sdcard source files
+sdDir=source/sd
+
+#directory for simulator source files
+simDir=source/sim
+
+#directory for helper source files
+hlprDir=source/hlpr
+
+#directory for test files
+testDir=test
+
+#make build directory if it doesn't exist
+mkdir -p -v $buildDir
+
+
+# Host build of the SD module against the simulated SD card (SIM_SD).
+# SD_SIM selects SIM_SPI in place of AVR_SPI in sd_spi_base.h.
+# SD_STATS=1 compiles in the SPI instrumentation (sd_spi_stats.h).
+Compile=(gcc -Wall -g -O2 -DSD_SIM -DSD_STATS=1 -I "includes/sd" -I "includes/sim" -I "includes/avrio" -I "includes/hlpr" -c -o)
+Link=(gcc -Wall -g -o)
+
+srcFiles=($simDir/sim_sd.c $simDir/sim_spi.c $simDir/sim_usart.c $hlprDir/prints.c $sdDir/sd_spi_base.c $sdDir/sd_spi_rwe.c $sdDir/sd_spi_info.c $sdDir/sd_spi_misc.c $sdDir/sd_spi_print.c $sdDir/sd_spi_stats.c $sdDir/sd_spi_crc.c $sdDir/sd_spi_cache.c $sdDir/sd_spi_async.c $sdDir/sd_spi_card.c $sdDir/sd_spi_mirror.c $sdDir/sd_spi_log.c $testDir/sd_sim_test.c)
+objFiles=()
+
+for src in "${srcFiles[@]}"
+do
+    obj=$buildDir/$(basename ${src%.c}).o
+    echo -e "\n\r>> COMPILE: "${Compile[@]}" "$obj" "$src
+    "${Compile[@]}" $obj $src
+    status=$?
+    if [ $status -gt 0 ]
+    then
+        echo -e "error compiling $src"
+        echo -e "program exiting with code $status"
+        exit $status
+    else
+        echo -e "Compiling $src successful"
+    fi
+    objFiles+=($obj)
+done
+
+
+echo -e "\n\r>> LINK: "${Link[@]}" "$buildDir"/sd_sim_test "${objFiles[@]}
+"${Link[@]}" $buildDir/sd_sim_test "${objFiles[@]}"
+status=$?
+if [ $status -gt 0 ]
+then
+    echo -e "error during linking"
+    echo -e "program exiting with code $status"
+    exit $status
+else
+    echo -e "Linking successful. Output in SD_SIM_TEST"
+fi
+
+
+echo -e "\n\r>> RUN: "$buildDir"/sd_sim_test "$@
+$buildDir/sd_sim_test "$@"
+status=$?
+if [ $status -gt 0 ]
+then
+    echo -e "\n\rsd_sim_test failed with code $status"
+    exit $status
+else
+    echo -e "\n\rsd_sim_test passed"
+fi
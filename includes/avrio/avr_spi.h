@@ -15,6 +15,10 @@
 
 #include <avr/io.h>
 
+#ifndef F_CPU
+#define F_CPU       16000000UL                  // AVR target's clk freq.
+#endif //F_CPU
+
 /*
  ******************************************************************************
  *                                    MACROS   
@@ -40,9 +44,48 @@
 #define SS_HI        SPI_PORT |= 1 << SS                // set SS pin high
 #define SS_DD_OUT    DDR_SPI  |= 1 << DD_SS             // set SS pin as output
 
+// Operations on a chip select pin other than SS, described by an SPICsPin.
+#define CS_PIN_LO(cs)      (*(cs)->port &= ~(1 << (cs)->pin))
+#define CS_PIN_HI(cs)      (*(cs)->port |= 1 << (cs)->pin)
+#define CS_PIN_DD_OUT(cs)  (*(cs)->ddr |= 1 << (cs)->pin)
+
 // Bit length of SPI data register
 #define SPI_REG_BIT_LEN      8
 
+// SPI clock divisor is 2^n, with n from 1 (F_CPU/2) to 7 (F_CPU/128).
+#define SPI_CLK_DIV_SHIFT_MIN   1
+#define SPI_CLK_DIV_SHIFT_MAX   7
+
+// Enable / disable the SPI Serial Transfer Complete interrupt (SPI_INT_VECT).
+#define SPI_INT_ENABLE      SPCR |= 1 << SPIE
+#define SPI_INT_DISABLE     SPCR &= ~(1 << SPIE)
+#define SPI_INT_VECT        SPI_STC_vect
+
+/*
+ ******************************************************************************
+ *                                   STRUCTS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                             CHIP SELECT PIN
+ *
+ * Description : A chip select pin on any port, for when more than one device
+ *               shares the bus. See CS_PIN_LO, CS_PIN_HI and CS_PIN_DD_OUT.
+ * 
+ * Members     : port  - ptr to the pin's PORT register, e.g. &PORTB.
+ *               ddr   - ptr to the pin's DDR register, e.g. &DDRB.
+ *               pin   - bit number of the pin, e.g. PB4.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SPICsPin
+{
+  volatile uint8_t *port;
+  volatile uint8_t *ddr;
+  uint8_t           pin;
+} SPICsPin;
+
 /*
  ******************************************************************************
  *                              FUNCTION PROTOTYPES
@@ -87,4 +130,76 @@ uint8_t spi_MasterReceive(void);
  */
 void spi_MasterTransmit(uint8_t byte);
 
+/*
+ * ----------------------------------------------------------------------------
+ *                                                    SPI START TRANSMIT BYTE 
+ * 
+ * Description : Loads a byte into SPDR to start its transfer and returns 
+ *               without waiting for it to complete. Completion is signalled by
+ *               SPIF, or by the SPI_INT_VECT interrupt if SPI_INT_ENABLE is
+ *               set, after which the byte received can be read with 
+ *               spi_MasterReceive.
+ * 
+ * Arguments   : byte - data byte to be sent via SPI.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterStartTransmit(uint8_t byte);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           SPI RECEIVE BLOCK
+ * 
+ * Description : Receives a block of bytes via the SPI port operating in master
+ *               mode by clocking out 0xFF for each byte. The next transfer is
+ *               started as soon as the previous one completes and the received
+ *               byte is stored while the next one is being clocked.
+ * 
+ * Arguments   : buf  - pointer to the array to be loaded with the bytes read.
+ *               len  - number of bytes to receive. Must be at least 1.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterReceiveBlock(uint8_t *buf, uint16_t len);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          SPI TRANSMIT BLOCK
+ * 
+ * Description : Sends a block of bytes via the SPI port operating in master
+ *               mode. The next byte is fetched while the current one is being
+ *               clocked so SPDR is reloaded as soon as the transfer completes.
+ * 
+ * Arguments   : buf  - pointer to the array holding the bytes to send.
+ *               len  - number of bytes to send. Must be at least 1.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterTransmitBlock(const uint8_t *buf, uint16_t len);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           SET SPI CLOCK RATE
+ * 
+ * Description : Sets the SPI clock to the fastest rate the SPI port supports
+ *               that does not exceed maxRate. The rate is F_CPU divided by
+ *               one of 2, 4, 8, 16, 32, 64 or 128.
+ * 
+ * Arguments   : maxRate  - maximum SPI clock rate in Hz.
+ * 
+ * Returns     : SPI clock rate in Hz that was set. If maxRate is below 
+ *               F_CPU/128 then the clock is set to F_CPU/128 and this is 
+ *               returned.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t spi_SetClockRate(uint32_t maxRate);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           GET SPI CLOCK RATE
+ * 
+ * Description : Gets the current SPI clock rate.
+ * 
+ * Returns     : SPI clock rate in Hz.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t spi_GetClockRate(void);
+
 #endif  //AVR_SPI_H
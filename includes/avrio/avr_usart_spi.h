@@ -0,0 +1,201 @@
+/*
+ * File       : AVR_USART_SPI.H
+ * Version    : 1.0 
+ * Target     : ATMega1280
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ * 
+ * Description: Alternative to AVR_SPI that provides the same interface using
+ *              USART1 in Master SPI Mode (MSPIM). Unlike the SPI port, the
+ *              USART transmitter is double-buffered, so the next byte can be
+ *              loaded while the current one is being clocked and the block 
+ *              transfers run with no idle clock between bytes. Selected in 
+ *              SD_SPI_BASE.H when SD_USART_SPI is defined.
+ *
+ *              Pins: XCK1 (PD5) - SCK, TXD1 (PD3) - MOSI, RXD1 (PD2) - MISO.
+ *              Chip select remains on PB0 by default. See CS_XXXX below.
+ *
+ *              SPI mode 0, MSB first. The clock rate is F_CPU / (2 * (UBRR1 
+ *              + 1)), so any even divisor of F_CPU from 2 to 8192 can be set.
+ */
+
+#ifndef AVR_USART_SPI_H
+#define AVR_USART_SPI_H
+
+#include <avr/io.h>
+
+#ifndef F_CPU
+#define F_CPU       16000000UL                  // AVR target's clk freq.
+#endif //F_CPU
+
+/*
+ ******************************************************************************
+ *                                    MACROS   
+ ******************************************************************************
+ */
+
+// USART1 MSPIM pins.
+#define DDR_USPI    DDRD
+#define DD_XCK      DDD5
+#define DD_TXD      DDD3
+
+// Chip Select pin. May be moved to any free port pin.
+#define CS_DDR      DDRB
+#define CS_PORT     PORTB
+#define CS_PIN      PB0
+
+// Common SPI operations. SS is the chip select pin.
+#define SS_LO        CS_PORT  = CS_PORT & ~(1 << CS_PIN)  // set SS pin low
+#define SS_HI        CS_PORT |= 1 << CS_PIN               // set SS pin high
+#define SS_DD_OUT    CS_DDR  |= 1 << CS_PIN               // set SS as output
+
+// Operations on a chip select pin other than SS, described by an SPICsPin.
+#define CS_PIN_LO(cs)      (*(cs)->port &= ~(1 << (cs)->pin))
+#define CS_PIN_HI(cs)      (*(cs)->port |= 1 << (cs)->pin)
+#define CS_PIN_DD_OUT(cs)  (*(cs)->ddr |= 1 << (cs)->pin)
+
+// Bit length of SPI data register
+#define SPI_REG_BIT_LEN      8
+
+// Max value of the 12-bit baud rate register UBRR1.
+#define USPI_UBRR_MAX        4095
+
+// Enable / disable the receive complete interrupt, which fires each time a 
+// byte transfer completes (SPI_INT_VECT).
+#define SPI_INT_ENABLE      UCSR1B |= 1 << RXCIE1
+#define SPI_INT_DISABLE     UCSR1B &= ~(1 << RXCIE1)
+#define SPI_INT_VECT        USART1_RX_vect
+
+/*
+ ******************************************************************************
+ *                                   STRUCTS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                             CHIP SELECT PIN
+ *
+ * Description : A chip select pin on any port, for when more than one device
+ *               shares the bus. See CS_PIN_LO, CS_PIN_HI and CS_PIN_DD_OUT.
+ * 
+ * Members     : port  - ptr to the pin's PORT register, e.g. &PORTB.
+ *               ddr   - ptr to the pin's DDR register, e.g. &DDRB.
+ *               pin   - bit number of the pin, e.g. PB4.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SPICsPin
+{
+  volatile uint8_t *port;
+  volatile uint8_t *ddr;
+  uint8_t           pin;
+} SPICsPin;
+
+/*
+ ******************************************************************************
+ *                              FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                         INITIALIZE SPI PORT INTO MASTER MODE
+ * 
+ * Description : Initialize USART1 into Master SPI Mode at F_CPU/64.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterInit(void);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                             SPI RECEIVE BYTE
+ *                                       
+ * Description : Gets the byte received during the last completed transfer.
+ * 
+ * Returns     : byte received.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t spi_MasterReceive(void);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                            SPI TRANSMIT BYTE 
+ * 
+ * Description : Sends a byte and waits for the transfer to complete.
+ * 
+ * Arguments   : byte - data byte to be sent via SPI.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterTransmit(uint8_t byte);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                    SPI START TRANSMIT BYTE 
+ * 
+ * Description : Loads a byte into UDR1 to start its transfer and returns 
+ *               without waiting for it to complete. Completion is signalled by
+ *               RXC1, or by the SPI_INT_VECT interrupt if SPI_INT_ENABLE is
+ *               set, after which the byte received can be read with 
+ *               spi_MasterReceive.
+ * 
+ * Arguments   : byte - data byte to be sent via SPI.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterStartTransmit(uint8_t byte);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           SPI RECEIVE BLOCK
+ * 
+ * Description : Receives a block of bytes by clocking out 0xFF for each byte.
+ *               Two bytes are kept in flight so the clock runs continuously.
+ * 
+ * Arguments   : buf  - pointer to the array to be loaded with the bytes read.
+ *               len  - number of bytes to receive. Must be at least 1.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterReceiveBlock(uint8_t *buf, uint16_t len);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          SPI TRANSMIT BLOCK
+ * 
+ * Description : Sends a block of bytes. Each byte is loaded as soon as the 
+ *               transmit buffer is free, so the clock runs continuously. The
+ *               bytes received are discarded.
+ * 
+ * Arguments   : buf  - pointer to the array holding the bytes to send.
+ *               len  - number of bytes to send. Must be at least 1.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterTransmitBlock(const uint8_t *buf, uint16_t len);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           SET SPI CLOCK RATE
+ * 
+ * Description : Sets the SPI clock to the fastest rate, F_CPU / (2 * (UBRR1 +
+ *               1)), that does not exceed maxRate.
+ * 
+ * Arguments   : maxRate  - maximum SPI clock rate in Hz.
+ * 
+ * Returns     : SPI clock rate in Hz that was set. If maxRate is below 
+ *               F_CPU/8192 then the clock is set to F_CPU/8192 and this is
+ *               returned.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t spi_SetClockRate(uint32_t maxRate);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           GET SPI CLOCK RATE
+ * 
+ * Description : Gets the current SPI clock rate.
+ * 
+ * Returns     : SPI clock rate in Hz.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t spi_GetClockRate(void);
+
+#endif //AVR_USART_SPI_H
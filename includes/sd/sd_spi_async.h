@@ -0,0 +1,132 @@
+/*
+ * File       : SD_SPI_ASYNC.H
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Interrupt-driven single block read and write. A request is submitted with
+ * sd_ReadBlockAsync or sd_WriteBlockAsync, which start the transfer and 
+ * return at once. Each following byte is moved by the SPI module's transfer
+ * complete interrupt (SPI_INT_VECT), which steps a state machine through the
+ * command, R1 response, start token, data block, CRC and, for writes, the 
+ * data response. As with sd_WriteSingleBlock, a write completes once the card
+ * accepts the data, while the card may still be busy. The application calls
+ * sd_AsyncPoll from its main loop to learn when the request has completed.
+ *
+ * Requires SD_SPI_BASE and SD_SPI_RWE. On the AVR target, global interrupts
+ * must be enabled (sei) for the transfer to progress. In the host simulator
+ * build (SD_SIM) there is no SPI interrupt and each call to sd_AsyncPoll 
+ * moves one byte instead.
+ *
+ * Warnings : 1) While a request is in progress, no other function of the SD
+ *               module may be called, and no other device may use the SPI 
+ *               port.
+ *            2) Async transfers are not counted by the SD_STATS 
+ *               instrumentation.
+ */
+
+#ifndef SD_SPI_ASYNC_H
+#define SD_SPI_ASYNC_H
+
+/*
+ ******************************************************************************
+ *                                   MACROS
+ ******************************************************************************
+ */
+
+// values returned by sd_AsyncPoll.
+#define SD_ASYNC_IDLE           0           // no request submitted
+#define SD_ASYNC_BUSY           1           // request in progress
+#define SD_ASYNC_DONE           2           // request has just completed
+
+/*
+ ******************************************************************************
+ *                                   TYPES
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                         COMPLETION CALLBACK
+ *
+ * Description : Called by sd_AsyncPoll when a request completes. It is called
+ *               from the context of sd_AsyncPoll, not from the interrupt, and
+ *               may submit the next request.
+ *
+ * Arguments   : err  - result of the request, as returned by the blocking 
+ *                      sd_ReadSingleBlock / sd_WriteSingleBlock.
+ *               ctx  - ctx passed to sd_ReadBlockAsync / sd_WriteBlockAsync.
+ * ----------------------------------------------------------------------------
+ */
+typedef void (*SDAsyncCallback)(uint16_t err, void *ctx);
+
+/*
+ ******************************************************************************
+ *                           FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                       READ BLOCK (ASYNC)
+ * 
+ * Description : Submits a request to read the block at blckAddr into blckArr.
+ * 
+ * Arguments   : blckAddr   - address of the block to be read.
+ *               blckArr    - array of length BLOCK_LEN loaded with the block.
+ *                            Must not be accessed until the request completes.
+ *               cb         - called when the request completes, or NULL.
+ *               ctx        - passed through to cb.
+ * 
+ * Returns     : 1 if the request was submitted, 0 if another request has not
+ *               yet completed.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_ReadBlockAsync(uint32_t blckAddr, uint8_t blckArr[], 
+                          SDAsyncCallback cb, void *ctx);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      WRITE BLOCK (ASYNC)
+ * 
+ * Description : Submits a request to write dataArr to the block at blckAddr.
+ * 
+ * Arguments   : blckAddr   - address of the block to be written.
+ *               dataArr    - array of length BLOCK_LEN holding the data. Must
+ *                            not be modified until the request completes.
+ *               cb         - called when the request completes, or NULL.
+ *               ctx        - passed through to cb.
+ * 
+ * Returns     : 1 if the request was submitted, 0 if another request has not
+ *               yet completed.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_WriteBlockAsync(uint32_t blckAddr, const uint8_t dataArr[],
+                           SDAsyncCallback cb, void *ctx);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        POLL ASYNC REQUEST
+ * 
+ * Description : Checks on the submitted request. If it has completed, its 
+ *               callback is called and the engine becomes idle, ready for the
+ *               next request.
+ * 
+ * Returns     : SD_ASYNC_IDLE, SD_ASYNC_BUSY, or SD_ASYNC_DONE, which is 
+ *               returned once for each request, on the call that completed it.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_AsyncPoll(void);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      GET ASYNC RESULT
+ * 
+ * Returns     : result of the last completed request. Same as the err passed
+ *               to its callback.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_AsyncResult(void);
+
+#endif //SD_SPI_ASYNC_H
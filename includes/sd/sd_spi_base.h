@@ -20,7 +20,12 @@
  *                                   to define CS_ASSERT in this file.
  *                 SS_DD_OUT       - sets the data direction of the SPI SS pin
  *                                   so it operates as an output pin. Used in 
- *                                   pvt_initSPI in sd_spi_base.c.
+ *                                   sd_InitSPI in sd_spi_base.c.
+ *                 CS_PIN_HI(cs)   - as SS_HI, SS_LO and SS_DD_OUT, but for the
+ *                 CS_PIN_LO(cs)     pin described by the SPICsPin instance 
+ *                 CS_PIN_DD_OUT(cs) pointed to by cs. Used in place of the SS 
+ *                                   pin once a card is selected with 
+ *                                   sd_SelectCard (SD_SPI_CARD).
  *                 SPI_REG_BIT_LEN - the bit length of the SPI data register 
  *                                   to calculate number of SPI clock cycles in
  *                                   sd_WaitSPI in sd_spi_base.c.
@@ -28,18 +33,38 @@
  * The below SPI-specific fuctions are called from functions in sd_spi_base.c
  * 
  * SPI Functions : spi_MasterInit     - initializes target's SPI port into
- *                                      master mode. Called in pvt_initSPI.
+ *                                      master mode. Called in sd_InitSPI.
  *                 spi_MasterTransmit - transmits single byte via SPI. Called 
  *                                      in sd_SendByteSPI
  *                 spi_MasterReceive  - receives single byte via SPI. Called 
  *                                      in sd_ReceiveByteSPI
+ *                 spi_MasterTransmitBlock - transmits a block of bytes via
+ *                                      SPI. Called in sd_SendBlockSPI
+ *                 spi_MasterReceiveBlock  - receives a block of bytes via
+ *                                      SPI. Called in sd_ReceiveBlockSPI
+ *                 spi_SetClockRate   - sets the fastest SPI clock rate not
+ *                                      above the requested rate. Called in
+ *                                      sd_InitSPI and sd_InitReady
+ *
+ * If SD_SIM is defined, SIM_SPI is included in place of AVR_SPI and the module
+ * talks to the host-side SD card simulator in SIM_SD instead of an SPI port.
+ * If SD_USART_SPI is defined, AVR_USART_SPI is included in place of AVR_SPI
+ * and the card is driven by USART1 in Master SPI Mode.
  */
 
 #ifndef SD_SPI_BASE_H
 #define SD_SPI_BASE_H
 
+#ifdef SD_SIM
+#include "sim_spi.h"          // host-side simulated SPI module
+#elif defined(SD_USART_SPI)
+#include "avr_usart_spi.h"    // SPI module using USART1 in MSPIM mode
+#else
 #include "avr_spi.h"          // SPI module
+#endif
 #include "sd_spi_car.h"       // defs for SD Commands, Arguments, Responses
+#include "sd_spi_stats.h"     // compile-time SPI instrumentation hooks
+#include "sd_spi_crc.h"       // CRC7 / CRC16 and CRC check setting
 
 /*
  ******************************************************************************
@@ -49,14 +74,44 @@
 
 // 
 // CS_ASSERT and CS_DEASSERT control the SD card's Chip Select (CS) pin to 
-// enable and disable SPI communication to the card.
+// enable and disable SPI communication to the card. CS_ASSERT also opens a new
+// transaction so the first command sent with sd_SendCommand will wait for the
+// card to be ready (see sd_SendCommand). The CS pin is the SPI module's SS pin
+// unless a card has been selected with sd_SelectCard (see sd_CsPin).
 // 
-#define CS_ASSERT       SS_LO               // enables card by setting CS low
-#define CS_DEASSERT     SS_HI               // disables card by setting CS high
+#define CS_LO           (sd_CsPin ? (void)(CS_PIN_LO(sd_CsPin)) : (void)(SS_LO))
+#define CS_HI           (sd_CsPin ? (void)(CS_PIN_HI(sd_CsPin)) : (void)(SS_HI))
+#define CS_ASSERT       (CS_LO, sd_TxnOpen = 0)  // enables card, CS low
+#define CS_DEASSERT     CS_HI               // disables card by setting CS high
 
 // Used for Send Command
 #define TX_CMD_BITS     0x40                // transmit bits (msb = 01)
 #define STOP_BIT        0x01                // final bit sent in a cmd/arg
+#define CMD_FRAME_LEN   6                   // bytes in a cmd/arg/crc frame
+
+
+/* 
+ * ----------------------------------------------------------------------------
+ *                                                        FIXED COMMAND FRAMES
+ * 
+ * Description : Indexes of the precomputed frames sent by sd_SendFixedCommand.
+ *               Each is the frame of a command that is always sent with an 
+ *               argument of 0.
+ * 
+ * Notes       : FRAME_SEND_STATUS is also the frame of SD_STATUS (ACMD13).
+ * ----------------------------------------------------------------------------
+ */
+#define FRAME_GO_IDLE_STATE       0         // CMD0
+#define FRAME_SEND_CSD            1         // CMD9
+#define FRAME_SEND_CID            2         // CMD10
+#define FRAME_STOP_TRANSMISSION   3         // CMD12
+#define FRAME_SEND_STATUS         4         // CMD13
+#define FRAME_SEND_NUM_WR_BLOCKS  5         // ACMD22
+#define FRAME_ERASE               6         // CMD38
+#define FRAME_SEND_SCR            7         // ACMD51
+#define FRAME_APP_CMD             8         // CMD55
+#define FRAME_READ_OCR            9         // CMD58
+#define NUM_OF_FIXED_FRAMES       10
 
 // Max number of attempts to check for valid command response from SD card.
 #define MAX_ATTEMPTS    0xFE  
@@ -81,7 +136,10 @@
  *        
  * Notes       : Set to either SDHC or SDSC. Recommend setting to SDHC, which 
  *               supports SDSC by default. This setting is used to inform the 
- *               card the version the host is capable of supporting.
+ *               card the version the host is capable of supporting. SDHC 
+ *               also accepts SDXC and over 2TB (SDUC) cards, which are block
+ *               addressed as SDHC. Only the first 2TB of an SDUC card can be
+ *               addressed, as 32-bit block addresses are used.
  * ----------------------------------------------------------------------------
  */
 #define HOST_CAPACITY_SUPPORT  SDHC
@@ -100,6 +158,114 @@
 #define BLOCK_LEN       512
 
 
+/* 
+ * ----------------------------------------------------------------------------
+ *                                                              SPI CLOCK RATES
+ * 
+ * Description : SD_INIT_CLK_RATE is the max SPI clock rate (Hz) allowed while
+ *               the card is being initialized. SD_DFLT_CLK_RATE is the rate of
+ *               the default speed mode supported by all cards. It is used if
+ *               TRAN_SPEED can not be read from the CSD.
+ * 
+ * Notes       : Once the card is out of the idle state, sd_InitModeSPI sets
+ *               the SPI clock to the max data transfer rate given by TRAN_SPEED
+ *               or the fastest rate of the SPI port, whichever is lower.
+ * ----------------------------------------------------------------------------
+ */
+#define SD_INIT_CLK_RATE        400000
+#define SD_DFLT_CLK_RATE        25000000
+#define SD_HS_CLK_RATE          50000000    // high speed, see sd_SwitchHighSpeed
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                              CSD TRAN_SPEED (MAX DATA RATE)
+ * 
+ * Description : TRAN_SPEED is byte 3 of the CSD in all CSD versions. Bits 2:0
+ *               are the rate unit (100kbit/s * 10^unit) and bits 6:3 are the
+ *               time value, a multiplier of 1.0 to 8.0 (0 is reserved).
+ * ----------------------------------------------------------------------------
+ */
+#define CSD_LEN                 16          // bytes in CSD register
+#define CSD_TRAN_SPEED_BYTE     3
+#define TRAN_SPEED_UNIT_MASK    0x07
+#define TRAN_SPEED_TV_MASK      0x78
+#define TRAN_SPEED_TV_SHIFT     3
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          TIMEOUTS (MS)
+ * 
+ * Description : Timeouts of the waits on the card, in milliseconds. The read
+ *               and write timeouts are the max given by the SD spec. SDHC 
+ *               cards always use them. For SDSC cards, sd_InitModeSPI 
+ *               calculates them from the CSD as 100 * (TAAC + NSAC) and 
+ *               100 * (TAAC + NSAC) * R2W_FACTOR, limited to these values.
+ * 
+ *               SD_READ_TIMEOUT_MS       - start token after a read command.
+ *               SD_WRITE_TIMEOUT_MS      - busy after a block is written. Also
+ *                                          used per block for erases.
+ *               SD_INIT_TIMEOUT_MS       - ACMD41 initialization.
+ *               SD_ERASE_TIMEOUT_MAX_MS  - limit on the busy after an erase.
+ * ----------------------------------------------------------------------------
+ */
+#define SD_READ_TIMEOUT_MS        100
+#define SD_WRITE_TIMEOUT_MS       250
+#define SD_INIT_TIMEOUT_MS        1000
+#define SD_ERASE_TIMEOUT_MAX_MS   60000
+
+// CSD fields used to calculate the timeouts. TAAC time value is as TRAN_SPEED.
+#define CSD_STRUCTURE_BYTE      0
+#define CSD_STRUCTURE_SHIFT     6
+#define CSD_TAAC_BYTE           1
+#define TAAC_UNIT_MASK          0x07        // 1ns * 10^unit
+#define CSD_NSAC_BYTE           2           // units of 100 clock cycles
+#define CSD_R2W_FACTOR_BYTE     12
+#define R2W_FACTOR_MASK         0x1C        // 2^R2W_FACTOR
+#define R2W_FACTOR_SHIFT        2
+
+//
+// Timeouts are measured in ticks of Timer/Counter1 on the AVR target, run 
+// free at F_CPU/1024 once sd_InitModeSPI is called. In the host simulator 
+// build (SD_SIM) one tick is one SPI byte time.
+//
+#define SD_TIMER_PRESCALE       (1 << CS12 | 1 << CS10)
+#define SD_TIMER_HZ             (F_CPU / 1024)
+
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                       SWITCH FUNCTION STATUS
+ * 
+ * Description : SWITCH_FUNC (CMD6) returns its status as a 64 byte data block.
+ *               Byte 13 holds the functions of group 1 (access mode) the card
+ *               supports. The low nibble of byte 16 is the group 1 function 
+ *               that was, or would be, selected. 0xF if it can not be.
+ * ----------------------------------------------------------------------------
+ */
+#define SWITCH_STATUS_LEN           64
+#define SWITCH_GRP1_SUPPORT_BYTE    13
+#define SWITCH_GRP1_RESULT_BYTE     16
+#define SWITCH_GRP1_RESULT_MASK     0x0F
+#define SWITCH_FN_HIGH_SPEED        1
+
+
+/* 
+ * ----------------------------------------------------------------------------
+ *                                                     HIGH SPEED SWITCH FLAGS
+ * 
+ * Description : Returned by sd_SwitchHighSpeed. If HS_R1_ERROR is set, the 
+ *               lower byte holds the R1 response to SWITCH_FUNC.
+ * ----------------------------------------------------------------------------
+ */
+#define HS_SWITCH_SUCCESS       0x0100
+#define HS_NOT_SUPPORTED        0x0200
+#define HS_SWITCH_FAILED        0x0400
+#define HS_STATUS_ERROR         0x0800      // status block timeout or CRC
+#define HS_R1_ERROR             0x1000
+
+
 /* 
  * ----------------------------------------------------------------------------
  *                                                   INITIALIZATION ERROR FLAGS
@@ -136,8 +302,8 @@
 #define POWER_UP_BIT_MASK     0x80
 #define CCS_BIT_MASK          0x40          // Card Capacity Support
 #define UHSII_BIT_MASK        0x20          // UHS-II Card Status
-#define CO2T_BIT_MASK         0x10          // Over 2TB support status
-#define S18A_BIT_MASK         0x08          // switching to 1.8V accepted
+#define CO2T_BIT_MASK         0x08          // Over 2TB support status
+#define S18A_BIT_MASK         0x01          // switching to 1.8V accepted
 
 // Volt Range Accepted by card: 2.7 - 3.6V. Only this range has been tested.
 #define VRA_OCR_MASK          0xFF80
@@ -169,6 +335,70 @@ typedef struct CardTypeVersion{
     uint8_t type;
 } CTV;
 
+/*
+ * ----------------------------------------------------------------------------
+ *                                                              CARD TIMEOUTS
+ * 
+ * Members  : readMs   - max wait for the start token of a block read.
+ *            writeMs  - max busy time after a block is written.
+ * 
+ * Notes    : Set by sd_InitModeSPI. See TIMEOUTS (MS).
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SDTimeouts
+{
+  uint16_t readMs;
+  uint16_t writeMs;
+} SDTimeouts;
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                 WAIT TIMER
+ * 
+ * Members  : last       - tick at the previous check.
+ *            ticksLeft  - ticks remaining until the timeout.
+ * 
+ * Notes    : Use with sd_TimerStart and sd_TimerExpired only.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SDTimer
+{
+  uint16_t last;
+  uint32_t ticksLeft;
+} SDTimer;
+
+/*
+ ******************************************************************************
+ *                                  VARIABLES
+ ******************************************************************************
+ */
+
+//
+// Cleared by CS_ASSERT and set by sd_SendCommand once the first command of
+// the transaction has been sent. Should not be used directly.
+//
+extern uint8_t sd_TxnOpen;
+
+//
+// Set to the timeout (ms) of the busy when a write or erase returns while the
+// card may still be busy. Cleared once the card is seen to be ready. Should
+// not be used directly.
+//
+extern uint32_t sd_CardBusy;
+
+// Read and write timeouts of the card. Set by sd_InitModeSPI. Read only.
+extern SDTimeouts sd_Timeouts;
+
+// Difference between the addresses of consecutive blocks, 1 (SDHC) or 
+// BLOCK_LEN (SDSC). Set by sd_InitModeSPI. Read only.
+extern uint16_t sd_BlckAddrStep;
+
+//
+// CS pin of the card being accessed. NULL, the default, for the SPI module's 
+// SS pin. Set by sd_SelectCard (SD_SPI_CARD). Should not be used directly.
+//
+extern const SPICsPin *sd_CsPin;
+
 /*
  ******************************************************************************
  *                           FUNCTION PROTOTYPES
@@ -200,7 +430,8 @@ void sd_WaitSPI(uint16_t clkCycles);
  *
  * Description : Implements the SD Card SPI mode initialization routine and 
  *               sets the members of the CTV (Card Type and Version) struct
- *               instance. 
+ *               instance. The SPI clock is held at or below SD_INIT_CLK_RATE
+ *               until the card is out of idle, then set from TRAN_SPEED.
  *
  * Arguments   : ctv - ptr to CTV instance whose members are set during init.
  * 
@@ -213,6 +444,60 @@ void sd_WaitSPI(uint16_t clkCycles);
  */
 uint32_t sd_InitModeSPI(CTV *ctv);
 
+/*
+ * ----------------------------------------------------------------------------
+ *                                             SD CARD WARM RESET INITIALIZATION
+ *
+ * Description : Fast initialization for when the host has been reset but the 
+ *               card has not, e.g. after a watchdog reset. If SEND_STATUS 
+ *               shows the card is already out of the idle state, the CTV is
+ *               restored from ctv and only CRC_ON_OFF, READ_OCR and the SPI 
+ *               clock and timeout setup are done, skipping GO_IDLE_STATE and
+ *               the SD_SEND_OP_COND polling. Otherwise, or if the card type in
+ *               the OCR does not match ctv, sd_InitModeSPI is run instead.
+ *
+ * Arguments   : ctv - ptr to CTV instance holding the values set by the last
+ *                     initialization of the card, e.g. kept in RAM that is 
+ *                     not cleared on reset. Its members are set as by 
+ *                     sd_InitModeSPI.
+ * 
+ * Returns     : Initialization Response, as sd_InitModeSPI.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t sd_WarmInitModeSPI(CTV *ctv);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        INITIALIZATION STEPS
+ *
+ * Description : The steps of sd_InitModeSPI, for initializing more than one
+ *               card at a time (see sd_InitCards in SD_SPI_CARD). 
+ * 
+ *               sd_InitSPI         - initializes the SPI port at or below 
+ *                                    SD_INIT_CLK_RATE and starts the timer. 
+ *                                    At least 74 clock cycles must then be 
+ *                                    sent, with every card deselected, before
+ *                                    a card's first command.
+ *               sd_InitIdle        - GO_IDLE_STATE, SEND_IF_COND and 
+ *                                    CRC_ON_OFF. Sets ctv->version.
+ *               sd_InitSendOpCond  - a single APP_CMD / SD_SEND_OP_COND poll.
+ *               sd_InitReady       - READ_OCR, then sets ctv->type, the SPI 
+ *                                    clock rate and the timeouts. Call once 
+ *                                    sd_InitSendOpCond returns OUT_OF_IDLE.
+ *
+ * Arguments   : ctv - ptr to CTV instance whose members are set during init.
+ * 
+ * Returns     : IN_IDLE_STATE (sd_InitIdle), IN_IDLE_STATE or OUT_OF_IDLE
+ *               (sd_InitSendOpCond) and OUT_OF_IDLE (sd_InitReady) on 
+ *               success. Otherwise the Initialization Error Flags and R1 
+ *               response, as sd_InitModeSPI.
+ * ----------------------------------------------------------------------------
+ */
+void sd_InitSPI(void);
+uint32_t sd_InitIdle(CTV *ctv);
+uint32_t sd_InitSendOpCond(void);
+uint32_t sd_InitReady(CTV *ctv);
+
 /*
  * ----------------------------------------------------------------------------
  *                                                                    SEND BYTE
@@ -247,6 +532,42 @@ void sd_SendByteSPI(uint8_t byte);
  */
 uint8_t sd_ReceiveByteSPI(void);
 
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                   SEND BLOCK
+ * 
+ * Description : Sends len bytes from buf to the SD card via the SPI port.
+ * 
+ * Arguments   : buf    - pointer to the array of bytes to send.
+ *               len    - number of bytes to send.
+ * 
+ * Notes       : 1) Use in place of repeated calls to sd_SendByteSPI when
+ *                  sending a data packet. The SPI module's block transmit
+ *                  keeps the SPI data register loaded between bytes.
+ *               2) This function calls spi_MasterTransmitBlock. This, or a
+ *                  similarly operating function must be included.
+ * ----------------------------------------------------------------------------
+ */
+void sd_SendBlockSPI(const uint8_t *buf, uint16_t len);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                RECEIVE BLOCK
+ * 
+ * Description : Receives len bytes from the SD card via the SPI port into buf.
+ * 
+ * Arguments   : buf    - pointer to the array to be loaded with the bytes.
+ *               len    - number of bytes to receive.
+ * 
+ * Notes       : 1) Use in place of repeated calls to sd_ReceiveByteSPI when
+ *                  receiving a data packet. The SPI module's block receive
+ *                  starts the next transfer before storing the last byte.
+ *               2) This function calls spi_MasterReceiveBlock. This, or a
+ *                  similarly operating function must be included.
+ * ----------------------------------------------------------------------------
+ */
+void sd_ReceiveBlockSPI(uint8_t *buf, uint16_t len);
+
 /*
  * ----------------------------------------------------------------------------
  *                                                                 SEND COMMAND
@@ -256,10 +577,34 @@ uint8_t sd_ReceiveByteSPI(void);
  * 
  * Arguments   : cmd   - SD Card command.
  *               arg   - 32-bit argument to be sent with the SD command.
+ * 
+ * Notes       : On the first command after CS_ASSERT, dummy bytes are clocked
+ *               until the card returns DMY_TKN (not busy) before the command
+ *               is sent. The wait is limited to the write timeout, or to the 
+ *               erase timeout if an erase left the card busy. Further 
+ *               commands sent before the next CS_ASSERT, such as an ACMD 
+ *               following APP_CMD, or STOP_TRANSMISSION during a multi-block
+ *               read, are sent without waiting.
  * ----------------------------------------------------------------------------
  */
 void sd_SendCommand(uint8_t cmd, uint32_t arg);
 
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           SEND FIXED COMMAND
+ * 
+ * Description : Sends one of the precomputed command frames. Equivalent to 
+ *               calling sd_SendCommand with the frame's command and an 
+ *               argument of 0, but no frame is built and no CRC7 calculated,
+ *               so only the six frame bytes are sent.
+ * 
+ * Arguments   : frameIdx   - one of the FRAME_XXXX indexes.
+ * 
+ * Notes       : Waits for the card in the same way as sd_SendCommand.
+ * ----------------------------------------------------------------------------
+ */
+void sd_SendFixedCommand(uint8_t frameIdx);
+
 /*
  * ----------------------------------------------------------------------------
  *                                                              GET R1 RESPONSE
@@ -276,4 +621,98 @@ void sd_SendCommand(uint8_t cmd, uint32_t arg);
  */
 uint8_t sd_GetR1(void);
 
+/*
+ * ----------------------------------------------------------------------------
+ *                                                    RECEIVE SHORT DATA BLOCK
+ * 
+ * Description : Receives a register or status returned as a data block, once
+ *               its command's R1 has been received, then deasserts CS.
+ * 
+ * Arguments   : buf  - array to be loaded with the data.
+ *               len  - length of the data block in bytes.
+ * 
+ * Returns     : READ_SUCCESS, START_TOKEN_TIMEOUT or READ_CRC_ERROR. See 
+ *               READ BLOCK ERROR FLAGS in sd_spi_rwe.h.
+ * 
+ * Notes       : The CRC is only checked if SD_CRC_CHECK is 1.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_ReceiveDataBlock(uint8_t buf[], uint8_t len);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                               CARD IS BUSY
+ * 
+ * Description : Checks whether the card is still programming or erasing after
+ *               sd_WriteSingleBlock, sd_WriteMultipleBlocks or sd_EraseBlocks
+ *               returned. Clocks a single byte, and only if a write or erase
+ *               is still pending.
+ * 
+ * Returns     : 1 if the card is busy, else 0.
+ * 
+ * Notes       : Polling is optional. The next command waits for the card if
+ *               it is still busy.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_IsBusy(void);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                    SWITCH TO HIGH SPEED MODE
+ * 
+ * Description : Checks with SWITCH_FUNC (CMD6) whether the card supports the
+ *               high speed access mode and, if so, switches the card to it and
+ *               raises the SPI clock limit to SD_HS_CLK_RATE. The SPI module 
+ *               limits this to the fastest rate it supports.
+ * 
+ * Returns     : HS_SWITCH_SUCCESS, or one of the other HIGH SPEED SWITCH 
+ *               FLAGS. The card and SPI clock are unchanged unless 
+ *               HS_SWITCH_SUCCESS is returned.
+ * 
+ * Notes       : Call after sd_InitModeSPI. Version 1.0 cards do not support
+ *               CMD6 and return an R1 illegal command error.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_SwitchHighSpeed(void);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                         START / CHECK TIMER
+ * 
+ * Description : sd_TimerStart starts a timeout of ms milliseconds. 
+ *               sd_TimerExpired returns 1 once it has expired, else 0. 
+ *               sd_TimerExpired must be called at least every 4 seconds, as 
+ *               the AVR tick counter wraps after 2^16 ticks.
+ * 
+ * Arguments   : tmr  - ptr to the SDTimer instance.
+ *               ms   - timeout in milliseconds.
+ * ----------------------------------------------------------------------------
+ */
+void    sd_TimerStart(SDTimer *tmr, uint32_t ms);
+uint8_t sd_TimerExpired(SDTimer *tmr);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                            GET TIMER TICK
+ * 
+ * Returns     : current value of the free-running tick counter.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_GetTick(void);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                         ERASE TIMEOUT (MS)
+ * 
+ * Description : Busy timeout of an erase, write timeout per block erased, 
+ *               limited to SD_ERASE_TIMEOUT_MAX_MS.
+ * 
+ * Arguments   : startBlckAddr  - address of the first block to be erased.
+ *               endBlckAddr    - address of the last block to be erased.
+ * 
+ * Returns     : timeout in milliseconds.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t sd_EraseTimeoutMs(uint32_t startBlckAddr, uint32_t endBlckAddr);
+
 #endif //SD_SPI_BASE_H
@@ -0,0 +1,160 @@
+/*
+ * File       : SD_SPI_CACHE.H
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Write-back block cache in front of the SD_SPI_RWE block read and write 
+ * functions. Holds SD_CACHE_NUM_BLCKS blocks in RAM. Reads of a cached block
+ * are served without any SPI traffic and writes are held in the cache, marked
+ * dirty, until the block is evicted or sd_CacheFlush is called. The least 
+ * recently used block is evicted when a block not in the cache is accessed 
+ * and the cache is full. Dirty blocks with consecutive addresses are written
+ * back together with a single multi-block write.
+ *
+ * Requires SD_SPI_BASE and SD_SPI_RWE.
+ *
+ * Warning : Blocks accessed through the cache should not be written or erased
+ *           with the SD_SPI_RWE functions directly unless the cache is first
+ *           flushed and then invalidated with sd_CacheInvalidate.
+ */
+
+#ifndef SD_SPI_CACHE_H
+#define SD_SPI_CACHE_H
+
+/*
+ ******************************************************************************
+ *                                   MACROS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        CACHE SIZE (BLOCKS)
+ *
+ * Description : Number of blocks held by the cache, 1 to 255. Each block uses
+ *               BLOCK_LEN bytes of RAM plus 6 bytes of bookkeeping. May also 
+ *               be set with -DSD_CACHE_NUM_BLCKS=N on the compiler line.
+ * ----------------------------------------------------------------------------
+ */
+#ifndef SD_CACHE_NUM_BLCKS
+#define SD_CACHE_NUM_BLCKS      4
+#endif
+
+/*
+ ******************************************************************************
+ *                                   STRUCTS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                             CACHE COUNTERS
+ *
+ * Members  : hits        - block reads/writes served by a cached block.
+ *            misses      - block reads/writes that needed a new cache entry.
+ *            writeBacks  - dirty blocks written to the card.
+ *            writeCmds   - write commands used to write them. Less than 
+ *                          writeBacks when consecutive blocks were written
+ *                          with a single multi-block write.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SDCacheStats
+{
+  uint32_t hits;
+  uint32_t misses;
+  uint32_t writeBacks;
+  uint32_t writeCmds;
+} SDCacheStats;
+
+/*
+ ******************************************************************************
+ *                           FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                         INITIALIZE CACHE
+ * 
+ * Description : Empties the cache and clears its counters. Must be called 
+ *               after sd_InitModeSPI and before any other cache function.
+ * 
+ * Arguments   : ctv  - ptr to the CTV instance set by sd_InitModeSPI. The card
+ *                      type determines how consecutive block addresses are
+ *                      found (SDHC - block addressed, SDSC - byte addressed).
+ * ----------------------------------------------------------------------------
+ */
+void sd_CacheInit(const CTV *ctv);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        READ BLOCK VIA CACHE
+ * 
+ * Description : Copies the block at blckAddr into blckArr. If the block is not
+ *               in the cache it is first read from the card into the cache.
+ * 
+ * Arguments   : blckAddr   - address of the block to be read.
+ *               blckArr    - array of length BLOCK_LEN loaded with the block.
+ * 
+ * Returns     : READ_SUCCESS, or the error returned by sd_ReadSingleBlock. If
+ *               a dirty block had to be evicted and could not be written, the
+ *               write error is returned instead and blckArr is not loaded.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_CacheReadBlock(uint32_t blckAddr, uint8_t blckArr[]);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                       WRITE BLOCK VIA CACHE
+ * 
+ * Description : Copies dataArr into the cache entry for blckAddr and marks it
+ *               dirty. The block is written to the card when it is evicted or
+ *               sd_CacheFlush is called.
+ * 
+ * Arguments   : blckAddr   - address of the block to be written.
+ *               dataArr    - array of length BLOCK_LEN holding the data.
+ * 
+ * Returns     : WRITE_SUCCESS, or if a dirty block had to be evicted and could
+ *               not be written, the write error.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_CacheWriteBlock(uint32_t blckAddr, const uint8_t dataArr[]);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                 FLUSH CACHE
+ * 
+ * Description : Writes every dirty block in the cache to the card. The blocks
+ *               remain cached.
+ * 
+ * Returns     : WRITE_SUCCESS, or the first write error. Blocks that could not
+ *               be written remain dirty.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_CacheFlush(void);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                            INVALIDATE CACHE
+ * 
+ * Description : Empties the cache WITHOUT writing dirty blocks. Call after 
+ *               sd_CacheFlush if blocks are to be modified outside the cache.
+ * ----------------------------------------------------------------------------
+ */
+void sd_CacheInvalidate(void);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                     GET / RESET CACHE COUNTERS
+ * 
+ * Description : Copies the cache counters into stats / clears the counters.
+ * 
+ * Arguments   : stats  - ptr to the SDCacheStats instance to be loaded.
+ * ----------------------------------------------------------------------------
+ */
+void sd_CacheGetStats(SDCacheStats *stats);
+void sd_CacheResetStats(void);
+
+#endif //SD_SPI_CACHE_H
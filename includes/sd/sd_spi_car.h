@@ -62,6 +62,14 @@
 // Some constant cmd args used in this current implementation.
 //
 
+//
+// SWITCH_FUNC arguments. Function group 1 (access mode) is set to high speed
+// (1) and all other groups are left unchanged (0xF). Mode 0 checks the 
+// function, mode 1 (bit 31) switches to it.
+//
+#define SWITCH_CHECK_HS_ARG   0x00FFFFF1
+#define SWITCH_SET_HS_ARG     0x80FFFFF1
+
 //
 // SEND_IF_COND arguments
 //
@@ -78,8 +86,9 @@
 //
 // SD_SEND_OP_COND arguments
 //
+// HCS (bit 30) and HO2T (bit 27). See HOST_CAPACITY_SUPPORT.
 #if HOST_CAPACITY_SUPPORT == SDHC
-#define ACMD41_HCS_ARG 0x40000000
+#define ACMD41_HCS_ARG 0x48000000
 #else
 #define ACMD41_HCS_ARG 0
 #endif
@@ -0,0 +1,104 @@
+/*
+ * File       : SD_SPI_CARD.H
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Card handles for more than one SD card on the same SPI bus, each with its
+ * own chip select pin. sd_InitCards initializes all of the cards together,
+ * interleaving their SD_SEND_OP_COND (ACMD41) polling so that the cards leave
+ * the idle state in parallel. Startup then takes about as long as the slowest
+ * card rather than the sum of the cards. sd_SelectCard then chooses the card
+ * that the functions of the other SD_SPI modules access.
+ *
+ * Requires SD_SPI_BASE.
+ *
+ * Warning : Only switch cards between operations. The block cache (SD_SPI_
+ *           CACHE) must be flushed and invalidated before switching, and no
+ *           asynchronous transfer (SD_SPI_ASYNC) may be in progress.
+ */
+
+#ifndef SD_SPI_CARD_H
+#define SD_SPI_CARD_H
+
+/*
+ ******************************************************************************
+ *                                   STRUCTS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                 CARD HANDLE
+ *
+ * Members  : ctv       - card type and version. Must be the first member so
+ *                        that a handle may be passed as a CTV.
+ *            cs        - the card's chip select pin. Set before sd_InitCards.
+ *            initResp  - the card's initialization response, as returned by
+ *                        sd_InitModeSPI. Set by sd_InitCards.
+ *
+ *            The remaining members hold the driver state of the card while
+ *            another card is selected. They should not be used directly.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SDCard
+{
+  CTV        ctv;
+  SPICsPin   cs;
+  uint32_t   initResp;
+  uint32_t   clkRate;
+  uint32_t   cardBusy;
+  SDTimeouts timeouts;
+  uint16_t   blckAddrStep;
+} SDCard;
+
+/*
+ ******************************************************************************
+ *                           FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        INITIALIZE ALL CARDS
+ *
+ * Description : Initializes every card in SPI mode. The SPI port is set up
+ *               and the power up clocks are sent once, for all of the cards.
+ *               Each card is then taken through GO_IDLE_STATE, SEND_IF_COND
+ *               and CRC_ON_OFF in turn. SD_SEND_OP_COND is then sent to each
+ *               card still idle in turn, until every card has left the idle
+ *               state, failed, or SD_INIT_TIMEOUT_MS has passed. A card is
+ *               finished (READ_OCR, SPI clock, timeouts) as soon as it leaves
+ *               the idle state.
+ *
+ * Arguments   : cards       - array of ptrs to the card handles. The cs member
+ *                             of each must be set.
+ *               numOfCards  - number of cards in the array.
+ *
+ * Returns     : number of cards initialized. The initResp member of each card
+ *               is OUT_OF_IDLE if it was initialized, otherwise it holds the
+ *               Initialization Error Flags and R1 response.
+ *
+ * Notes       : No card is selected when this returns. Call sd_SelectCard
+ *               before accessing a card.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_InitCards(SDCard *cards[], uint8_t numOfCards);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                 SELECT CARD
+ *
+ * Description : Selects the card accessed by the SD_SPI functions. The driver
+ *               state of the previous card - SPI clock rate, pending busy,
+ *               timeouts and addressing - is saved in its handle and that of
+ *               card is restored.
+ *
+ * Arguments   : card  - ptr to the handle of the card, initialized by
+ *                       sd_InitCards.
+ * ----------------------------------------------------------------------------
+ */
+void sd_SelectCard(SDCard *card);
+
+#endif //SD_SPI_CARD_H
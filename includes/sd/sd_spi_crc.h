@@ -0,0 +1,89 @@
+/*
+ * File       : SD_SPI_CRC.H
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Table-driven CRC functions for the SD card module. CRC7 protects command 
+ * frames and is always sent, as the card checks it on CMD0 and CMD8. CRC16 
+ * protects data blocks and is only used if SD_CRC_CHECK is set to 1, in which
+ * case the card's CRC checking is turned on during initialization, a CRC16 is
+ * sent with each data block written, and the CRC16 received with each data 
+ * block read is verified.
+ *
+ * The lookup tables are placed in program memory (PROGMEM) on the AVR.
+ *
+ * This file should only be included from sd_spi_base.h
+ */
+
+#ifndef SD_SPI_CRC_H
+#define SD_SPI_CRC_H
+
+/*
+ ******************************************************************************
+ *                                   MACROS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                            CRC CHECK ENABLE
+ *
+ * Description : Set to 1 to turn on CRC checking of commands and data blocks.
+ *               May also be set with -DSD_CRC_CHECK=1 on the compiler line.
+ * ----------------------------------------------------------------------------
+ */
+#ifndef SD_CRC_CHECK
+#define SD_CRC_CHECK        0
+#endif
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                            CRC16 TABLE SIZE
+ *
+ * Description : Set to 1 to calculate CRC16 a nibble at a time from a 16-entry
+ *               table (32 bytes) instead of a byte at a time from a 256-entry 
+ *               table (512 bytes). Slower, but uses less program memory.
+ * ----------------------------------------------------------------------------
+ */
+#ifndef SD_CRC16_NIBBLE
+#define SD_CRC16_NIBBLE     0
+#endif
+
+/*
+ ******************************************************************************
+ *                           FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      CALCULATE CRC7 CHECKSUM
+ * 
+ * Description : Calculates the CRC7 (x^7 + x^3 + 1) of a byte array.
+ * 
+ * Arguments   : buf   - pointer to the bytes the CRC7 is calculated over.
+ *               len   - number of bytes.
+ * 
+ * Returns     : CRC7 in the lower 7 bits.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_CRC7(const uint8_t *buf, uint8_t len);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                     CALCULATE CRC16 CHECKSUM
+ * 
+ * Description : Calculates the CRC16-CCITT (x^16 + x^12 + x^5 + 1, initial 
+ *               value 0) of a byte array, as used for SD card data blocks.
+ * 
+ * Arguments   : buf   - pointer to the bytes the CRC16 is calculated over.
+ *               len   - number of bytes.
+ * 
+ * Returns     : CRC16.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_CRC16(const uint8_t *buf, uint16_t len);
+
+#endif //SD_SPI_CRC_H
@@ -0,0 +1,275 @@
+/*
+ * File       : SD_SPI_INFO.H
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Reads the card's registers - CSD, CID, SCR, SD Status and OCR - and decodes
+ * every field into an SDCardInfo struct, which extends CTV. sd_ReadCardInfo
+ * is meant to be called once, after sd_InitModeSPI, so that the capacity,
+ * speed class, erase sizes and timeouts of the card can then be looked up
+ * without any further SPI traffic.
+ *
+ * Requires SD_SPI_BASE and SD_SPI_RWE.
+ */
+
+#ifndef SD_SPI_INFO_H
+#define SD_SPI_INFO_H
+
+/*
+ ******************************************************************************
+ *                                   MACROS
+ ******************************************************************************
+ */
+
+// Register lengths in bytes. CSD_LEN is in SD_SPI_BASE.
+#define CID_LEN                 16
+#define SCR_LEN                 8
+#define SD_STATUS_LEN           64
+#define OCR_LEN                 4
+
+// CSD_STRUCTURE values
+#define CSD_VSN_SDSC            0x00        // version 1.0 - SDSC
+#define CSD_VSN_SDHC            0x01        // version 2.0 - SDHC/SDXC
+#define CSD_VSN_SDUC            0x02        // version 3.0 - SDUC
+
+// MDT year field is years after this.
+#define CID_MDT_YEAR_BASE       2000
+
+/*
+ ******************************************************************************
+ *                                   STRUCTS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          CSD REGISTER FIELDS
+ *
+ * Description : Fields of the CSD register, named as in the SD spec. Single
+ *               bit fields are 0 or 1. The fields marked v1 are only present
+ *               in CSD version 1.0 (SDSC) and are 0 otherwise. cSize is 12 
+ *               bits in version 1.0, 22 bits in version 2.0 and 28 bits in 
+ *               version 3.0.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SDCsd
+{
+  uint8_t  csdStructure;
+  uint8_t  taac;
+  uint8_t  nsac;
+  uint8_t  tranSpeed;
+  uint16_t ccc;
+  uint8_t  readBlLen;
+  uint8_t  readBlPartial;
+  uint8_t  writeBlkMisalign;
+  uint8_t  readBlkMisalign;
+  uint8_t  dsrImp;
+  uint32_t cSize;
+  uint8_t  vddRCurrMin;                     // v1
+  uint8_t  vddRCurrMax;                     // v1
+  uint8_t  vddWCurrMin;                     // v1
+  uint8_t  vddWCurrMax;                     // v1
+  uint8_t  cSizeMult;                       // v1
+  uint8_t  eraseBlkEn;
+  uint8_t  sectorSize;
+  uint8_t  wpGrpSize;
+  uint8_t  wpGrpEnable;
+  uint8_t  r2wFactor;
+  uint8_t  writeBlLen;
+  uint8_t  writeBlPartial;
+  uint8_t  fileFormatGrp;
+  uint8_t  copy;
+  uint8_t  permWriteProtect;
+  uint8_t  tmpWriteProtect;
+  uint8_t  fileFormat;
+} SDCsd;
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          CID REGISTER FIELDS
+ *
+ * Members  : mid       - manufacturer ID.
+ *            oid       - OEM/application ID, 2 ASCII chars, null terminated.
+ *            pnm       - product name, 5 ASCII chars, null terminated.
+ *            prv       - product revision, BCD n.m.
+ *            psn       - product serial number.
+ *            mdtYear   - manufacturing year, e.g. 2024.
+ *            mdtMonth  - manufacturing month, 1 to 12.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SDCid
+{
+  uint8_t  mid;
+  char     oid[3];
+  char     pnm[6];
+  uint8_t  prv;
+  uint32_t psn;
+  uint16_t mdtYear;
+  uint8_t  mdtMonth;
+} SDCid;
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          SCR REGISTER FIELDS
+ *
+ * Description : Fields of the SCR register, named as in the SD spec.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SDScr
+{
+  uint8_t scrStructure;
+  uint8_t sdSpec;
+  uint8_t dataStatAfterErase;
+  uint8_t sdSecurity;
+  uint8_t sdBusWidths;
+  uint8_t sdSpec3;
+  uint8_t exSecurity;
+  uint8_t sdSpec4;
+  uint8_t sdSpecX;
+  uint8_t cmdSupport;
+} SDScr;
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           SD STATUS FIELDS
+ *
+ * Description : Fields of the SD Status (ACMD13), named as in the SD spec.
+ *               speedClass and auSize hold the raw codes. See SDCardInfo for
+ *               the decoded values.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SDStatus
+{
+  uint8_t  datBusWidth;
+  uint8_t  securedMode;
+  uint16_t sdCardType;
+  uint32_t sizeOfProtectedArea;
+  uint8_t  speedClass;
+  uint8_t  performanceMove;
+  uint8_t  auSize;
+  uint16_t eraseSize;
+  uint8_t  eraseTimeout;
+  uint8_t  eraseOffset;
+  uint8_t  uhsSpeedGrade;
+  uint8_t  uhsAuSize;
+  uint8_t  videoSpeedClass;
+} SDStatus;
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                             CARD INFORMATION
+ *
+ * Members  : ctv               - card type and version. Must be the first
+ *                                member so the struct may be passed as a CTV,
+ *                                e.g. sd_InitModeSPI(&info.ctv).
+ *            ocr               - OCR register.
+ *            csd, cid, scr,    - the decoded registers.
+ *            status
+ *            byteCapacity      - capacity of the card in bytes.
+ *            numOfBlcks        - capacity of the card in blocks (BLOCK_LEN).
+ *                                See sd_CsdNumOfBlcks.
+ *            eraseSectorBlcks  - erase sector size in blocks (SECTOR_SIZE).
+ *            auBlcks           - allocation unit size in blocks (AU_SIZE). 0
+ *                                if not defined by the card.
+ *            speedClass        - speed class, 0 (class 0), 2, 4, 6 or 10.
+ *            timeouts          - read and write timeouts. See sd_Timeouts.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SDCardInfo
+{
+  CTV        ctv;
+  uint32_t   ocr;
+  SDCsd      csd;
+  SDCid      cid;
+  SDScr      scr;
+  SDStatus   status;
+  uint64_t   byteCapacity;
+  uint32_t   numOfBlcks;
+  uint32_t   eraseSectorBlcks;
+  uint32_t   auBlcks;
+  uint8_t    speedClass;
+  SDTimeouts timeouts;
+} SDCardInfo;
+
+/*
+ ******************************************************************************
+ *                           FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           READ CARD INFO
+ *
+ * Description : Reads all of the card's registers and decodes them into info.
+ *               Must be called after sd_InitModeSPI(&info->ctv). Fields of
+ *               registers that could not be read are left 0.
+ *
+ * Arguments   : info  - ptr to the SDCardInfo instance whose ctv member was
+ *                       set by sd_InitModeSPI.
+ *
+ * Returns     : READ_SUCCESS, or the error of the first register that could
+ *               not be read. See sd_ReadCSD.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_ReadCardInfo(SDCardInfo *info);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        READ CARD REGISTERS
+ *
+ * Description : Read a single register from the card. The CSD (CMD9), CID
+ *               (CMD10), SCR (ACMD51) and SD Status (ACMD13) are returned as
+ *               data blocks. The OCR (CMD58) is returned with the R1.
+ *
+ * Arguments   : reg  - array of the register's length, XXX_LEN, loaded with
+ *                      the register as sent by the card, MSB first.
+ *               ocr  - loaded with the OCR.
+ *
+ * Returns     : READ_SUCCESS, START_TOKEN_TIMEOUT or READ_CRC_ERROR. If an R1
+ *               error occurs the returned response is the R1 error and the
+ *               R1_ERROR flag is set to indicate this.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_ReadCSD(uint8_t reg[]);
+uint16_t sd_ReadCID(uint8_t reg[]);
+uint16_t sd_ReadSCR(uint8_t reg[]);
+uint16_t sd_ReadSDStatus(uint8_t reg[]);
+uint16_t sd_ReadOCR(uint32_t *ocr);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      DECODE CARD REGISTERS
+ *
+ * Description : Decode the registers read by the functions above into their
+ *               fields. No SPI traffic.
+ *
+ * Arguments   : reg  - the register as read from the card.
+ *               xxx  - ptr to the struct instance to be loaded.
+ * ----------------------------------------------------------------------------
+ */
+void sd_DecodeCSD(const uint8_t reg[], SDCsd *csd);
+void sd_DecodeCID(const uint8_t reg[], SDCid *cid);
+void sd_DecodeSCR(const uint8_t reg[], SDScr *scr);
+void sd_DecodeSDStatus(const uint8_t reg[], SDStatus *status);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          CAPACITY FROM CSD
+ *
+ * Description : Calculates the capacity of the card from its CSD fields.
+ *               sd_CsdNumOfBlcks is limited to 0xFFFFFFFF blocks (2TB), the
+ *               blocks that can be addressed with a 32-bit block address.
+ *
+ * Arguments   : csd  - ptr to the decoded CSD.
+ *
+ * Returns     : capacity in bytes / in blocks of BLOCK_LEN bytes. 0 if the CSD
+ *               version is not supported.
+ * ----------------------------------------------------------------------------
+ */
+uint64_t sd_CsdByteCapacity(const SDCsd *csd);
+uint32_t sd_CsdNumOfBlcks(const SDCsd *csd);
+
+#endif //SD_SPI_INFO_H
@@ -0,0 +1,227 @@
+/*
+ * File       : SD_SPI_LOG.H
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Ring log of records on a range of raw blocks, for data logging without a
+ * file system. Records are collected into blocks in RAM and written with
+ * multi-block writes, SD_LOG_NUM_BLCKS blocks at a time. Each block is
+ * stamped with a sequence number and a CRC16, and the blocks are written to
+ * the range in order, wrapping to its first block when the end is reached.
+ *
+ * A block's sequence number is that of the first block of the range plus the
+ * block's offset in the range, up to the newest block, and not after it. The
+ * newest block is therefore found at mount by bisection, reading about
+ * log2(number of blocks) blocks rather than the whole range. A block left
+ * torn by a power failure fails its CRC and is not part of the log, so the
+ * log is mounted up to the last block that was completely written.
+ *
+ * Requires SD_SPI_BASE, SD_SPI_RWE and SD_SPI_CRC.
+ */
+
+#ifndef SD_SPI_LOG_H
+#define SD_SPI_LOG_H
+
+/*
+ ******************************************************************************
+ *                                   MACROS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          LOG BUFFER BLOCKS
+ *
+ * Description : Number of blocks collected in RAM before they are written to
+ *               the card with one multi-block write. Each costs BLOCK_LEN
+ *               bytes of RAM in the SDLog instance. Define before the build
+ *               to change.
+ * ----------------------------------------------------------------------------
+ */
+#ifndef SD_LOG_NUM_BLCKS
+#define SD_LOG_NUM_BLCKS        2
+#endif
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                              LOG BLOCK LAYOUT
+ *
+ * Description : Each log block begins with a header of LOG_MAGIC (2 bytes),
+ *               the block's sequence number (4 bytes) and the number of data
+ *               bytes in the block (2 bytes), all most significant byte
+ *               first. The data follows the header, and the last 2 bytes of
+ *               the block are the CRC16 of the rest of the block. Within the
+ *               data, each record is stored as its length (1 byte) followed
+ *               by its bytes. A record is never split across blocks.
+ * ----------------------------------------------------------------------------
+ */
+#define LOG_MAGIC               0x4C47
+#define LOG_HDR_LEN             8
+#define LOG_CRC_LEN             2
+#define LOG_DATA_LEN            (BLOCK_LEN - LOG_HDR_LEN - LOG_CRC_LEN)
+#define LOG_MAX_RECORD_LEN      255
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                            LOG RESULT FLAGS
+ *
+ * Description : Returned by the log functions. LOG_READ_ERROR, LOG_WRITE_ERROR
+ *               and LOG_ERASE_ERROR are returned if the card failed the
+ *               operation. The log is unchanged by a failed write, so the
+ *               write is retried by the next sd_LogFlush.
+ * ----------------------------------------------------------------------------
+ */
+#define LOG_SUCCESS             0x01
+#define LOG_INVALID_RECORD      0x02
+#define LOG_READ_ERROR          0x04
+#define LOG_WRITE_ERROR         0x08
+#define LOG_ERASE_ERROR         0x10
+#define LOG_NO_BLOCK            0x20
+
+/*
+ ******************************************************************************
+ *                                   STRUCTS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                    RING LOG
+ *
+ * Members  : startBlckNum  - number of the first block of the log's range.
+ *            numOfBlcks    - number of blocks in the range.
+ *            head          - offset in the range of the next block written.
+ *            nextSeq       - sequence number of the next block written.
+ *
+ *            The remaining members hold the blocks not yet written to the
+ *            card. They should not be used directly.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SDLog
+{
+  uint32_t startBlckNum;
+  uint32_t numOfBlcks;
+  uint32_t head;
+  uint32_t nextSeq;
+  uint8_t  numOfFull;                       // full blocks in buf
+  uint16_t pos;                             // data bytes in buf[numOfFull]
+  uint8_t  buf[SD_LOG_NUM_BLCKS][BLOCK_LEN];
+} SDLog;
+
+/*
+ ******************************************************************************
+ *                           FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                  FORMAT LOG
+ *
+ * Description : Erases the log's range and starts an empty log on it.
+ *
+ * Arguments   : log           - ptr to the SDLog instance.
+ *               startBlckNum  - number of the first block of the range.
+ *               numOfBlcks    - number of blocks in the range. At least 2.
+ *
+ * Returns     : LOG_SUCCESS or LOG_ERASE_ERROR.
+ *
+ * Notes       : A range that has not been used by a log before must be
+ *               formatted, as old data in it could otherwise be taken for
+ *               log blocks.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_LogFormat(SDLog *log, uint32_t startBlckNum, uint32_t numOfBlcks);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                   MOUNT LOG
+ *
+ * Description : Finds the newest block of the log on the range by bisection
+ *               and sets the log up to append after it.
+ *
+ * Arguments   : log           - ptr to the SDLog instance.
+ *               startBlckNum  - number of the first block of the range.
+ *               numOfBlcks    - number of blocks in the range. At least 2.
+ *
+ * Returns     : LOG_SUCCESS or LOG_READ_ERROR. An empty log is mounted with
+ *               head and nextSeq 0.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_LogMount(SDLog *log, uint32_t startBlckNum, uint32_t numOfBlcks);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                               APPEND RECORD
+ *
+ * Description : Appends a record to the log. The record is added to the block
+ *               in RAM. If it does not fit, the block is closed and the
+ *               record starts the next one. The blocks are written to the
+ *               card when SD_LOG_NUM_BLCKS are full.
+ *
+ * Arguments   : log     - ptr to the SDLog instance.
+ *               rec     - the record's bytes.
+ *               recLen  - length of the record. 1 to LOG_MAX_RECORD_LEN.
+ *
+ * Returns     : LOG_SUCCESS, LOG_INVALID_RECORD if recLen is 0, or
+ *               LOG_WRITE_ERROR if the full blocks could not be written.
+ *               The record is not appended if an error is returned.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_LogAppend(SDLog *log, const uint8_t rec[], uint8_t recLen);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                   FLUSH LOG
+ *
+ * Description : Writes the blocks in RAM to the card, including the block in
+ *               progress. That block is closed, so the next record starts a
+ *               new block.
+ *
+ * Arguments   : log  - ptr to the SDLog instance.
+ *
+ * Returns     : LOG_SUCCESS or LOG_WRITE_ERROR.
+ *
+ * Notes       : Flushing often fills the range with partly used blocks.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_LogFlush(SDLog *log);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                              READ LOG BLOCK
+ *
+ * Description : Reads a block of the log from the card and checks it.
+ *
+ * Arguments   : log      - ptr to the SDLog instance.
+ *               age      - 0 for the newest block written to the card, 1 for
+ *                          the one before it, and so on.
+ *               blckArr  - array of length BLOCK_LEN the block is read into.
+ *
+ * Returns     : LOG_SUCCESS, LOG_READ_ERROR, or LOG_NO_BLOCK if the block is
+ *               not in the log, having not been written or been overwritten.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_LogReadBlock(const SDLog *log, uint32_t age, uint8_t blckArr[]);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                  GET RECORD
+ *
+ * Description : Gets a record from a block read with sd_LogReadBlock.
+ *
+ * Arguments   : blckArr  - the block.
+ *               pos      - ptr to the position of the record in the block's
+ *                          data. Set to 0 for the first record. Advanced to
+ *                          the next record.
+ *               rec      - ptr set to the record's bytes.
+ *
+ * Returns     : length of the record, or 0 if there are no more records.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_LogGetRecord(const uint8_t blckArr[], uint16_t *pos,
+                        const uint8_t **rec);
+
+#endif //SD_SPI_LOG_H
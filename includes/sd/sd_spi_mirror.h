@@ -0,0 +1,132 @@
+/*
+ * File       : SD_SPI_MIRROR.H
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Mirrors (RAID-1) blocks across two cards on the same SPI bus. Every write
+ * goes to both cards, so every block written is clocked over the bus twice.
+ * A card programs a block while the block is sent to the other card, so the
+ * cards' busy times are hidden behind the transfers rather than added to
+ * them. Reads alternate between the cards and fall back to the other card if
+ * a read fails.
+ *
+ * Blocks are given by block number rather than address, as the two cards may
+ * be of different types (SDSC / SDHC).
+ *
+ * Requires SD_SPI_BASE, SD_SPI_RWE and SD_SPI_CARD.
+ */
+
+#ifndef SD_SPI_MIRROR_H
+#define SD_SPI_MIRROR_H
+
+/*
+ ******************************************************************************
+ *                                   MACROS
+ ******************************************************************************
+ */
+
+#define MIRROR_NUM_OF_CARDS     2
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          MIRROR RESULT FLAGS
+ *
+ * Description : Returned by the mirror functions. MIRROR_SUCCESS is set if
+ *               the blocks were written to, or read from, at least one card.
+ *               MIRROR_CARD0_ERROR / MIRROR_CARD1_ERROR is set for each card
+ *               the operation failed on. The card's response is then in the
+ *               resp member of the SDMirror instance.
+ * ----------------------------------------------------------------------------
+ */
+#define MIRROR_SUCCESS          0x01
+#define MIRROR_CARD0_ERROR      0x02
+#define MIRROR_CARD1_ERROR      0x04
+
+/*
+ ******************************************************************************
+ *                                   STRUCTS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                MIRRORED PAIR
+ *
+ * Members  : card      - ptrs to the handles of the two cards, initialized by
+ *                        sd_InitCards.
+ *            resp      - the response of each card to the last operation, as
+ *                        returned by the SD_SPI_RWE function used.
+ *            nextRead  - card the next read is sent to first. Alternated by
+ *                        the read functions.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SDMirror
+{
+  SDCard  *card[MIRROR_NUM_OF_CARDS];
+  uint16_t resp[MIRROR_NUM_OF_CARDS];
+  uint8_t  nextRead;
+} SDMirror;
+
+/*
+ ******************************************************************************
+ *                           FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                     MIRRORED WRITE BLOCK(S)
+ *
+ * Description : Writes the block(s) to both cards. sd_MirrorWriteBlock 
+ *               writes the block to one card and then the other with 
+ *               sd_WriteSingleBlock. sd_MirrorWriteBlocks opens a write 
+ *               stream (sd_WriteStreamOpen) on each card and sends each block
+ *               to one card and then the other, so each card programs a block
+ *               while the block is sent to the other card.
+ *
+ * Arguments   : mirror        - ptr to the SDMirror instance.
+ *               blckNum       - number of the (first) block to be written.
+ *               numOfBlcks    - number of blocks to write.
+ *               dataArr       - data to be written, BLOCK_LEN bytes per block.
+ *                               Not used by sd_MirrorWriteBlocks if blckSrc
+ *                               is not NULL.
+ *               blckSrc, ctx  - as sd_WriteMultipleBlocks. blckSrc is called
+ *                               once for each block, for both cards.
+ *
+ * Returns     : MIRROR RESULT FLAGS.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_MirrorWriteBlock(SDMirror *mirror, uint32_t blckNum,
+                            const uint8_t dataArr[]);
+uint8_t sd_MirrorWriteBlocks(SDMirror *mirror, uint32_t blckNum,
+                             uint32_t numOfBlcks, const uint8_t dataArr[],
+                             SDBlockSource blckSrc, void *ctx);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      MIRRORED READ BLOCK(S)
+ *
+ * Description : Reads the block(s) from one of the cards, alternating between
+ *               the cards on each call. If the read fails, it is completed on
+ *               the other card. sd_MirrorReadBlocks resumes from the first
+ *               block not passed to blckHndlr, or reads all of the blocks
+ *               again if blckHndlr is NULL.
+ *
+ * Arguments   : mirror          - ptr to the SDMirror instance.
+ *               blckNum         - number of the (first) block to be read.
+ *               numOfBlcks      - number of blocks to read.
+ *               blckArr         - as sd_ReadSingleBlock / sd_ReadMultipleBlocks.
+ *               blckHndlr, ctx  - as sd_ReadMultipleBlocks.
+ *
+ * Returns     : MIRROR RESULT FLAGS.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_MirrorReadBlock(SDMirror *mirror, uint32_t blckNum,
+                           uint8_t blckArr[]);
+uint8_t sd_MirrorReadBlocks(SDMirror *mirror, uint32_t blckNum,
+                            uint32_t numOfBlcks, uint8_t blckArr[],
+                            SDBlockHandler blckHndlr, void *ctx);
+
+#endif //SD_SPI_MIRROR_H
@@ -117,4 +117,18 @@ void sd_PrintEraseError(uint16_t err);
  * Note        : Array must be of length BLOCK_LEN.
  * ----------------------------------------------------------------------------
  */
-void sd_PrintSingleBlock(const uint8_t blckArr[]);
\ No newline at end of file
+void sd_PrintSingleBlock(const uint8_t blckArr[]);
+
+#if SD_STATS
+/*
+ * ----------------------------------------------------------------------------
+ *                                                 PRINT INSTRUMENTATION COUNTERS
+ * 
+ * Description : Prints the SPI instrumentation counters (see SD_SPI_STATS.H)
+ *               of every instrumented function, one function per row.
+ * 
+ * Note        : Only available when SD_STATS is set to 1.
+ * ----------------------------------------------------------------------------
+ */
+void sd_PrintStats(void);
+#endif
@@ -5,7 +5,8 @@
  * Author     : Joshua Fain
  * Copyright (c) 2020 - 2024
  * 
- * Interface for SD Card single-block (R)ead, (W)rite and multi-block (E)rase.
+ * Interface for SD Card single and multi-block (R)ead, (W)rite and 
+ * multi-block (E)rase.
  */
 
 #ifndef SD_SPI_RWE_H
@@ -27,6 +28,42 @@
  */
 #define START_BLOCK_TKN                0xFE
 
+/* 
+ * ----------------------------------------------------------------------------
+ *                                          MULTI-BLOCK WRITE START/STOP TOKENS
+ *
+ * Description : Tokens sent by the host during a multi-block write. Each block
+ *               is preceded by START_BLOCK_TKN_MBW and the data transfer is
+ *               ended by STOP_TRANSMIT_TKN_MBW.
+ * ----------------------------------------------------------------------------
+ */
+#define START_BLOCK_TKN_MBW            0xFC
+#define STOP_TRANSMIT_TKN_MBW          0xFD
+
+/* 
+ * ----------------------------------------------------------------------------
+ *                                                      MAX WRITE ERASE COUNT
+ *
+ * Description : Largest block count accepted by SET_WR_BLK_ERASE_COUNT. The
+ *               count is a 23-bit field.
+ * ----------------------------------------------------------------------------
+ */
+#define MAX_WR_BLK_ERASE_COUNT         0x7FFFFF
+
+/* 
+ * ----------------------------------------------------------------------------
+ *                                                           SCAN FINISH LENGTH
+ *
+ * Description : Used by sd_ScanBlocks. When a block is found to be in use 
+ *               with no more than this many of its bytes left to receive, the 
+ *               block is received to its end and the stream continues, as 
+ *               that is cheaper than stopping and restarting the stream 
+ *               (STOP_TRANSMISSION, READ_MULTIPLE_BLOCK and the read access
+ *               time).
+ * ----------------------------------------------------------------------------
+ */
+#define SCAN_FINISH_LEN                32
+
 /* 
  * ----------------------------------------------------------------------------
  *                                                         DATA RESPONSE TOKENS
@@ -63,6 +100,8 @@
  */
 #define READ_SUCCESS                   0x01
 #define START_TOKEN_TIMEOUT            0x02
+#define STOP_TRANSMISSION_ERROR        0x04
+#define READ_CRC_ERROR                 0x08   // only if SD_CRC_CHECK is 1
 
 
 /* 
@@ -77,7 +116,7 @@
 #define WRITE_ERROR_TKN_RECEIVED       0x04
 #define INVALID_DATA_RESPONSE          0x08
 #define DATA_RESPONSE_TIMEOUT          0x10
-#define CARD_BUSY_TIMEOUT              0x20
+#define CARD_BUSY_TIMEOUT              0x20   // between multi-block writes
 
 /* 
  * ----------------------------------------------------------------------------
@@ -93,7 +132,64 @@
 #define SET_ERASE_START_ADDR_ERROR     0x0200
 #define SET_ERASE_END_ADDR_ERROR       0x0400
 #define ERASE_ERROR                    0x0800
-#define ERASE_BUSY_TIMEOUT             0x1000
+#define ERASE_BUSY_TIMEOUT             0x1000 // no longer returned
+
+/* 
+ * ----------------------------------------------------------------------------
+ *                                                       COPY BLOCK ERROR FLAGS
+ *
+ * Description : flags returned by sd_CopyBlocks. COPY_INVALID_BUFFER is
+ *               returned if the batch buffer cannot hold a block.
+ * 
+ * Notes       : On COPY_READ_ERROR / COPY_WRITE_ERROR the response of the 
+ *               read / write that failed is also returned, in the lower byte
+ *               and the R1_ERROR flag.
+ * ----------------------------------------------------------------------------
+ */
+#define COPY_SUCCESS                   0x0100
+#define COPY_READ_ERROR                0x0200
+#define COPY_WRITE_ERROR               0x0400
+#define COPY_INVALID_BUFFER            0x0800
+
+/*
+ ******************************************************************************
+ *                                   TYPES
+ ******************************************************************************
+ */
+
+/* 
+ * ----------------------------------------------------------------------------
+ *                                                                BLOCK HANDLER
+ *
+ * Description : Function called by sd_ReadMultipleBlocks for each block as it
+ *               is streamed from the card.
+ * 
+ * Arguments   : blckIdx    - index of the block in the stream, beginning at 0.
+ *               blckArr    - the block's data. Length BLOCK_LEN.
+ *               ctx        - the ctx pointer passed to sd_ReadMultipleBlocks.
+ * 
+ * Returns     : 0 to continue the stream, non-zero to stop it after this block.
+ * ----------------------------------------------------------------------------
+ */
+typedef uint8_t (*SDBlockHandler)(uint32_t blckIdx, const uint8_t blckArr[],
+                                  void *ctx);
+
+/* 
+ * ----------------------------------------------------------------------------
+ *                                                                 BLOCK SOURCE
+ *
+ * Description : Function called by sd_WriteMultipleBlocks for the data of each
+ *               block, just before the block is sent to the card.
+ * 
+ * Arguments   : blckIdx    - index of the block in the stream, beginning at 0.
+ *               ctx        - the ctx pointer passed to sd_WriteMultipleBlocks.
+ * 
+ * Returns     : pointer to the block's data, BLOCK_LEN bytes, which must stay
+ *               valid until the next call. NULL ends the stream without 
+ *               writing any further blocks.
+ * ----------------------------------------------------------------------------
+ */
+typedef const uint8_t *(*SDBlockSource)(uint32_t blckIdx, void *ctx);
 
 /*
  ******************************************************************************
@@ -121,6 +217,97 @@
  */
 uint16_t sd_ReadSingleBlock(uint32_t blckAddr, uint8_t blckArr[]);
 
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          READ MULTIPLE BLOCKS
+ * 
+ * Description : Streams numOfBlcks consecutive data blocks from the SD card, 
+ *               beginning at startBlckAddr, using READ_MULTIPLE_BLOCK (CMD18).
+ *               STOP_TRANSMISSION (CMD12) is sent once the last block has been
+ *               received, or when blckHndlr requests the stream be stopped.
+ * 
+ * Arguments   : startBlckAddr  - address of the first block to be read.
+ *               numOfBlcks     - number of blocks to read.
+ *               blckArr        - if blckHndlr is NULL, the array the blocks
+ *                                are loaded into, one after the other. It must
+ *                                be of length numOfBlcks * BLOCK_LEN. If
+ *                                blckHndlr is not NULL, each block is loaded 
+ *                                into this array before blckHndlr is called
+ *                                and it need only be of length BLOCK_LEN.
+ *               blckHndlr      - function called with each block, or NULL.
+ *                                See SDBlockHandler.
+ *               ctx            - passed through to blckHndlr.
+ * 
+ * Returns     : If an R1 error occurs when sending the READ command the 
+ *               returned response is the R1 error and the R1_ERROR flag is 
+ *               set to indicate this. If no R1 error occurs, the function 
+ *               returns one of the READ BLOCK ERROR flags.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_ReadMultipleBlocks(uint32_t startBlckAddr, uint32_t numOfBlcks, 
+                               uint8_t blckArr[], SDBlockHandler blckHndlr,
+                               void *ctx);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                  SCAN BLOCKS
+ * 
+ * Description : Finds which of numOfBlcks consecutive blocks, beginning at 
+ *               startBlckAddr, hold data. The blocks are streamed with 
+ *               READ_MULTIPLE_BLOCK (CMD18) and each byte is compared with
+ *               erasedByte as it is received. A block is in use once a byte
+ *               differs, so the rest of it is not needed. The stream is then
+ *               stopped with STOP_TRANSMISSION (CMD12) part way through the
+ *               block, CS is deasserted, and the stream is restarted at the
+ *               next block. See SCAN_FINISH_LEN.
+ * 
+ * Arguments   : startBlckAddr  - address of the first block to scan.
+ *               numOfBlcks     - number of blocks to scan.
+ *               erasedByte     - byte value of erased data, 0x00 or 0xFF. See
+ *                                sd_GetErasedByte (SD_SPI_MISC).
+ *               bitmap         - bit i (bit i % 8 of bitmap[i / 8]) is set if
+ *                                block i of the scan is in use, and cleared 
+ *                                if it is erased. Must be of length 
+ *                                (numOfBlcks + 7) / 8.
+ * 
+ * Returns     : If an R1 error occurs when sending the READ command the 
+ *               returned response is the R1 error and the R1_ERROR flag is 
+ *               set to indicate this. If no R1 error occurs, the function 
+ *               returns one of the READ BLOCK ERROR flags.
+ * 
+ * Notes       : 1) Blocks whose bytes all equal erasedByte are taken to be
+ *                  erased, even if they were written.
+ *               2) The CRC of the blocks is not checked.
+ *               3) Bits of bitmap past the last block are not changed. If an
+ *                  error is returned, neither are the bits of the blocks from
+ *                  the one that failed.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_ScanBlocks(uint32_t startBlckAddr, uint32_t numOfBlcks,
+                       uint8_t erasedByte, uint8_t bitmap[]);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                              FIND DATA BLOCK
+ * 
+ * Description : Finds the first block in use of numOfBlcks consecutive 
+ *               blocks, beginning at startBlckAddr. The blocks are scanned as
+ *               by sd_ScanBlocks, and the stream is stopped at the first byte
+ *               that is not erased.
+ * 
+ * Arguments   : startBlckAddr  - address of the first block to scan.
+ *               numOfBlcks     - number of blocks to scan.
+ *               erasedByte     - byte value of erased data, 0x00 or 0xFF.
+ *               blckIdx        - ptr loaded with the index in the scan of the
+ *                                first block in use, or with numOfBlcks if 
+ *                                every block is erased.
+ * 
+ * Returns     : As sd_ScanBlocks.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_FindDataBlock(uint32_t startBlckAddr, uint32_t numOfBlcks,
+                          uint8_t erasedByte, uint32_t *blckIdx);
+
 /*
  * ----------------------------------------------------------------------------
  *                                                           WRITE SINGLE BLOCK
@@ -137,10 +324,79 @@ uint16_t sd_ReadSingleBlock(uint32_t blckAddr, uint8_t blckArr[]);
  *               returned response is the R1 error and the R1_ERROR 
  *               flag is set to indicate this. If no R1 error occurs, the 
  *               function returns one of the WRITE BLOCK ERROR flags.   
+ * 
+ * Notes       : Returns once the card accepts the data. The card may still be
+ *               programming the block. See sd_IsBusy.
  * ----------------------------------------------------------------------------
  */
 uint16_t sd_WriteSingleBlock(uint32_t blckAddr, const uint8_t dataArr[]);
 
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        WRITE MULTIPLE BLOCKS
+ * 
+ * Description : Streams data to numOfBlcks consecutive blocks on the SD card,
+ *               beginning at startBlckAddr, using WRITE_MULTIPLE_BLOCK (CMD25).
+ *               SET_WR_BLK_ERASE_COUNT (ACMD23) is sent first with numOfBlcks
+ *               so the card can pre-erase the blocks to be written.
+ * 
+ * Arguments   : startBlckAddr  - address of the first block to be written.
+ *               numOfBlcks     - number of blocks to write.
+ *               dataArr        - if blckSrc is NULL, the data to be written, 
+ *                                one block after the other. Must be of length
+ *                                numOfBlcks * BLOCK_LEN. Not used otherwise.
+ *               blckSrc        - function called for the data of each block, 
+ *                                or NULL. See SDBlockSource.
+ *               ctx            - passed through to blckSrc.
+ * 
+ * Returns     : If an R1 error occurs when sending ACMD23 or the WRITE command, 
+ *               the returned response is the R1 error and the R1_ERROR flag is
+ *               set to indicate this. If no R1 error occurs, the function 
+ *               returns one of the WRITE BLOCK ERROR flags.
+ * 
+ * Notes       : 1) If WRITE_ERROR_TKN_RECEIVED is returned, the number of 
+ *                  blocks written can be found with 
+ *                  sd_GetNumOfWellWrittenBlocks.
+ *               2) Returns once the Stop Transmission Token is sent. The card
+ *                  may still be programming the last block. See sd_IsBusy.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_WriteMultipleBlocks(uint32_t startBlckAddr, uint32_t numOfBlcks, 
+                                const uint8_t dataArr[], SDBlockSource blckSrc,
+                                void *ctx);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           WRITE BLOCK STREAM
+ * 
+ * Description : A multi-block write (WRITE_MULTIPLE_BLOCK) that is run one 
+ *               block per call, with CS deasserted between calls. The card 
+ *               programs each block while CS is deasserted, so the bus can be
+ *               used for another card in the meantime. sd_WriteStreamOpen 
+ *               sends ACMD23 and CMD25, sd_WriteStreamBlock sends the next
+ *               block, and sd_WriteStreamClose sends the Stop Transmission 
+ *               Token.
+ * 
+ * Arguments   : startBlckAddr  - address of the first block to be written.
+ *               numOfBlcks     - number of blocks that will be written.
+ *               blckData       - data of the block. Length BLOCK_LEN.
+ * 
+ * Returns     : sd_WriteStreamOpen returns as sd_WriteMultipleBlocks if an R1
+ *               error occurs, else WRITE_SUCCESS. sd_WriteStreamBlock and 
+ *               sd_WriteStreamClose return one of the WRITE BLOCK ERROR 
+ *               flags. CARD_BUSY_TIMEOUT is returned if the card is still 
+ *               programming the last block after the write timeout.
+ * 
+ * Notes       : 1) No other command may be sent to the card while its stream
+ *                  is open. The stream must be closed after an error.
+ *               2) The functions return without waiting for the card to 
+ *                  program the block. See sd_IsBusy.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_WriteStreamOpen(uint32_t startBlckAddr, uint32_t numOfBlcks);
+uint16_t sd_WriteStreamBlock(const uint8_t blckData[]);
+uint16_t sd_WriteStreamClose(void);
+
 /*
  * ----------------------------------------------------------------------------
  *                                                                 ERASE BLOCKS
@@ -155,9 +411,47 @@ uint16_t sd_WriteSingleBlock(uint32_t blckAddr, const uint8_t dataArr[]);
  *               response other OUT_OF_IDLE is returned by the SD card when
  *               issuing one of the in this function, then the R1_ERROR flag is
  *               also set and the lower byte will contain this R1 response.
+ * 
+ * Notes       : Returns once the card accepts the ERASE command. The card may
+ *               still be erasing. See sd_IsBusy.
  * ----------------------------------------------------------------------------
  */
 uint16_t sd_EraseBlocks(uint32_t startBlckAddr, uint32_t endBlckAddr);
 
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                  COPY BLOCKS
+ * 
+ * Description : Copies numOfBlcks consecutive blocks beginning at srcBlckAddr
+ *               to the blocks beginning at dstBlckAddr. The blocks are read
+ *               a batch at a time into the batch buffer with 
+ *               READ_MULTIPLE_BLOCK (CMD18), and the batch is then written
+ *               with WRITE_MULTIPLE_BLOCK (CMD25), so each command, access 
+ *               time and pre-erase is shared by the blocks of a batch. If the
+ *               ranges overlap with the destination after the source, the 
+ *               blocks are copied from the end of the range backwards.
+ * 
+ * Arguments   : srcBlckAddr   - address of the first block to be copied.
+ *               dstBlckAddr   - address of the block it is copied to.
+ *               numOfBlcks    - number of blocks to copy.
+ *               batch         - buffer the blocks are read into. 
+ *               batchLen      - length of batch. A batch is batchLen / 
+ *                               BLOCK_LEN blocks, and must be at least 1.
+ * 
+ * Returns     : COPY_SUCCESS, COPY_INVALID_BUFFER, or COPY_READ_ERROR / 
+ *               COPY_WRITE_ERROR with the response of the read / write that
+ *               failed. See COPY BLOCK ERROR FLAGS.
+ * 
+ * Notes       : 1) A card has a single data line, so a read cannot overlap a
+ *                  write. The card programs the last blocks written while the
+ *                  next READ_MULTIPLE_BLOCK waits for it.
+ *               2) On an error, the blocks of the reads and writes before the
+ *                  one that failed have been copied.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_CopyBlocks(uint32_t srcBlckAddr, uint32_t dstBlckAddr,
+                       uint32_t numOfBlcks, uint8_t batch[], 
+                       uint16_t batchLen);
+
 
 #endif // SD_SPI_RWE_H
@@ -0,0 +1,170 @@
+/*
+ * File       : SD_SPI_STATS.H
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Compile-time SPI instrumentation for the SD card module. When SD_STATS is
+ * set to 1, every byte clocked through sd_SendByteSPI / sd_ReceiveByteSPI (or
+ * their block forms, sd_SendBlockSPI / sd_ReceiveBlockSPI) and every polling
+ * iteration spent waiting on the card is recorded against the
+ * public function(s) that are currently executing. When SD_STATS is 0 (the
+ * default) all of the hook macros below expand to nothing.
+ *
+ * Accounting is inclusive: bytes clocked by sd_SendCommand while called from
+ * sd_ReadSingleBlock are counted against both functions.
+ *
+ * Elapsed time is measured in ticks of a free-running timer. On the AVR
+ * target this is Timer/Counter1, clocked at F_CPU/1024 and started by
+ * sd_InitModeSPI or sd_StatsReset (see sd_GetTick). In the host simulator
+ * build (SD_SIM) one tick is one SPI byte time.
+ *
+ * This file should only be included from sd_spi_base.h
+ */
+
+#ifndef SD_SPI_STATS_H
+#define SD_SPI_STATS_H
+
+/*
+ ******************************************************************************
+ *                                   MACROS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      INSTRUMENTATION ENABLE
+ *
+ * Description : Set to 1 to compile the SPI instrumentation into the module.
+ *               May also be set with -DSD_STATS=1 on the compiler line.
+ * ----------------------------------------------------------------------------
+ */
+#ifndef SD_STATS
+#define SD_STATS        0
+#endif
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                         INSTRUMENTED CALLS
+ *
+ * Description : Index of each instrumented public function. Pass to
+ *               sd_StatsGet to retrieve the counters for that function.
+ * ----------------------------------------------------------------------------
+ */
+#define SD_STATS_OP_INIT            0       // sd_InitModeSPI
+#define SD_STATS_OP_SEND_CMD        1       // sd_SendCommand
+#define SD_STATS_OP_READ            2       // sd_ReadSingleBlock
+#define SD_STATS_OP_WRITE           3       // sd_WriteSingleBlock
+#define SD_STATS_OP_ERASE           4       // sd_EraseBlocks
+#define SD_STATS_OP_READ_MULT       5       // sd_ReadMultipleBlocks
+#define SD_STATS_OP_WRITE_MULT      6       // sd_WriteMultipleBlocks
+#define SD_STATS_OP_SCAN            7       // sd_ScanBlocks
+#define SD_STATS_NUM_OPS            8
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      INSTRUMENTATION HOOKS
+ *
+ * Description : Placed in the SD module functions to record SPI traffic.
+ *
+ *               SD_STATS_BEGIN(op)     - start of an instrumented function.
+ *               SD_STATS_END(op, ret)  - wraps every return value of an
+ *                                        instrumented function, e.g.
+ *                                        return SD_STATS_END(op, READ_SUCCESS)
+ *               SD_STATS_SENT()        - a byte was sent to the card.
+ *               SD_STATS_DMY()         - a dummy byte was clocked to receive.
+ *               SD_STATS_SENT_N(n)     - n bytes were sent to the card.
+ *               SD_STATS_DMY_N(n)      - n dummy bytes were clocked to receive.
+ *               SD_STATS_POLL()        - one iteration of a loop waiting on an
+ *                                        R1 response, token, or busy signal.
+ * ----------------------------------------------------------------------------
+ */
+#if SD_STATS
+#define SD_STATS_BEGIN(op)          sd_StatsBegin(op)
+#define SD_STATS_END(op, ret)       (sd_StatsEnd(op), (ret))
+#define SD_STATS_SENT()             sd_StatsCount(SD_STATS_CNT_SENT, 1)
+#define SD_STATS_DMY()              sd_StatsCount(SD_STATS_CNT_DMY, 1)
+#define SD_STATS_SENT_N(n)          sd_StatsCount(SD_STATS_CNT_SENT, (n))
+#define SD_STATS_DMY_N(n)           sd_StatsCount(SD_STATS_CNT_DMY, (n))
+#define SD_STATS_POLL()             sd_StatsCount(SD_STATS_CNT_POLL, 1)
+#else
+#define SD_STATS_BEGIN(op)
+#define SD_STATS_END(op, ret)       (ret)
+#define SD_STATS_SENT()
+#define SD_STATS_DMY()
+#define SD_STATS_SENT_N(n)
+#define SD_STATS_DMY_N(n)
+#define SD_STATS_POLL()
+#endif
+
+// counter selectors for sd_StatsCount
+#define SD_STATS_CNT_SENT           0
+#define SD_STATS_CNT_DMY            1
+#define SD_STATS_CNT_POLL           2
+
+/*
+ ******************************************************************************
+ *                                   STRUCTS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                     INSTRUMENTATION COUNTERS
+ *
+ * Members  : calls      - num of times the function was called.
+ *            bytesSent  - bytes (command, token, data) sent to the card.
+ *            dmyBytes   - dummy bytes clocked to receive from the card.
+ *            pollIters  - polling iterations spent waiting for an R1
+ *                         response, start/data response token, or not-busy.
+ *            ticks      - elapsed timer ticks spent in the function.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SDStats
+{
+  uint32_t calls;
+  uint32_t bytesSent;
+  uint32_t dmyBytes;
+  uint32_t pollIters;
+  uint32_t ticks;
+} SDStats;
+
+/*
+ ******************************************************************************
+ *                           FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+#if SD_STATS
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                 RESET INSTRUMENTATION COUNTERS
+ *
+ * Description : Clears the counters of every instrumented function and starts
+ *               the tick timer.
+ * ----------------------------------------------------------------------------
+ */
+void sd_StatsReset(void);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                   GET INSTRUMENTATION COUNTERS
+ *
+ * Description : Copies the counters recorded for one instrumented function.
+ *
+ * Arguments   : op     - one of the SD_STATS_OP_XXXX indexes.
+ *               stats  - ptr to the SDStats instance to be loaded.
+ * ----------------------------------------------------------------------------
+ */
+void sd_StatsGet(uint8_t op, SDStats *stats);
+
+// Called through the hook macros above. Not to be called directly.
+void sd_StatsBegin(uint8_t op);
+void sd_StatsEnd(uint8_t op);
+void sd_StatsCount(uint8_t cnt, uint16_t n);
+
+#endif //SD_STATS
+
+#endif //SD_SPI_STATS_H
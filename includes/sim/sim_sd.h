@@ -0,0 +1,196 @@
+/*
+ * File       : SIM_SD.H
+ * Version    : 1.0
+ * Target     : Host (Linux)
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Description: Interface for a byte-accurate SD card simulator that runs on
+ *              the host. The simulated card sits behind the SPI functions in
+ *              SIM_SPI and behaves like an SD card operating in SPI mode. It
+ *              decodes command frames, returns R1/R2/R3/R7 responses, start
+ *              block tokens, data response tokens and busy periods, and
+ *              stores block data in a file-backed image.
+ *
+ *              The simulator also counts the SPI bytes that pass through it
+ *              so the byte cost of each SD module operation can be measured
+ *              without target hardware.
+ */
+
+#ifndef SIM_SD_H
+#define SIM_SD_H
+
+#include <stdint.h>
+
+/*
+ ******************************************************************************
+ *                                    MACROS
+ ******************************************************************************
+ */
+
+// Number of simulated cards that may share the bus. See sim_sd_OpenCard.
+#define SIM_MAX_CARDS         2
+
+// Block length of the simulated card. Only 512 is supported.
+#define SIM_BLOCK_LEN         512
+
+// Values returned by sim_sd_Open.
+#define SIM_OPEN_SUCCESS      0
+#define SIM_OPEN_FAILED       1
+
+// Card Capacity Status of the simulated card. Sets the addressing mode.
+#define SIM_CCS_SDSC          0             // byte addressed, CSD version 1
+#define SIM_CCS_SDHC          1             // block addressed, CSD version 2
+
+// Default simulated card settings. See SimCardConfig.
+#define SIM_DFLT_NUM_OF_BLCKS 0x40000       // 128 MB
+#define SIM_DFLT_IDLE_POLLS   3
+#define SIM_DFLT_ACCESS_DELAY 2
+#define SIM_DFLT_WRITE_BUSY   64
+#define SIM_DFLT_ERASE_BUSY   128
+
+/*
+ ******************************************************************************
+ *                                   STRUCTS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                   SIMULATED CARD CONFIGURATION
+ *
+ * Members  : numOfBlcks  - capacity of the card in blocks of SIM_BLOCK_LEN.
+ *            ccs         - SIM_CCS_SDHC or SIM_CCS_SDSC.
+ *            idlePolls   - num of ACMD41 polls that return IN_IDLE_STATE
+ *                          before the card leaves the idle state.
+ *            accessDelay - num of 0xFF bytes the card sends before the start
+ *                          block token of a read (NAC).
+ *            writeBusy   - num of busy (0x00) bytes following an accepted
+ *                          data block.
+ *            eraseBusy   - num of busy (0x00) bytes following ERASE.
+ *            co2t        - 1 for an over 2TB (SDUC) card. Requires ccs of
+ *                          SIM_CCS_SDHC. The card leaves the idle state only
+ *                          if ACMD41 sets HO2T, then sets CO2T in the OCR and
+ *                          returns a version 3 CSD. The capacity is still
+ *                          numOfBlcks.
+ *            idleBytes   - num of bytes clocked on the bus, selected or not,
+ *                          from the first ACMD41 before the card may leave
+ *                          the idle state. Models the card's power up time.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SimCardConfig
+{
+  uint32_t numOfBlcks;
+  uint8_t  ccs;
+  uint16_t idlePolls;
+  uint8_t  accessDelay;
+  uint16_t writeBusy;
+  uint16_t eraseBusy;
+  uint8_t  co2t;
+  uint32_t idleBytes;
+} SimCardConfig;
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           SIMULATOR COUNTERS
+ *
+ * Members  : bytes       - total num of bytes clocked through the SPI port.
+ *            selBytes    - num of bytes clocked while the card was selected.
+ *            cmds        - num of command frames decoded by the card.
+ *            busyBytes   - num of busy (0x00) bytes sent by the card.
+ *            blcksRead   - num of data blocks sent by the card.
+ *            blcksWrtn   - num of data blocks programmed into the image.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SimStats
+{
+  uint32_t bytes;
+  uint32_t selBytes;
+  uint32_t cmds;
+  uint32_t busyBytes;
+  uint32_t blcksRead;
+  uint32_t blcksWrtn;
+} SimStats;
+
+/*
+ ******************************************************************************
+ *                              FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      OPEN SIMULATED SD CARD
+ *
+ * Description : Creates a simulated card and attaches its backing image. 
+ *               sim_sd_Open opens card 0.
+ *
+ * Arguments   : cardNum  - card number, 0 to SIM_MAX_CARDS - 1.
+ *               imgPath  - path to the image file. It is created if it does
+ *                          not exist and extended to the card's capacity if
+ *                          it is too short. If NULL, an anonymous temporary
+ *                          image is used.
+ *               cfg      - card configuration. If NULL the SIM_DFLT_XXXX
+ *                          settings and an SDHC card are used.
+ *
+ * Returns     : SIM_OPEN_SUCCESS or SIM_OPEN_FAILED.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sim_sd_Open(const char *imgPath, const SimCardConfig *cfg);
+uint8_t sim_sd_OpenCard(uint8_t cardNum, const char *imgPath, 
+                        const SimCardConfig *cfg);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                     CLOSE SIMULATED SD CARD
+ *
+ * Description : Flushes and detaches the image of a simulated card. 
+ *               sim_sd_Close closes card 0.
+ *
+ * Arguments   : cardNum  - card number, 0 to SIM_MAX_CARDS - 1.
+ * ----------------------------------------------------------------------------
+ */
+void sim_sd_Close(void);
+void sim_sd_CloseCard(uint8_t cardNum);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                         SET CHIP SELECT LEVEL
+ *
+ * Description : Drives the CS line of a simulated card. sim_sd_SetCS drives 
+ *               the CS line of card 0.
+ *
+ * Arguments   : cardNum  - card number, 0 to SIM_MAX_CARDS - 1.
+ *               level    - 0 selects the card, any other value deselects it.
+ * ----------------------------------------------------------------------------
+ */
+void sim_sd_SetCS(uint8_t level);
+void sim_sd_SetCardCS(uint8_t cardNum, uint8_t level);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                             EXCHANGE SPI BYTE
+ *
+ * Description : Clocks a single byte through the simulated cards. Only the 
+ *               selected card drives DO.
+ *
+ * Arguments   : mosi  - byte sent to the card by the host.
+ *
+ * Returns     : byte sent by the card to the host during the same 8 clocks.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sim_sd_Exchange(uint8_t mosi);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                       GET / RESET COUNTERS
+ *
+ * Description : sim_sd_GetStats copies the simulator counters into stats.
+ *               sim_sd_ResetStats clears them.
+ * ----------------------------------------------------------------------------
+ */
+void sim_sd_GetStats(SimStats *stats);
+void sim_sd_ResetStats(void);
+
+#endif //SIM_SD_H
@@ -0,0 +1,154 @@
+/*
+ * File       : SIM_SPI.H
+ * Version    : 1.0
+ * Target     : Host (Linux)
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Description: Host-side replacement for AVR_SPI. Provides the SPI macros and
+ *              functions required by SD_SPI_BASE, but instead of driving an
+ *              SPI port every byte is exchanged with the simulated SD card in
+ *              SIM_SD. Selected in SD_SPI_BASE.H when SD_SIM is defined.
+ */
+
+#ifndef SIM_SPI_H
+#define SIM_SPI_H
+
+#include <stdint.h>
+#include "sim_sd.h"
+
+#ifndef F_CPU
+#define F_CPU       16000000UL                  // simulated target clk freq.
+#endif //F_CPU
+
+/*
+ ******************************************************************************
+ *                                    MACROS
+ ******************************************************************************
+ */
+
+// Common SPI operations. The SS pin is the simulated card's CS line.
+#define SS_LO        sim_sd_SetCS(0)                // set SS pin low
+#define SS_HI        sim_sd_SetCS(1)                // set SS pin high
+#define SS_DD_OUT                                   // nothing to configure
+
+// Operations on the CS line of the simulated card described by an SPICsPin.
+#define CS_PIN_LO(cs)      sim_sd_SetCardCS((cs)->card, 0)
+#define CS_PIN_HI(cs)      sim_sd_SetCardCS((cs)->card, 1)
+#define CS_PIN_DD_OUT(cs)  ((void)(cs))         // nothing to configure
+
+// Bit length of SPI data register
+#define SPI_REG_BIT_LEN      8
+
+// SPI clock divisor is 2^n, with n from 1 (F_CPU/2) to 7 (F_CPU/128).
+#define SPI_CLK_DIV_SHIFT_MIN   1
+#define SPI_CLK_DIV_SHIFT_MAX   7
+
+// No interrupts in the simulator. The transfer started by
+// spi_MasterStartTransmit has completed by the time it returns.
+#define SPI_INT_ENABLE
+#define SPI_INT_DISABLE
+
+/*
+ ******************************************************************************
+ *                                   STRUCTS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                             CHIP SELECT PIN
+ *
+ * Description : The CS line of one of the simulated cards sharing the bus. 
+ *               See CS_PIN_LO, CS_PIN_HI and CS_PIN_DD_OUT.
+ * 
+ * Members     : card  - simulated card number. See sim_sd_OpenCard.
+ * ----------------------------------------------------------------------------
+ */
+typedef struct SPICsPin
+{
+  uint8_t card;
+} SPICsPin;
+
+/*
+ ******************************************************************************
+ *                              FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                         INITIALIZE SPI PORT INTO MASTER MODE
+ *
+ * Description : Deselects the simulated card. There is no port to set up.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterInit(void);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                             SPI RECEIVE BYTE
+ *
+ * Description : Gets the byte returned by the simulated card during the last
+ *               call to spi_MasterTransmit.
+ *
+ * Returns     : byte received from the simulated card.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t spi_MasterReceive(void);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                            SPI TRANSMIT BYTE
+ *
+ * Description : Exchanges a byte with the simulated card.
+ *
+ * Arguments   : byte - data byte to be sent to the card.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterTransmit(uint8_t byte);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                    SPI START TRANSMIT BYTE
+ *
+ * Description : Same as spi_MasterTransmit. Provided for the interrupt-driven
+ *               users of AVR_SPI, which poll for completion instead.
+ *
+ * Arguments   : byte - data byte to be sent to the card.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterStartTransmit(uint8_t byte);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                 SPI RECEIVE / TRANSMIT BLOCK
+ *
+ * Description : Block forms of the above. spi_MasterReceiveBlock clocks 0xFF
+ *               for each byte and stores what the card returns in buf.
+ *               spi_MasterTransmitBlock sends len bytes from buf.
+ *
+ * Arguments   : buf  - array to load / array holding the bytes to send.
+ *               len  - number of bytes. Must be at least 1.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterReceiveBlock(uint8_t *buf, uint16_t len);
+void spi_MasterTransmitBlock(const uint8_t *buf, uint16_t len);
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                  SET / GET SPI CLOCK RATE
+ *
+ * Description : Same divisor selection as AVR_SPI. The simulated card is not
+ *               timed, so the rate is only recorded so that it can be checked.
+ *
+ * Arguments   : maxRate  - maximum SPI clock rate in Hz.
+ *
+ * Returns     : SPI clock rate in Hz that was set / is currently set.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t spi_SetClockRate(uint32_t maxRate);
+uint32_t spi_GetClockRate(void);
+
+#endif  //SIM_SPI_H
@@ -13,6 +13,9 @@
 #include <avr/io.h>
 #include "avr_spi.h"
 
+// divisor shift of the current SPI clock rate (F_CPU >> clkDivShift).
+static uint8_t clkDivShift = 6;
+
 /*
  ******************************************************************************
  *                                  FUNCTIONS
@@ -52,8 +55,9 @@ void spi_MasterInit(void)
   //SPCR: SPIE=0, SPE=1, DORD=0, MSTR=1, CPOL=0, CPHA=0, SPR1=1, SPR0=0
   SPCR = 1 << SPE | 1 << MSTR | 1 << SPR1;
 
-  //SPI2X = 0. Set to 1 to double clock rate.
+  //SPI2X = 0. Use spi_SetClockRate to change the rate once init.
   SPSR &= ~(1 << SPI2X);
+  clkDivShift = 6;
 }
 
 /*
@@ -88,3 +92,152 @@ void spi_MasterTransmit(uint8_t byte)
   while ( !(SPSR & 1 << SPIF))
     ;
 }
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                    SPI START TRANSMIT BYTE 
+ * 
+ * Description : Loads a byte into SPDR to start its transfer and returns 
+ *               without waiting for it to complete. Completion is signalled by
+ *               SPIF, or by the SPI_INT_VECT interrupt if SPI_INT_ENABLE is
+ *               set, after which the byte received can be read with 
+ *               spi_MasterReceive.
+ * 
+ * Arguments   : byte - data byte to be sent via SPI.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterStartTransmit(uint8_t byte)
+{
+  SPDR = byte;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           SPI RECEIVE BLOCK
+ * 
+ * Description : Receives a block of bytes via the SPI port operating in master
+ *               mode by clocking out 0xFF for each byte. The next transfer is
+ *               started as soon as the previous one completes and the received
+ *               byte is stored while the next one is being clocked.
+ * 
+ * Arguments   : buf  - pointer to the array to be loaded with the bytes read.
+ *               len  - number of bytes to receive. Must be at least 1.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterReceiveBlock(uint8_t *buf, uint16_t len)
+{
+  uint8_t byte;
+
+  // start the first transfer.
+  SPDR = 0xFF;
+
+  while (--len)
+  {
+    while ( !(SPSR & 1 << SPIF))
+      ;
+    byte = SPDR;                    // read received byte, clears SPIF
+    SPDR = 0xFF;                    // start the next transfer right away
+    *buf++ = byte;                  // store while the next byte is clocked
+  }
+
+  // last byte
+  while ( !(SPSR & 1 << SPIF))
+    ;
+  *buf = SPDR;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          SPI TRANSMIT BLOCK
+ * 
+ * Description : Sends a block of bytes via the SPI port operating in master
+ *               mode. The next byte is fetched while the current one is being
+ *               clocked so SPDR is reloaded as soon as the transfer completes.
+ * 
+ * Arguments   : buf  - pointer to the array holding the bytes to send.
+ *               len  - number of bytes to send. Must be at least 1.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterTransmitBlock(const uint8_t *buf, uint16_t len)
+{
+  uint8_t byte;
+
+  // start the first transfer.
+  SPDR = *buf++;
+
+  while (--len)
+  {
+    byte = *buf++;                  // fetch while the current byte is clocked
+    while ( !(SPSR & 1 << SPIF))
+      ;
+    SPDR = byte;
+  }
+
+  // wait for the last byte to complete.
+  while ( !(SPSR & 1 << SPIF))
+    ;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           SET SPI CLOCK RATE
+ * 
+ * Description : Sets the SPI clock to the fastest rate the SPI port supports
+ *               that does not exceed maxRate. The rate is F_CPU divided by
+ *               one of 2, 4, 8, 16, 32, 64 or 128.
+ * 
+ * Arguments   : maxRate  - maximum SPI clock rate in Hz.
+ * 
+ * Returns     : SPI clock rate in Hz that was set. If maxRate is below 
+ *               F_CPU/128 then the clock is set to F_CPU/128 and this is 
+ *               returned.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t spi_SetClockRate(uint32_t maxRate)
+{
+  uint8_t shift = SPI_CLK_DIV_SHIFT_MIN;
+  uint8_t spr;                              // SPR1:SPR0 bits
+  uint8_t dbl;                              // SPI2X bit
+
+  // find the smallest divisor that brings the clock down to maxRate.
+  while (shift < SPI_CLK_DIV_SHIFT_MAX && (F_CPU >> shift) > maxRate)
+    ++shift;
+
+  //
+  // Divisors 2, 8, 32 are the SPR settings for 4, 16, 64 with SPI2X set.
+  // Divisor 128 is only available with SPI2X cleared.
+  //
+  if (shift == SPI_CLK_DIV_SHIFT_MAX)
+  {
+    spr = 3;
+    dbl = 0;
+  }
+  else
+  {
+    dbl = shift & 1;
+    spr = (shift - 2 + dbl) / 2;
+  }
+
+  SPCR = (SPCR & ~(1 << SPR1 | 1 << SPR0)) | spr;
+  if (dbl)
+    SPSR |= 1 << SPI2X;
+  else
+    SPSR &= ~(1 << SPI2X);
+
+  clkDivShift = shift;
+  return F_CPU >> shift;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           GET SPI CLOCK RATE
+ * 
+ * Description : Gets the current SPI clock rate.
+ * 
+ * Returns     : SPI clock rate in Hz.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t spi_GetClockRate(void)
+{
+  return F_CPU >> clkDivShift;
+}
@@ -0,0 +1,212 @@
+/*
+ * File       : AVR_USART_SPI.C
+ * Version    : 1.0
+ * Target     : ATMega1280
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ * 
+ * Description: Implements AVR_USART_SPI.H using USART1 in Master SPI Mode.
+ */
+
+#include <avr/io.h>
+#include "avr_usart_spi.h"
+
+// last byte received. Returned by spi_MasterReceive.
+static uint8_t lastRx = 0xFF;
+
+/*
+ ******************************************************************************
+ *                                  FUNCTIONS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                         INITIALIZE SPI PORT INTO MASTER MODE
+ * 
+ * Description : Initialize USART1 into Master SPI Mode at F_CPU/64.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterInit(void)
+{
+  // chip select high (deasserted) and output.
+  CS_PORT |= 1 << CS_PIN;
+  CS_DDR |= 1 << CS_PIN;
+
+  // UBRR1 must be 0 when the transmitter is enabled. XCK1 output selects
+  // master mode.
+  UBRR1 = 0;
+  DDR_USPI |= 1 << DD_XCK | 1 << DD_TXD;
+
+  // MSPIM, MSB first, SPI mode 0 (UCPHA1 = 0, UCPOL1 = 0).
+  UCSR1C = 1 << UMSEL11 | 1 << UMSEL10;
+  UCSR1B = 1 << RXEN1 | 1 << TXEN1;
+
+  // F_CPU/64, as with AVR_SPI. Use spi_SetClockRate to change the rate.
+  UBRR1 = 31;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                             SPI RECEIVE BYTE
+ *                                       
+ * Description : Gets the byte received during the last completed transfer.
+ * 
+ * Returns     : byte received.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t spi_MasterReceive(void)
+{ 
+  // a transfer started by spi_MasterStartTransmit has not yet been read.
+  if (UCSR1A & 1 << RXC1)
+    lastRx = UDR1;
+  return lastRx;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                            SPI TRANSMIT BYTE 
+ * 
+ * Description : Sends a byte and waits for the transfer to complete.
+ * 
+ * Arguments   : byte - data byte to be sent via SPI.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterTransmit(uint8_t byte)
+{
+  while ( !(UCSR1A & 1 << UDRE1))
+    ;
+  UDR1 = byte;
+
+  // every byte sent clocks one in. Wait for it so it can be returned.
+  while ( !(UCSR1A & 1 << RXC1))
+    ;
+  lastRx = UDR1;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                    SPI START TRANSMIT BYTE 
+ * 
+ * Description : Loads a byte into UDR1 to start its transfer and returns 
+ *               without waiting for it to complete. Completion is signalled by
+ *               RXC1, or by the SPI_INT_VECT interrupt if SPI_INT_ENABLE is
+ *               set, after which the byte received can be read with 
+ *               spi_MasterReceive.
+ * 
+ * Arguments   : byte - data byte to be sent via SPI.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterStartTransmit(uint8_t byte)
+{
+  UDR1 = byte;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           SPI RECEIVE BLOCK
+ * 
+ * Description : Receives a block of bytes by clocking out 0xFF for each byte.
+ *               Two bytes are kept in flight so the clock runs continuously.
+ * 
+ * Arguments   : buf  - pointer to the array to be loaded with the bytes read.
+ *               len  - number of bytes to receive. Must be at least 1.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterReceiveBlock(uint8_t *buf, uint16_t len)
+{
+  uint16_t txLeft = len;                    // bytes still to be clocked out
+
+  //
+  // Never more than two bytes in flight (one shifting, one in the transmit 
+  // buffer), so the two-level receive buffer cannot overrun.
+  //
+  while (len)
+  {
+    if (txLeft && len - txLeft < 2 && (UCSR1A & 1 << UDRE1))
+    {
+      UDR1 = 0xFF;
+      --txLeft;
+    }
+    if (UCSR1A & 1 << RXC1)
+    {
+      *buf++ = UDR1;
+      --len;
+    }
+  }
+  lastRx = buf[-1];
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          SPI TRANSMIT BLOCK
+ * 
+ * Description : Sends a block of bytes. Each byte is loaded as soon as the 
+ *               transmit buffer is free, so the clock runs continuously. The
+ *               bytes received are discarded.
+ * 
+ * Arguments   : buf  - pointer to the array holding the bytes to send.
+ *               len  - number of bytes to send. Must be at least 1.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterTransmitBlock(const uint8_t *buf, uint16_t len)
+{
+  uint16_t rxLeft = len;                    // bytes still to be clocked in
+
+  while (rxLeft)
+  {
+    if (len && rxLeft - len < 2 && (UCSR1A & 1 << UDRE1))
+    {
+      UDR1 = *buf++;
+      --len;
+    }
+    if (UCSR1A & 1 << RXC1)
+    {
+      lastRx = UDR1;                        // keeps the receive buffer empty
+      --rxLeft;
+    }
+  }
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           SET SPI CLOCK RATE
+ * 
+ * Description : Sets the SPI clock to the fastest rate, F_CPU / (2 * (UBRR1 +
+ *               1)), that does not exceed maxRate.
+ * 
+ * Arguments   : maxRate  - maximum SPI clock rate in Hz.
+ * 
+ * Returns     : SPI clock rate in Hz that was set. If maxRate is below 
+ *               F_CPU/8192 then the clock is set to F_CPU/8192 and this is
+ *               returned.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t spi_SetClockRate(uint32_t maxRate)
+{
+  uint32_t ubrr = USPI_UBRR_MAX;
+
+  // smallest UBRR1 + 1 with F_CPU / (2 * (UBRR1 + 1)) <= maxRate.
+  if (maxRate)
+    ubrr = (F_CPU + 2 * maxRate - 1) / (2 * maxRate) - 1;
+  if (ubrr > USPI_UBRR_MAX)
+    ubrr = USPI_UBRR_MAX;
+
+  UBRR1 = ubrr;
+  return F_CPU / (2 * (ubrr + 1));
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           GET SPI CLOCK RATE
+ * 
+ * Description : Gets the current SPI clock rate.
+ * 
+ * Returns     : SPI clock rate in Hz.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t spi_GetClockRate(void)
+{
+  return F_CPU / (2 * ((uint32_t)UBRR1 + 1));
+}
@@ -0,0 +1,372 @@
+/*
+ * File       : SD_SPI_ASYNC.C
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ * 
+ * Implementation of SD_SPI_ASYNC.H. 
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#ifndef SD_SIM
+#include <avr/interrupt.h>
+#endif
+#include "sd_spi_base.h"
+#include "sd_spi_rwe.h"
+#include "sd_spi_async.h"
+
+/*
+ ******************************************************************************
+ *                                   MACROS
+ ******************************************************************************
+ */
+
+//
+// Engine states. Apart from IDLE and DONE, the state names the byte whose
+// transfer has just completed when the interrupt fires.
+//
+#define ST_IDLE           0
+#define ST_DONE           1
+#define ST_READY          2                 // waiting for card not busy
+#define ST_CMD            3                 // command frame byte sent
+#define ST_R1             4                 // waiting for R1
+#define ST_START_TKN      5                 // read: waiting for start token
+#define ST_DATA_RX        6                 // read: data byte received
+#define ST_CRC_RX         7                 // read: CRC byte received
+#define ST_TAIL           8                 // read: trailing byte clocked
+#define ST_START_TKN_TX   9                 // write: start token sent
+#define ST_DATA_TX        10                // write: data byte sent
+#define ST_CRC_TX         11                // write: CRC byte sent
+#define ST_DATA_RESP      12                // write: waiting for data response
+
+/*
+ ******************************************************************************
+ *                                  VARIABLES
+ ******************************************************************************
+ */
+
+static volatile uint8_t  state = ST_IDLE;
+static volatile uint16_t result;
+
+static uint8_t         isWrite;
+static uint8_t         frame[CMD_FRAME_LEN];
+static uint8_t        *rxBuf;
+static const uint8_t  *txBuf;
+static uint16_t        pos;                 // byte position in frame/block/CRC
+static uint16_t        attempts;
+static SDTimer         tmr;                 // busy and start token waits
+static uint16_t        crc;                 // block CRC sent or received
+static SDAsyncCallback callback;
+static void           *cbCtx;
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+static uint8_t pvt_Submit(uint8_t cmd, uint32_t blckAddr, SDAsyncCallback cb,
+                          void *ctx);
+static void    pvt_Step(void);
+static void    pvt_Finish(uint16_t res);
+
+/*
+ ******************************************************************************
+ *                                 FUNCTIONS   
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                       READ BLOCK (ASYNC)
+ * 
+ * Description : Submits a request to read the block at blckAddr into blckArr.
+ * 
+ * Arguments   : blckAddr   - address of the block to be read.
+ *               blckArr    - array of length BLOCK_LEN loaded with the block.
+ *                            Must not be accessed until the request completes.
+ *               cb         - called when the request completes, or NULL.
+ *               ctx        - passed through to cb.
+ * 
+ * Returns     : 1 if the request was submitted, 0 if another request has not
+ *               yet completed.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_ReadBlockAsync(uint32_t blckAddr, uint8_t blckArr[], 
+                          SDAsyncCallback cb, void *ctx)
+{
+  if (state != ST_IDLE)
+    return 0;
+
+  isWrite = 0;
+  rxBuf = blckArr;
+  return pvt_Submit(READ_SINGLE_BLOCK, blckAddr, cb, ctx);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      WRITE BLOCK (ASYNC)
+ * 
+ * Description : Submits a request to write dataArr to the block at blckAddr.
+ * 
+ * Arguments   : blckAddr   - address of the block to be written.
+ *               dataArr    - array of length BLOCK_LEN holding the data. Must
+ *                            not be modified until the request completes.
+ *               cb         - called when the request completes, or NULL.
+ *               ctx        - passed through to cb.
+ * 
+ * Returns     : 1 if the request was submitted, 0 if another request has not
+ *               yet completed.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_WriteBlockAsync(uint32_t blckAddr, const uint8_t dataArr[],
+                           SDAsyncCallback cb, void *ctx)
+{
+  if (state != ST_IDLE)
+    return 0;
+
+  isWrite = 1;
+  txBuf = dataArr;
+#if SD_CRC_CHECK
+  crc = sd_CRC16(dataArr, BLOCK_LEN);
+#else
+  crc = DMY_TKN << 8 | DMY_TKN;
+#endif
+  return pvt_Submit(WRITE_BLOCK, blckAddr, cb, ctx);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        POLL ASYNC REQUEST
+ * 
+ * Description : Checks on the submitted request. If it has completed, its 
+ *               callback is called and the engine becomes idle, ready for the
+ *               next request.
+ * 
+ * Returns     : SD_ASYNC_IDLE, SD_ASYNC_BUSY, or SD_ASYNC_DONE, which is 
+ *               returned once for each request, on the call that completed it.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_AsyncPoll(void)
+{
+#ifdef SD_SIM
+  // no SPI interrupt in the simulator. Each poll completes one byte.
+  if (state != ST_IDLE && state != ST_DONE)
+    pvt_Step();
+#endif
+
+  if (state == ST_IDLE)
+    return SD_ASYNC_IDLE;
+  if (state != ST_DONE)
+    return SD_ASYNC_BUSY;
+
+  // CRC of a block read is checked here rather than in the interrupt.
+#if SD_CRC_CHECK
+  if (!isWrite && result == READ_SUCCESS && crc != sd_CRC16(rxBuf, BLOCK_LEN))
+    result = READ_CRC_ERROR;
+#endif
+
+  state = ST_IDLE;
+  if (callback)
+    callback(result, cbCtx);
+  return SD_ASYNC_DONE;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      GET ASYNC RESULT
+ * 
+ * Returns     : result of the last completed request. Same as the err passed
+ *               to its callback.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_AsyncResult(void)
+{
+  return result;
+}
+
+#ifndef SD_SIM
+// SPI transfer complete. Only enabled while a request is in progress.
+ISR(SPI_INT_VECT)
+{
+  pvt_Step();
+}
+#endif
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTIONS DEFINITIONS
+ ******************************************************************************
+ */
+
+// builds the command frame, selects the card and clocks the first byte.
+static uint8_t pvt_Submit(uint8_t cmd, uint32_t blckAddr, SDAsyncCallback cb,
+                          void *ctx)
+{
+  frame[0] = TX_CMD_BITS | cmd;
+  frame[1] = blckAddr >> 24;
+  frame[2] = blckAddr >> 16;
+  frame[3] = blckAddr >> 8;
+  frame[4] = blckAddr;
+  frame[5] = sd_CRC7(frame, CMD_FRAME_LEN - 1) << 1 | STOP_BIT;
+
+  callback = cb;
+  cbCtx = ctx;
+  sd_TimerStart(&tmr, sd_CardBusy ? sd_CardBusy : sd_Timeouts.writeMs);
+  state = ST_READY;
+
+  CS_ASSERT;
+  SPI_INT_ENABLE;
+  spi_MasterStartTransmit(DMY_TKN);
+  return 1;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          STEP STATE MACHINE
+ * 
+ * Description : Called each time a byte transfer completes. Handles the byte
+ *               received and starts the transfer of the next byte, following
+ *               the same sequence as sd_ReadSingleBlock / sd_WriteSingleBlock.
+ * ----------------------------------------------------------------------------
+ */
+static void pvt_Step(void)
+{
+  uint8_t  rx = spi_MasterReceive();
+  uint8_t  tx = DMY_TKN;
+  uint16_t res = 0;                         // set when the request ends
+
+  switch (state)
+  {
+    case ST_READY:
+      // as in sd_SendCommand, the command is sent anyway on timeout.
+      if (rx == DMY_TKN)
+        sd_CardBusy = 0;
+      else if (!sd_TimerExpired(&tmr))
+        break;
+      state = ST_CMD;
+      pos = 1;
+      tx = frame[0];
+      break;
+
+    case ST_CMD:
+      if (pos < CMD_FRAME_LEN)
+        tx = frame[pos++];
+      else
+      {
+        state = ST_R1;
+        attempts = 0;
+      }
+      break;
+
+    case ST_R1:
+      if (rx == DMY_TKN)
+      {
+        if (attempts++ >= MAX_ATTEMPTS)
+          res = R1_ERROR | R1_TIMEOUT;
+      }
+      else if (rx != OUT_OF_IDLE)
+        res = R1_ERROR | rx;
+      else if (isWrite)
+      {
+        state = ST_START_TKN_TX;
+        tx = START_BLOCK_TKN;
+      }
+      else
+      {
+        state = ST_START_TKN;
+        sd_TimerStart(&tmr, sd_Timeouts.readMs);
+      }
+      break;
+
+    case ST_START_TKN:
+      if (rx == START_BLOCK_TKN)
+      {
+        state = ST_DATA_RX;
+        pos = 0;
+      }
+      else if (sd_TimerExpired(&tmr))
+        res = START_TOKEN_TIMEOUT;
+      break;
+
+    case ST_DATA_RX:
+      rxBuf[pos] = rx;
+      if (++pos == BLOCK_LEN)
+      {
+        state = ST_CRC_RX;
+        pos = 0;
+      }
+      break;
+
+    case ST_CRC_RX:
+      crc = crc << 8 | rx;
+      if (++pos == 2)
+        state = ST_TAIL;                    // clear remaining data from SPDR
+      break;
+
+    case ST_TAIL:
+      res = READ_SUCCESS;
+      break;
+
+    case ST_START_TKN_TX:
+      state = ST_DATA_TX;
+      pos = 1;
+      tx = txBuf[0];
+      break;
+
+    case ST_DATA_TX:
+      if (pos < BLOCK_LEN)
+        tx = txBuf[pos++];
+      else
+      {
+        state = ST_CRC_TX;
+        pos = 1;
+        tx = crc >> 8;
+      }
+      break;
+
+    case ST_CRC_TX:
+      if (pos++ == 1)
+        tx = crc;
+      else
+      {
+        state = ST_DATA_RESP;
+        attempts = 0;
+      }
+      break;
+
+    case ST_DATA_RESP:
+      rx &= DATA_RESPONSE_TKN_MASK;
+      if (rx == DATA_ACCEPTED_TKN)
+      {
+        sd_CardBusy = sd_Timeouts.writeMs;  // next command waits, see sd_IsBusy
+        res = WRITE_SUCCESS;
+      }
+      else if (rx == CRC_ERROR_TKN)
+        res = CRC_ERROR_TKN_RECEIVED;
+      else if (rx == WRITE_ERROR_TKN)
+        res = WRITE_ERROR_TKN_RECEIVED;
+      else if (++attempts > MAX_ATTEMPTS)
+        res = DATA_RESPONSE_TIMEOUT;
+      break;
+
+    default:                                // IDLE / DONE, nothing to do
+      return;
+  }
+
+  if (res)
+    pvt_Finish(res);
+  else
+    spi_MasterStartTransmit(tx);
+}
+
+// ends the transfer and records its result for sd_AsyncPoll.
+static void pvt_Finish(uint16_t res)
+{
+  SPI_INT_DISABLE;
+  CS_DEASSERT;
+  result = res;
+  state = ST_DONE;
+}
@@ -10,7 +10,9 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include "sd_spi_base.h"
+#include "sd_spi_rwe.h"
 
 
 /*
@@ -19,8 +21,55 @@
  ******************************************************************************
  */
 
-static void pvt_initSPI(void);                   // initialize SPI port
-static uint8_t pvt_CRC7(uint64_t tca);           // returns the CRC7 checksum
+static uint16_t pvt_SwitchFunc(uint32_t arg, uint8_t status[]);
+static uint8_t pvt_ReadCSD(uint8_t csd[]);       // CSD register via CMD9
+static uint32_t pvt_GetTranSpeed(const uint8_t csd[]); // max data rate
+static void pvt_SetTimeouts(const uint8_t csd[]);      // from TAAC, NSAC, R2W
+static void pvt_WaitReady(void);                 // pre-command wait
+
+/*
+ ******************************************************************************
+ *                                   TABLES
+ ******************************************************************************
+ */
+
+//
+// Frames of the commands that are always sent with an argument of 0, indexed
+// by the FRAME_XXXX macros. The CRC7 of each was calculated ahead of time.
+//
+#define ARG_0_FRAME(CMD, CRC7)    { TX_CMD_BITS | (CMD), 0, 0, 0, 0,           \
+                                    (CRC7) << 1 | STOP_BIT }
+
+static const uint8_t fixedFrames[NUM_OF_FIXED_FRAMES][CMD_FRAME_LEN] =
+{
+  ARG_0_FRAME(GO_IDLE_STATE,      0x4A),
+  ARG_0_FRAME(SEND_CSD,           0x57),
+  ARG_0_FRAME(SEND_CID,           0x0D),
+  ARG_0_FRAME(STOP_TRANSMISSION,  0x30),
+  ARG_0_FRAME(SEND_STATUS,        0x06),
+  ARG_0_FRAME(SEND_NUM_WR_BLOCKS, 0x21),
+  ARG_0_FRAME(ERASE,              0x52),
+  ARG_0_FRAME(SEND_SCR,           0x63),
+  ARG_0_FRAME(APP_CMD,            0x32),
+  ARG_0_FRAME(READ_OCR,           0x7E)
+};
+
+// TRAN_SPEED / TAAC time values (x10) indexed by bits 6:3. 0 is reserved.
+static const uint8_t timeVal[16] = { 0, 10, 12, 13, 15, 20, 25, 30,
+                                    35, 40, 45, 50, 55, 60, 70, 80};
+
+/*
+ ******************************************************************************
+ *                                  VARIABLES
+ ******************************************************************************
+ */
+
+uint8_t    sd_TxnOpen = 0;              // first cmd of transaction sent
+uint32_t   sd_CardBusy = 0;             // timeout of pending write/erase busy
+SDTimeouts sd_Timeouts = { SD_READ_TIMEOUT_MS, SD_WRITE_TIMEOUT_MS };
+uint16_t   sd_BlckAddrStep = 1;         // 1 or BLOCK_LEN, from card type
+const SPICsPin *sd_CsPin = NULL;        // CS of selected card, NULL for SS
+
 
 
 /*
@@ -49,7 +98,7 @@ static uint8_t pvt_CRC7(uint64_t tca);           // returns the CRC7 checksum
 void sd_WaitSPI(uint16_t clkCycles)
 {
   for (uint8_t waitCnt = 0; waitCnt < clkCycles / SPI_REG_BIT_LEN; ++waitCnt)
-    sd_SendByteSPI(DMY_TKN);
+    sd_ReceiveByteSPI();
 }
 
 
@@ -59,7 +108,9 @@ void sd_WaitSPI(uint16_t clkCycles)
  *
  * Description : Implements the SD Card SPI mode initialization routine and 
  *               sets the members of the CTV (Card Type and Version) struct
- *               instance. 
+ *               instance. The SPI clock is held at or below SD_INIT_CLK_RATE
+ *               until the card is out of idle, then set from TRAN_SPEED. The
+ *               card's read and write timeouts (sd_Timeouts) are also set.
  *
  * Arguments   : ctv - ptr to CTV instance whose members are set during init.
  * 
@@ -72,20 +123,159 @@ void sd_WaitSPI(uint16_t clkCycles)
  */
 uint32_t sd_InitModeSPI(CTV *ctv)
 {
-  uint8_t r1;                     // for r1 response
+  uint32_t resp;
 
-  pvt_initSPI();                  // initialize SPI port
+  SD_STATS_BEGIN(SD_STATS_OP_INIT);
+  sd_InitSPI();                   // initialize SPI port and timer
   sd_WaitSPI(80);                 // wait 80 SPI Clk cycles to ensure power up
 
+  //
+  // Steps 1 - 3: GO_IDLE_STATE, SEND_IF_COND, CRC_ON_OFF
+  //
+  resp = sd_InitIdle(ctv);
+  if (resp != IN_IDLE_STATE)
+    return SD_STATS_END(SD_STATS_OP_INIT, resp);
+
+  //
+  // Step 4: SD_SEND_OP_COND (ACMD41)
+  //
+  // Repeats until the card is no longer in the idle state or 
+  // SD_INIT_TIMEOUT_MS has passed.
+  //
+  SDTimer tmr;
+
+  sd_TimerStart(&tmr, SD_INIT_TIMEOUT_MS);
+  do
+  {
+    SD_STATS_POLL();
+    resp = sd_InitSendOpCond();
+    if (resp > IN_IDLE_STATE)
+      return SD_STATS_END(SD_STATS_OP_INIT, resp);
+    if (resp != OUT_OF_IDLE && sd_TimerExpired(&tmr))
+      return SD_STATS_END(SD_STATS_OP_INIT, 
+                          FAILED_SD_SEND_OP_COND | OUT_OF_IDLE_TIMEOUT | resp);
+  }
+  while (resp & IN_IDLE_STATE);
+
+  //
+  // Steps 5 - 6: READ_OCR, set the SPI clock and timeouts.
+  //
+  return SD_STATS_END(SD_STATS_OP_INIT, sd_InitReady(ctv));
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                             SD CARD WARM RESET INITIALIZATION
+ *
+ * Description : Fast initialization for when the host has been reset but the 
+ *               card has not, e.g. after a watchdog reset. If SEND_STATUS 
+ *               shows the card is already out of the idle state, the CTV is
+ *               restored from ctv and only CRC_ON_OFF, READ_OCR and the SPI 
+ *               clock and timeout setup are done, skipping GO_IDLE_STATE and
+ *               the SD_SEND_OP_COND polling. Otherwise, or if the card type in
+ *               the OCR does not match ctv, sd_InitModeSPI is run instead.
+ *
+ * Arguments   : ctv - ptr to CTV instance holding the values set by the last
+ *                     initialization of the card, e.g. kept in RAM that is 
+ *                     not cleared on reset. Its members are set as by 
+ *                     sd_InitModeSPI.
+ * 
+ * Returns     : Initialization Response, as sd_InitModeSPI.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t sd_WarmInitModeSPI(CTV *ctv)
+{
+  CTV     cached = *ctv;
+  uint8_t r1;
+
+  sd_InitSPI();
+  sd_WaitSPI(80);                 // in case the card was powered up as well
+  sd_CardBusy = 0;
+  sd_Timeouts.readMs = SD_READ_TIMEOUT_MS;
+  sd_Timeouts.writeMs = SD_WRITE_TIMEOUT_MS;
+
+  if (cached.version != VERSION_1 && cached.version != VERSION_2)
+    return sd_InitModeSPI(ctv);
+
+  // an initialized card is out of the idle state and accepts SEND_STATUS.
+  CS_ASSERT;
+  sd_SendFixedCommand(FRAME_SEND_STATUS);
+  r1 = sd_GetR1();
+  sd_ReceiveByteSPI();                      // second byte of R2, not used
+  CS_DEASSERT;
+  if (r1 != OUT_OF_IDLE)
+    return sd_InitModeSPI(ctv);
+
+  // CRC setting of this build, in case it differs from the last one.
+  CS_ASSERT;
+  sd_SendCommand(CRC_ON_OFF, SD_CRC_CHECK ? CRC_ON_ARG : CRC_OFF_ARG);
+  r1 = sd_GetR1();
+  CS_DEASSERT;
+  if (r1 != OUT_OF_IDLE)
+    return sd_InitModeSPI(ctv);
+
+  // READ_OCR, SPI clock and timeouts. The OCR must match the cached type.
+  if (sd_InitReady(ctv) != OUT_OF_IDLE || ctv->type != cached.type)
+    return sd_InitModeSPI(ctv);
+  return OUT_OF_IDLE;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        INITIALIZATION STEPS
+ *
+ * Description : The steps of sd_InitModeSPI, for initializing more than one
+ *               card at a time (see sd_InitCards in SD_SPI_CARD). 
+ * 
+ *               sd_InitSPI         - initializes the SPI port at or below 
+ *                                    SD_INIT_CLK_RATE and starts the timer. 
+ *                                    At least 74 clock cycles must then be 
+ *                                    sent, with every card deselected, before
+ *                                    a card's first command.
+ *               sd_InitIdle        - GO_IDLE_STATE, SEND_IF_COND and 
+ *                                    CRC_ON_OFF. Sets ctv->version.
+ *               sd_InitSendOpCond  - a single APP_CMD / SD_SEND_OP_COND poll.
+ *               sd_InitReady       - READ_OCR, then sets ctv->type, the SPI 
+ *                                    clock rate and the timeouts. Call once 
+ *                                    sd_InitSendOpCond returns OUT_OF_IDLE.
+ *
+ * Arguments   : ctv - ptr to CTV instance whose members are set during init.
+ * 
+ * Returns     : IN_IDLE_STATE (sd_InitIdle), IN_IDLE_STATE or OUT_OF_IDLE
+ *               (sd_InitSendOpCond) and OUT_OF_IDLE (sd_InitReady) on 
+ *               success. Otherwise the Initialization Error Flags and R1 
+ *               response, as sd_InitModeSPI.
+ * ----------------------------------------------------------------------------
+ */
+void sd_InitSPI(void)
+{
+  SS_DD_OUT;                  // set SPI SS as an output pin.
+  CS_DEASSERT;                // ensure SD CS pin deassert before enabling SPI.
+  spi_MasterInit();           // initialize SPI port in master mode.
+  spi_SetClockRate(SD_INIT_CLK_RATE);       // slow clock until out of idle
+#ifndef SD_SIM
+  TCCR1A = 0;                 // Timer/Counter1 normal mode, free-running
+  TCCR1B = SD_TIMER_PRESCALE;
+#endif
+}
+
+uint32_t sd_InitIdle(CTV *ctv)
+{
+  uint8_t r1;                     // for r1 response
+
+  sd_CardBusy = 0;
+  sd_Timeouts.readMs = SD_READ_TIMEOUT_MS;
+  sd_Timeouts.writeMs = SD_WRITE_TIMEOUT_MS;
+
   //
   // Step 1: GO_IDLE_STATE (CMD0)
   //
   CS_ASSERT;
-  sd_SendCommand(GO_IDLE_STATE, 0);         // send with arg = 0
+  sd_SendFixedCommand(FRAME_GO_IDLE_STATE);
   r1 = sd_GetR1();
   CS_DEASSERT;
   if (r1 != IN_IDLE_STATE) 
-    return (FAILED_GO_IDLE_STATE | r1);
+    return FAILED_GO_IDLE_STATE | r1;
 
   //
   // Step 2: SEND_IF_COND (CMD8)
@@ -108,20 +298,27 @@ uint32_t sd_InitModeSPI(CTV *ctv)
     ctv->version = VERSION_2;
     if (r7[R7_VOLT_RNG_ACPTD_BYTE] != VOLT_RANGE_SUPPORTED 
         || r7[R7_CHK_PTRN_ECHO_BYTE] != CHECK_PATTERN)
-      return (FAILED_SEND_IF_COND | UNSUPPORTED_CARD_TYPE | r7[R7_R1_RESP_BYTE]);
+      return FAILED_SEND_IF_COND | UNSUPPORTED_CARD_TYPE 
+             | r7[R7_R1_RESP_BYTE];
   }
   else  
-    return (FAILED_SEND_IF_COND | r7[R7_R1_RESP_BYTE]);
+    return FAILED_SEND_IF_COND | r7[R7_R1_RESP_BYTE];
   
   //
   // Step 3: CRC_ON_OFF (CMD59)
   //
   CS_ASSERT;
-  sd_SendCommand(CRC_ON_OFF, CRC_OFF_ARG);
+  sd_SendCommand(CRC_ON_OFF, SD_CRC_CHECK ? CRC_ON_ARG : CRC_OFF_ARG);
   r1 = sd_GetR1();
   CS_DEASSERT;
   if (r1 != IN_IDLE_STATE) 
-    return (FAILED_CRC_ON_OFF | r1);
+    return FAILED_CRC_ON_OFF | r1;
+  return IN_IDLE_STATE;
+}
+
+uint32_t sd_InitSendOpCond(void)
+{
+  uint8_t r1;
 
   //
   // Step 4: SD_SEND_OP_COND (ACMD41)
@@ -129,28 +326,25 @@ uint32_t sd_InitModeSPI(CTV *ctv)
   // SD_SEND_OP_COND is type ACMD, thus APP_CMD must first be sent to signal 
   // that the next incoming command is type ACMD. The SD_SEND_OP_COND argument
   // indicates the card capacity supported by the host (HOST_CAPACITY_SUPPORT).
-  // The process repeats until the SD_SEND_OP_COND R1 response shows card is no
-  // longer in the idle state or the attempt/timeout limit has been reached.
   //
-  uint8_t  attempts = 0;
-  do
-  {
-    CS_ASSERT;
-    sd_SendCommand(APP_CMD, 0);             // arg is 0 for this command
-    r1 = sd_GetR1();
-    CS_DEASSERT;
-    if (r1 != IN_IDLE_STATE) 
-      return (FAILED_APP_CMD | r1);
-    CS_ASSERT;
-    sd_SendCommand(SD_SEND_OP_COND, ACMD41_HCS_ARG);
-    r1 = sd_GetR1();
-    CS_DEASSERT;
-    if (r1 > IN_IDLE_STATE)
-      return (FAILED_SD_SEND_OP_COND | r1);
-    if (++attempts >= MAX_ATTEMPTS && r1 != OUT_OF_IDLE)
-      return (FAILED_SD_SEND_OP_COND | OUT_OF_IDLE_TIMEOUT | r1);
-  }
-  while (r1 & IN_IDLE_STATE);
+  CS_ASSERT;
+  sd_SendFixedCommand(FRAME_APP_CMD);
+  r1 = sd_GetR1();
+  CS_DEASSERT;
+  if (r1 != IN_IDLE_STATE) 
+    return FAILED_APP_CMD | r1;
+  CS_ASSERT;
+  sd_SendCommand(SD_SEND_OP_COND, ACMD41_HCS_ARG);
+  r1 = sd_GetR1();
+  CS_DEASSERT;
+  if (r1 > IN_IDLE_STATE)
+    return FAILED_SD_SEND_OP_COND | r1;
+  return r1;
+}
+
+uint32_t sd_InitReady(CTV *ctv)
+{
+  uint8_t r1;
 
   //
   // Step 5: READ_OCR (CMD 58)
@@ -165,10 +359,13 @@ uint32_t sd_InitModeSPI(CTV *ctv)
   uint16_t vra;                             // OCR voltage range accepted
   
   CS_ASSERT;
-  sd_SendCommand(READ_OCR, 0);              // arg is 0 for this command
+  sd_SendFixedCommand(FRAME_READ_OCR);
   r1 = sd_GetR1();
   if (r1 != OUT_OF_IDLE)
-    return (FAILED_READ_OCR | r1);
+  {
+    CS_DEASSERT;
+    return FAILED_READ_OCR | r1;
+  }
 
   ocr = sd_ReceiveByteSPI();                // load MSByte of OCR
 
@@ -176,7 +373,7 @@ uint32_t sd_InitModeSPI(CTV *ctv)
   if (!(ocr & POWER_UP_BIT_MASK))
   {
     CS_DEASSERT;
-    return (POWER_UP_NOT_COMPLETE | r1);
+    return POWER_UP_NOT_COMPLETE | r1;
   }
   
   // CCS is used to set card type
@@ -184,22 +381,44 @@ uint32_t sd_InitModeSPI(CTV *ctv)
     ctv->type = SDHC;
   else 
     ctv->type = SDSC;
+  sd_BlckAddrStep = (ctv->type == SDHC) ? 1 : BLOCK_LEN;
 
   // load two bytes for the vra
   vra = sd_ReceiveByteSPI();
   vra <<= 8;
   vra |= sd_ReceiveByteSPI();
 
-  // verify voltage range of card and unsupported card type is not used  
-  if (ocr & (UHSII_BIT_MASK | CO2T_BIT_MASK | S18A_BIT_MASK) 
-      || vra != VRA_OCR_MASK)
+  //
+  // verify voltage range of card and unsupported card type is not used. 
+  // CO2T cards are accepted. They are block addressed, as SDHC.
+  //
+  if (ocr & (UHSII_BIT_MASK | S18A_BIT_MASK) || vra != VRA_OCR_MASK)
   {
     CS_DEASSERT;
-    return (FAILED_READ_OCR | UNSUPPORTED_CARD_TYPE | r1);
+    return FAILED_READ_OCR | UNSUPPORTED_CARD_TYPE | r1;
   }
 
-  // Initialization success
   CS_DEASSERT;
+
+  //
+  // Step 6: Set the SPI clock for data transfer.
+  //
+  // The card is out of idle so the init clock limit no longer applies. Set
+  // the SPI clock to the card's max data rate (TRAN_SPEED in the CSD). The
+  // SPI module limits this to the fastest rate it supports. The timeouts
+  // depend on the SPI clock, so are set after it.
+  //
+  uint8_t csd[CSD_LEN];
+
+  if (pvt_ReadCSD(csd))
+  {
+    spi_SetClockRate(pvt_GetTranSpeed(csd));
+    pvt_SetTimeouts(csd);
+  }
+  else
+    spi_SetClockRate(SD_DFLT_CLK_RATE);
+
+  // Initialization success
   return OUT_OF_IDLE;
 }
 
@@ -220,6 +439,7 @@ uint32_t sd_InitModeSPI(CTV *ctv)
  */
 void sd_SendByteSPI(uint8_t byte)
 {
+  SD_STATS_SENT();
   spi_MasterTransmit(byte);       // sends byte via SPI port. Must be included.
 }
 
@@ -240,10 +460,59 @@ void sd_SendByteSPI(uint8_t byte)
  */
 uint8_t sd_ReceiveByteSPI(void)
 {
-  sd_SendByteSPI(DMY_TKN);             // send dummy byte to initiate response
+  SD_STATS_DMY();
+  spi_MasterTransmit(DMY_TKN);         // send dummy byte to initiate response
   return spi_MasterReceive();          // return byte received from SD card
 }
 
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                   SEND BLOCK
+ * 
+ * Description : Sends len bytes from buf to the SD card via the SPI port.
+ * 
+ * Arguments   : buf    - pointer to the array of bytes to send.
+ *               len    - number of bytes to send.
+ * 
+ * Notes       : 1) Use in place of repeated calls to sd_SendByteSPI when
+ *                  sending a data packet. The SPI module's block transmit
+ *                  keeps the SPI data register loaded between bytes.
+ *               2) This function calls spi_MasterTransmitBlock. This, or a
+ *                  similarly operating function must be included.
+ * ----------------------------------------------------------------------------
+ */
+void sd_SendBlockSPI(const uint8_t *buf, uint16_t len)
+{
+  if (!len)
+    return;
+  SD_STATS_SENT_N(len);
+  spi_MasterTransmitBlock(buf, len);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                RECEIVE BLOCK
+ * 
+ * Description : Receives len bytes from the SD card via the SPI port into buf.
+ * 
+ * Arguments   : buf    - pointer to the array to be loaded with the bytes.
+ *               len    - number of bytes to receive.
+ * 
+ * Notes       : 1) Use in place of repeated calls to sd_ReceiveByteSPI when
+ *                  receiving a data packet. The SPI module's block receive
+ *                  starts the next transfer before storing the last byte.
+ *               2) This function calls spi_MasterReceiveBlock. This, or a
+ *                  similarly operating function must be included.
+ * ----------------------------------------------------------------------------
+ */
+void sd_ReceiveBlockSPI(uint8_t *buf, uint16_t len)
+{
+  if (!len)
+    return;
+  SD_STATS_DMY_N(len);
+  spi_MasterReceiveBlock(buf, len);
+}
+
 /*
  * ----------------------------------------------------------------------------
  *                                                                 SEND COMMAND
@@ -253,30 +522,60 @@ uint8_t sd_ReceiveByteSPI(void)
  * 
  * Arguments   : cmd   - SD Card command.
  *               arg   - 32-bit argument to be sent with the SD command.
+ * 
+ * Notes       : On the first command after CS_ASSERT, dummy bytes are clocked
+ *               until the card returns DMY_TKN (not busy) before the command
+ *               is sent. Further commands sent before the next CS_ASSERT, such
+ *               as an ACMD following APP_CMD, or STOP_TRANSMISSION during a
+ *               multi-block read, are sent without waiting.
  * ----------------------------------------------------------------------------
  */
 void sd_SendCommand(uint8_t cmd, uint32_t arg)
 {
-  // Forcing a wait period between commands improves stability/behavior.
-  sd_WaitSPI(80);
+  SD_STATS_BEGIN(SD_STATS_OP_SEND_CMD);
+
+  pvt_WaitReady();
                            
   // 
-  // Construct the command/argument packet to be sent to the SD card. The form
-  // of the packet from MSB to LSB is:
+  // Construct the command/argument frame to be sent to the SD card. The form
+  // of the frame, first byte to last, is:
   // TX_CMD (2b) | CMD (6b) | ARG (32b) | CRC7 (7b) | STOP_BIT (1b)
   //
-  uint64_t tcacs = (uint64_t)(TX_CMD_BITS | cmd) << 40;   // load tx and cmd
-  tcacs |= (uint64_t)arg << 8;
-  tcacs |= pvt_CRC7(tcacs);                 // calculate and load CRC7
-  tcacs |= STOP_BIT;
-
-  // Send cmd/arg to SD Card via SPI port 8-bits at a time
-  sd_SendByteSPI((uint8_t)(tcacs >> 40));
-  sd_SendByteSPI((uint8_t)(tcacs >> 32));
-  sd_SendByteSPI((uint8_t)(tcacs >> 24));
-  sd_SendByteSPI((uint8_t)(tcacs >> 16));
-  sd_SendByteSPI((uint8_t)(tcacs >> 8));
-  sd_SendByteSPI((uint8_t)(tcacs));
+  uint8_t frame[CMD_FRAME_LEN];
+
+  frame[0] = TX_CMD_BITS | cmd;
+  frame[1] = arg >> 24;
+  frame[2] = arg >> 16;
+  frame[3] = arg >> 8;
+  frame[4] = arg;
+  frame[5] = sd_CRC7(frame, CMD_FRAME_LEN - 1) << 1 | STOP_BIT;
+
+  // Send cmd/arg/crc frame to SD Card via SPI port
+  sd_SendBlockSPI(frame, CMD_FRAME_LEN);
+
+  SD_STATS_END(SD_STATS_OP_SEND_CMD, (void)0);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           SEND FIXED COMMAND
+ * 
+ * Description : Sends one of the precomputed command frames. Equivalent to 
+ *               calling sd_SendCommand with the frame's command and an 
+ *               argument of 0, but no frame is built and no CRC7 calculated,
+ *               so only the six frame bytes are sent.
+ * 
+ * Arguments   : frameIdx   - one of the FRAME_XXXX indexes.
+ * 
+ * Notes       : Waits for the card in the same way as sd_SendCommand.
+ * ----------------------------------------------------------------------------
+ */
+void sd_SendFixedCommand(uint8_t frameIdx)
+{
+  SD_STATS_BEGIN(SD_STATS_OP_SEND_CMD);
+  pvt_WaitReady();
+  sd_SendBlockSPI(fixedFrames[frameIdx], CMD_FRAME_LEN);
+  SD_STATS_END(SD_STATS_OP_SEND_CMD, (void)0);
 }
 
 /*
@@ -299,11 +598,205 @@ uint8_t sd_GetR1(void)
   
   // loop until SPDR has new values or attempt limit has been reached.
   for (uint8_t attempt = 0; (r1 = sd_ReceiveByteSPI()) == DMY_TKN; ++attempt)
+  {
+    SD_STATS_POLL();
     if(attempt >= MAX_ATTEMPTS) 
       return R1_TIMEOUT;
+  }
   return r1;
 }
 
+/*
+ * ----------------------------------------------------------------------------
+ *                                                    RECEIVE SHORT DATA BLOCK
+ * 
+ * Description : Receives a register or status returned as a data block, once
+ *               its command's R1 has been received, then deasserts CS.
+ * 
+ * Arguments   : buf  - array to be loaded with the data.
+ *               len  - length of the data block in bytes.
+ * 
+ * Returns     : READ_SUCCESS, START_TOKEN_TIMEOUT or READ_CRC_ERROR. See 
+ *               READ BLOCK ERROR FLAGS in sd_spi_rwe.h.
+ * 
+ * Notes       : The CRC is only checked if SD_CRC_CHECK is 1.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_ReceiveDataBlock(uint8_t buf[], uint8_t len)
+{
+  uint16_t crc;
+  SDTimer  tmr;
+
+  sd_TimerStart(&tmr, sd_Timeouts.readMs);
+  while (sd_ReceiveByteSPI() != START_BLOCK_TKN)
+  {
+    if (sd_TimerExpired(&tmr))
+    {
+      CS_DEASSERT;
+      return START_TOKEN_TIMEOUT;
+    }
+  }
+  sd_ReceiveBlockSPI(buf, len);
+
+  // 16-bit CRC. Only checked if SD_CRC_CHECK is set.
+  crc = sd_ReceiveByteSPI();
+  crc = crc << 8 | sd_ReceiveByteSPI();
+  CS_DEASSERT;
+  if (SD_CRC_CHECK && crc != sd_CRC16(buf, len))
+    return READ_CRC_ERROR;
+  return READ_SUCCESS;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                               CARD IS BUSY
+ * 
+ * Description : Checks whether the card is still programming or erasing after
+ *               sd_WriteSingleBlock, sd_WriteMultipleBlocks or sd_EraseBlocks
+ *               returned. Clocks a single byte, and only if a write or erase
+ *               is still pending.
+ * 
+ * Returns     : 1 if the card is busy, else 0.
+ * 
+ * Notes       : Polling is optional. The next command waits for the card if
+ *               it is still busy.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_IsBusy(void)
+{
+  if (!sd_CardBusy)
+    return 0;
+
+  // a busy card holds DO low again once selected.
+  CS_ASSERT;
+  if (sd_ReceiveByteSPI() == DMY_TKN)
+    sd_CardBusy = 0;
+  CS_DEASSERT;
+  return sd_CardBusy != 0;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                    SWITCH TO HIGH SPEED MODE
+ * 
+ * Description : Checks with SWITCH_FUNC (CMD6) whether the card supports the
+ *               high speed access mode and, if so, switches the card to it and
+ *               raises the SPI clock limit to SD_HS_CLK_RATE. The SPI module 
+ *               limits this to the fastest rate it supports.
+ * 
+ * Returns     : HS_SWITCH_SUCCESS, or one of the other HIGH SPEED SWITCH 
+ *               FLAGS. The card and SPI clock are unchanged unless 
+ *               HS_SWITCH_SUCCESS is returned.
+ * 
+ * Notes       : Call after sd_InitModeSPI. Version 1.0 cards do not support
+ *               CMD6 and return an R1 illegal command error.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_SwitchHighSpeed(void)
+{
+  uint8_t  status[SWITCH_STATUS_LEN];
+  uint16_t err;
+
+  // mode 0 - check that group 1 supports high speed and could be selected.
+  if ((err = pvt_SwitchFunc(SWITCH_CHECK_HS_ARG, status)))
+    return err;
+  if (!(status[SWITCH_GRP1_SUPPORT_BYTE] & 1 << SWITCH_FN_HIGH_SPEED)
+      || (status[SWITCH_GRP1_RESULT_BYTE] & SWITCH_GRP1_RESULT_MASK) 
+         != SWITCH_FN_HIGH_SPEED)
+    return HS_NOT_SUPPORTED;
+
+  // mode 1 - switch. The result shows the function that was selected.
+  if ((err = pvt_SwitchFunc(SWITCH_SET_HS_ARG, status)))
+    return err;
+  if ((status[SWITCH_GRP1_RESULT_BYTE] & SWITCH_GRP1_RESULT_MASK) 
+      != SWITCH_FN_HIGH_SPEED)
+    return HS_SWITCH_FAILED;
+
+  // the card is in high speed mode 8 clocks after the end of the status.
+  sd_WaitSPI(SPI_REG_BIT_LEN);
+  spi_SetClockRate(SD_HS_CLK_RATE);
+  return HS_SWITCH_SUCCESS;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                         START / CHECK TIMER
+ * 
+ * Description : sd_TimerStart starts a timeout of ms milliseconds. 
+ *               sd_TimerExpired returns 1 once it has expired, else 0. 
+ *               sd_TimerExpired must be called at least every 4 seconds, as 
+ *               the AVR tick counter wraps after 2^16 ticks.
+ * 
+ * Arguments   : tmr  - ptr to the SDTimer instance.
+ *               ms   - timeout in milliseconds.
+ * ----------------------------------------------------------------------------
+ */
+void sd_TimerStart(SDTimer *tmr, uint32_t ms)
+{
+  tmr->last = sd_GetTick();
+#ifdef SD_SIM
+  tmr->ticksLeft = ms * (spi_GetClockRate() / SPI_REG_BIT_LEN / 1000);
+#else
+  tmr->ticksLeft = ms * SD_TIMER_HZ / 1000;
+#endif
+}
+
+uint8_t sd_TimerExpired(SDTimer *tmr)
+{
+  uint16_t now = sd_GetTick();
+  uint16_t elapsed = now - tmr->last;       // 16-bit wrap is handled
+
+  tmr->last = now;
+  if (elapsed >= tmr->ticksLeft)
+  {
+    tmr->ticksLeft = 0;
+    return 1;
+  }
+  tmr->ticksLeft -= elapsed;
+  return 0;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                            GET TIMER TICK
+ * 
+ * Returns     : current value of the free-running tick counter.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_GetTick(void)
+{
+#ifdef SD_SIM
+  SimStats simStats;
+
+  sim_sd_GetStats(&simStats);
+  return simStats.bytes;
+#else
+  return TCNT1;
+#endif
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                         ERASE TIMEOUT (MS)
+ * 
+ * Description : Busy timeout of an erase, write timeout per block erased, 
+ *               limited to SD_ERASE_TIMEOUT_MAX_MS.
+ * 
+ * Arguments   : startBlckAddr  - address of the first block to be erased.
+ *               endBlckAddr    - address of the last block to be erased.
+ * 
+ * Returns     : timeout in milliseconds.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t sd_EraseTimeoutMs(uint32_t startBlckAddr, uint32_t endBlckAddr)
+{
+  uint32_t numOfBlcks = (endBlckAddr - startBlckAddr) / sd_BlckAddrStep + 1;
+
+  if (numOfBlcks > SD_ERASE_TIMEOUT_MAX_MS / sd_Timeouts.writeMs)
+    return SD_ERASE_TIMEOUT_MAX_MS;
+  return numOfBlcks * sd_Timeouts.writeMs;
+}
+
 /*
  ******************************************************************************
  *                        "PRIVATE" FUNCTIONS DEFINITIONS
@@ -312,53 +805,167 @@ uint8_t sd_GetR1(void)
 
 /*
  * ----------------------------------------------------------------------------
- *                                           INITIALIZE SPI PORT IN MASTER MODE 
+ *                                                         PRE-COMMAND WAIT
  * 
- * Description : Called from sd_InitModeSPI to initialize the SPI port in
- *               Master Mode. Implementation of this function may vary based
- *               on how a target's SPI port is setup and implemented.
+ * Description : Called before a command frame is sent. Only the first command
+ *               after CS_ASSERT waits, and only until the card releases DO 
+ *               (DMY_TKN), which may be on the first byte. Later commands in 
+ *               the transaction follow a response from the card so need no 
+ *               wait. The wait is limited to the write timeout, or to the 
+ *               timeout held in sd_CardBusy if a write or erase left the card
+ *               busy.
  * ----------------------------------------------------------------------------
  */
-
-static void pvt_initSPI(void)
+static void pvt_WaitReady(void)
 {
-  SS_DD_OUT;                  // set SPI SS as an output pin.
-  CS_DEASSERT;                // ensure SD CS pin deassert before enabling SPI.
-  spi_MasterInit();           // initialize SPI port in master mode.
+  SDTimer tmr;
+
+  if (sd_TxnOpen)
+    return;
+
+  if (sd_ReceiveByteSPI() != DMY_TKN)
+  {
+    sd_TimerStart(&tmr, sd_CardBusy ? sd_CardBusy : sd_Timeouts.writeMs);
+    while (sd_ReceiveByteSPI() != DMY_TKN)
+    {
+      SD_STATS_POLL();
+      if (sd_TimerExpired(&tmr))
+      {
+        sd_TxnOpen = 1;
+        return;                             // still busy, send anyway
+      }
+    }
+  }
+  sd_CardBusy = 0;
+  sd_TxnOpen = 1;
 }
 
 /*
  * ----------------------------------------------------------------------------
- *                                                      CALCULATE CRC7 CHECKSUM
+ *                                                        SEND SWITCH FUNCTION
  * 
- * Description : Used by sd_SendCommand() to calculate the CRC7 for a command.
+ * Description : Used by sd_SwitchHighSpeed to send SWITCH_FUNC (CMD6) and 
+ *               receive the switch status.
  * 
- * Arguments   : tca   - the tx/cmd/arg bits used to calculate the CRC7.
+ * Arguments   : arg     - CMD6 argument.
+ *               status  - array of length SWITCH_STATUS_LEN to be loaded.
  * 
- * Returns     : calculated CRC7 to be sent with the SD command. 
+ * Returns     : 0 on success, else HS_R1_ERROR | R1, or HS_STATUS_ERROR.
  * ----------------------------------------------------------------------------
  */
-static uint8_t pvt_CRC7(uint64_t tca)
+static uint16_t pvt_SwitchFunc(uint32_t arg, uint8_t status[])
 {
-  // to test if division will take place during a given calc iteration.
-  uint64_t test = 0x800000000000; 
-  
-  //
-  // 0b10001001 (0x89) is divisor set in SD std to generate CRC7.
-  // Byte 6 is initialized with this value.
-  //
-  uint64_t divisor = 0x890000000000;
+  uint8_t r1;
 
-  // initialize result with tx/cmd/arg portion of SD command.
-  uint64_t result = tca;
+  CS_ASSERT;
+  sd_SendCommand(SWITCH_FUNC, arg);
+  if ((r1 = sd_GetR1()) != OUT_OF_IDLE)
+  {
+    CS_DEASSERT;
+    return HS_R1_ERROR | r1;
+  }
+  if (sd_ReceiveDataBlock(status, SWITCH_STATUS_LEN) != READ_SUCCESS)
+    return HS_STATUS_ERROR;
+  return 0;
+}
 
-  // calculate CRC7. 
-  for (uint8_t calc = 0; calc < 40; ++calc)
+/*
+ * ----------------------------------------------------------------------------
+ *                                                         READ CSD REGISTER
+ * 
+ * Description : Used by sd_InitModeSPI to read the CSD register via CMD9.
+ * 
+ * Arguments   : csd  - array of length CSD_LEN to be loaded with the CSD.
+ * 
+ * Returns     : 1 if the CSD was read, else 0.
+ * ----------------------------------------------------------------------------
+ */
+static uint8_t pvt_ReadCSD(uint8_t csd[])
+{
+  CS_ASSERT;
+  sd_SendFixedCommand(FRAME_SEND_CSD);
+  if (sd_GetR1() != OUT_OF_IDLE)
   {
-    if (result & test)
-      result ^= divisor;
-    divisor >>= 1;
-    test >>= 1;
+    CS_DEASSERT;
+    return 0;
   }
-  return result;
+
+  // CSD is returned as a data block.
+  return sd_ReceiveDataBlock(csd, CSD_LEN) == READ_SUCCESS;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                 GET MAX DATA TRANSFER RATE
+ * 
+ * Description : Used by sd_InitModeSPI to decode the TRAN_SPEED field of the
+ *               CSD into the card's max data transfer rate.
+ * 
+ * Arguments   : csd  - the CSD register.
+ * 
+ * Returns     : max data transfer rate in Hz (bit/s). SD_DFLT_CLK_RATE is 
+ *               returned if TRAN_SPEED holds a reserved value.
+ * ----------------------------------------------------------------------------
+ */
+static uint32_t pvt_GetTranSpeed(const uint8_t csd[])
+{
+  uint8_t  tv;
+  uint32_t rate = 10000;                    // 100kbit/s unit / time value x10
+
+  tv = timeVal[(csd[CSD_TRAN_SPEED_BYTE] & TRAN_SPEED_TV_MASK) 
+               >> TRAN_SPEED_TV_SHIFT];
+  if (!tv || (csd[CSD_TRAN_SPEED_BYTE] & TRAN_SPEED_UNIT_MASK) > 3)
+    return SD_DFLT_CLK_RATE;
+
+  for (uint8_t unit = 0; 
+       unit < (csd[CSD_TRAN_SPEED_BYTE] & TRAN_SPEED_UNIT_MASK); ++unit)
+    rate *= 10;
+
+  return rate * tv;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                         SET CARD TIMEOUTS
+ * 
+ * Description : Used by sd_InitModeSPI to set sd_Timeouts. CSD version 2.0 
+ *               (SDHC) cards do not give TAAC and NSAC values to be used, so
+ *               the spec maximums are kept. For CSD version 1.0 (SDSC) cards
+ *               the timeouts are 100 times the typical access time, TAAC + 
+ *               NSAC, and the write timeout is that times R2W_FACTOR. Both
+ *               are limited to the spec maximums. Must be called after the 
+ *               SPI clock is set, as NSAC is given in clock cycles.
+ * 
+ * Arguments   : csd  - the CSD register.
+ * ----------------------------------------------------------------------------
+ */
+static void pvt_SetTimeouts(const uint8_t csd[])
+{
+  uint32_t taac;                            // units of 0.1ns
+  uint32_t accessUs;
+  uint32_t tmo;
+  uint8_t  r2w;
+
+  sd_Timeouts.readMs = SD_READ_TIMEOUT_MS;
+  sd_Timeouts.writeMs = SD_WRITE_TIMEOUT_MS;
+  if (csd[CSD_STRUCTURE_BYTE] >> CSD_STRUCTURE_SHIFT)
+    return;
+
+  taac = timeVal[(csd[CSD_TAAC_BYTE] & TRAN_SPEED_TV_MASK) 
+                 >> TRAN_SPEED_TV_SHIFT];
+  if (!taac)
+    return;
+  for (uint8_t unit = 0; unit < (csd[CSD_TAAC_BYTE] & TAAC_UNIT_MASK); ++unit)
+    taac *= 10;
+
+  // 100 * (TAAC + NSAC) in us. NSAC is in units of 100 clock cycles.
+  accessUs = taac / 10000 
+           + csd[CSD_NSAC_BYTE] * 100000UL / (spi_GetClockRate() / 1000);
+  tmo = accessUs / 10 + 1;                  // x100 and us to ms, rounded up
+
+  r2w = (csd[CSD_R2W_FACTOR_BYTE] & R2W_FACTOR_MASK) >> R2W_FACTOR_SHIFT;
+  if (tmo < SD_READ_TIMEOUT_MS)
+    sd_Timeouts.readMs = tmo;
+  if ((tmo << r2w) < SD_WRITE_TIMEOUT_MS)
+    sd_Timeouts.writeMs = tmo << r2w;
 }
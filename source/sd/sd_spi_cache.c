@@ -0,0 +1,354 @@
+/*
+ * File       : SD_SPI_CACHE.C
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ * 
+ * Implementation of SD_SPI_CACHE.H. 
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "sd_spi_base.h"
+#include "sd_spi_rwe.h"
+#include "sd_spi_cache.h"
+
+#if SD_CACHE_NUM_BLCKS < 1 || SD_CACHE_NUM_BLCKS > 255
+#error "SD_CACHE_NUM_BLCKS must be from 1 to 255"
+#endif
+
+/*
+ ******************************************************************************
+ *                                   MACROS
+ ******************************************************************************
+ */
+
+// cache entry flags
+#define ENTRY_VALID       0x01
+#define ENTRY_DIRTY       0x02
+
+/*
+ ******************************************************************************
+ *                                  VARIABLES
+ ******************************************************************************
+ */
+
+static struct
+{
+  uint32_t blckAddr;
+  uint8_t  flags;
+  uint8_t  data[BLOCK_LEN];
+} entries[SD_CACHE_NUM_BLCKS];
+
+// entry indexes ordered from most (lruList[0]) to least recently used.
+static uint8_t lruList[SD_CACHE_NUM_BLCKS];
+
+// difference between the addresses of consecutive blocks, 1 or BLOCK_LEN.
+static uint32_t addrStep;
+
+static SDCacheStats cacheStats;
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+static uint16_t pvt_GetEntry(uint32_t blckAddr, uint8_t *entIdx, 
+                             uint8_t *found);
+static void     pvt_Touch(uint8_t entIdx);
+static uint16_t pvt_WriteBackRun(uint8_t entIdx);
+static const uint8_t *pvt_RunSource(uint32_t blckIdx, void *ctx);
+
+/*
+ ******************************************************************************
+ *                                 FUNCTIONS   
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                         INITIALIZE CACHE
+ * 
+ * Description : Empties the cache and clears its counters. Must be called 
+ *               after sd_InitModeSPI and before any other cache function.
+ * 
+ * Arguments   : ctv  - ptr to the CTV instance set by sd_InitModeSPI. The card
+ *                      type determines how consecutive block addresses are
+ *                      found (SDHC - block addressed, SDSC - byte addressed).
+ * ----------------------------------------------------------------------------
+ */
+void sd_CacheInit(const CTV *ctv)
+{
+  addrStep = (ctv->type == SDHC) ? 1 : BLOCK_LEN;
+  sd_CacheInvalidate();
+  sd_CacheResetStats();
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        READ BLOCK VIA CACHE
+ * 
+ * Description : Copies the block at blckAddr into blckArr. If the block is not
+ *               in the cache it is first read from the card into the cache.
+ * 
+ * Arguments   : blckAddr   - address of the block to be read.
+ *               blckArr    - array of length BLOCK_LEN loaded with the block.
+ * 
+ * Returns     : READ_SUCCESS, or the error returned by sd_ReadSingleBlock. If
+ *               a dirty block had to be evicted and could not be written, the
+ *               write error is returned instead and blckArr is not loaded.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_CacheReadBlock(uint32_t blckAddr, uint8_t blckArr[])
+{
+  uint8_t  entIdx, found;
+  uint16_t err;
+
+  err = pvt_GetEntry(blckAddr, &entIdx, &found);
+  if (err != WRITE_SUCCESS)
+    return err;
+
+  if (!found)
+  {
+    err = sd_ReadSingleBlock(blckAddr, entries[entIdx].data);
+    if (err != READ_SUCCESS)
+      return err;                           // entry is left invalid
+    entries[entIdx].blckAddr = blckAddr;
+    entries[entIdx].flags = ENTRY_VALID;
+  }
+
+  memcpy(blckArr, entries[entIdx].data, BLOCK_LEN);
+  return READ_SUCCESS;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                       WRITE BLOCK VIA CACHE
+ * 
+ * Description : Copies dataArr into the cache entry for blckAddr and marks it
+ *               dirty. The block is written to the card when it is evicted or
+ *               sd_CacheFlush is called.
+ * 
+ * Arguments   : blckAddr   - address of the block to be written.
+ *               dataArr    - array of length BLOCK_LEN holding the data.
+ * 
+ * Returns     : WRITE_SUCCESS, or if a dirty block had to be evicted and could
+ *               not be written, the write error.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_CacheWriteBlock(uint32_t blckAddr, const uint8_t dataArr[])
+{
+  uint8_t  entIdx, found;
+  uint16_t err;
+
+  // whole block is replaced, so a miss does not need to read the card.
+  err = pvt_GetEntry(blckAddr, &entIdx, &found);
+  if (err != WRITE_SUCCESS)
+    return err;
+
+  memcpy(entries[entIdx].data, dataArr, BLOCK_LEN);
+  entries[entIdx].blckAddr = blckAddr;
+  entries[entIdx].flags = ENTRY_VALID | ENTRY_DIRTY;
+  return WRITE_SUCCESS;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                 FLUSH CACHE
+ * 
+ * Description : Writes every dirty block in the cache to the card. The blocks
+ *               remain cached.
+ * 
+ * Returns     : WRITE_SUCCESS, or the first write error. Blocks that could not
+ *               be written remain dirty.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_CacheFlush(void)
+{
+  uint16_t retTkn = WRITE_SUCCESS;
+  uint16_t err;
+
+  for (uint8_t i = 0; i < SD_CACHE_NUM_BLCKS; ++i)
+  {
+    if (!(entries[i].flags & ENTRY_DIRTY))
+      continue;
+    err = pvt_WriteBackRun(i);
+    if (err != WRITE_SUCCESS && retTkn == WRITE_SUCCESS)
+      retTkn = err;
+  }
+  return retTkn;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                            INVALIDATE CACHE
+ * 
+ * Description : Empties the cache WITHOUT writing dirty blocks. Call after 
+ *               sd_CacheFlush if blocks are to be modified outside the cache.
+ * ----------------------------------------------------------------------------
+ */
+void sd_CacheInvalidate(void)
+{
+  for (uint8_t i = 0; i < SD_CACHE_NUM_BLCKS; ++i)
+  {
+    entries[i].flags = 0;
+    lruList[i] = i;
+  }
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                     GET / RESET CACHE COUNTERS
+ * 
+ * Description : Copies the cache counters into stats / clears the counters.
+ * 
+ * Arguments   : stats  - ptr to the SDCacheStats instance to be loaded.
+ * ----------------------------------------------------------------------------
+ */
+void sd_CacheGetStats(SDCacheStats *stats)
+{
+  *stats = cacheStats;
+}
+
+void sd_CacheResetStats(void)
+{
+  cacheStats.hits = 0;
+  cacheStats.misses = 0;
+  cacheStats.writeBacks = 0;
+  cacheStats.writeCmds = 0;
+}
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTIONS DEFINITIONS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                    FIND OR ALLOCATE ENTRY
+ * 
+ * Description : Sets entIdx to the entry holding blckAddr (found = 1), or to
+ *               the least recently used entry (found = 0), writing it back
+ *               first if it is dirty. The entry is made the most recent.
+ * 
+ * Returns     : WRITE_SUCCESS, or the error from writing back the evicted
+ *               entry. The entry is then left unchanged.
+ * ----------------------------------------------------------------------------
+ */
+static uint16_t pvt_GetEntry(uint32_t blckAddr, uint8_t *entIdx, 
+                             uint8_t *found)
+{
+  uint16_t err;
+  uint8_t  i;
+
+  for (i = 0; i < SD_CACHE_NUM_BLCKS; ++i)
+  {
+    if ((entries[i].flags & ENTRY_VALID) && entries[i].blckAddr == blckAddr)
+    {
+      ++cacheStats.hits;
+      pvt_Touch(i);
+      *entIdx = i;
+      *found = 1;
+      return WRITE_SUCCESS;
+    }
+  }
+
+  ++cacheStats.misses;
+  i = lruList[SD_CACHE_NUM_BLCKS - 1];
+  if (entries[i].flags & ENTRY_DIRTY)
+  {
+    err = pvt_WriteBackRun(i);
+    if (err != WRITE_SUCCESS)
+      return err;
+  }
+  entries[i].flags = 0;
+  pvt_Touch(i);
+  *entIdx = i;
+  *found = 0;
+  return WRITE_SUCCESS;
+}
+
+// moves entIdx to the front (most recently used) of lruList.
+static void pvt_Touch(uint8_t entIdx)
+{
+  uint8_t pos = 0;
+
+  while (lruList[pos] != entIdx)
+    ++pos;
+  for (; pos > 0; --pos)
+    lruList[pos] = lruList[pos - 1];
+  lruList[0] = entIdx;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                    WRITE BACK DIRTY RUN
+ * 
+ * Description : Writes the dirty entry entIdx together with every dirty entry
+ *               that extends it into a run of consecutive block addresses, in
+ *               either direction. A run of more than one block is written with
+ *               a single sd_WriteMultipleBlocks. The run is marked clean if 
+ *               the write succeeds.
+ * 
+ * Returns     : WRITE_SUCCESS or the write error.
+ * ----------------------------------------------------------------------------
+ */
+static uint16_t pvt_WriteBackRun(uint8_t entIdx)
+{
+  uint8_t  run[SD_CACHE_NUM_BLCKS];         // entry indexes in address order
+  uint8_t  runLen = 1;
+  uint8_t  i;
+  uint32_t first, next;
+  uint16_t err;
+
+  // walk down to the lowest address of the run.
+  first = entries[entIdx].blckAddr;
+  for (i = 0; i < SD_CACHE_NUM_BLCKS; ++i)
+  {
+    if ((entries[i].flags & ENTRY_DIRTY) && first >= addrStep
+         && entries[i].blckAddr == first - addrStep)
+    {
+      first -= addrStep;
+      i = 0xFF;                             // restart search at entry 0
+    }
+  }
+
+  // collect the run upward from first.
+  for (i = 0; i < SD_CACHE_NUM_BLCKS; ++i)
+    if ((entries[i].flags & ENTRY_DIRTY) && entries[i].blckAddr == first)
+      break;
+  run[0] = i;
+  next = first + addrStep;
+  for (i = 0; i < SD_CACHE_NUM_BLCKS && runLen < SD_CACHE_NUM_BLCKS; ++i)
+  {
+    if ((entries[i].flags & ENTRY_DIRTY) && entries[i].blckAddr == next)
+    {
+      run[runLen++] = i;
+      next += addrStep;
+      i = 0xFF;
+    }
+  }
+
+  if (runLen == 1)
+    err = sd_WriteSingleBlock(first, entries[run[0]].data);
+  else
+    err = sd_WriteMultipleBlocks(first, runLen, NULL, pvt_RunSource, run);
+
+  ++cacheStats.writeCmds;
+  if (err != WRITE_SUCCESS)
+    return err;
+
+  cacheStats.writeBacks += runLen;
+  for (i = 0; i < runLen; ++i)
+    entries[run[i]].flags &= ~ENTRY_DIRTY;
+  return WRITE_SUCCESS;
+}
+
+// SDBlockSource over a run of entry indexes.
+static const uint8_t *pvt_RunSource(uint32_t blckIdx, void *ctx)
+{
+  return entries[((const uint8_t *)ctx)[blckIdx]].data;
+}
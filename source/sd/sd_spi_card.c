@@ -0,0 +1,183 @@
+/*
+ * File       : SD_SPI_CARD.C
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Implementation of SD_SPI_CARD.H.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sd_spi_base.h"
+#include "sd_spi_card.h"
+
+/*
+ ******************************************************************************
+ *                                  VARIABLES
+ ******************************************************************************
+ */
+
+// card whose driver state is currently loaded. NULL if none.
+static SDCard *activeCard = NULL;
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+static void pvt_SaveCard(void);
+
+/*
+ ******************************************************************************
+ *                                  FUNCTIONS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        INITIALIZE ALL CARDS
+ *
+ * Description : Initializes every card in SPI mode. The SPI port is set up
+ *               and the power up clocks are sent once, for all of the cards.
+ *               Each card is then taken through GO_IDLE_STATE, SEND_IF_COND
+ *               and CRC_ON_OFF in turn. SD_SEND_OP_COND is then sent to each
+ *               card still idle in turn, until every card has left the idle
+ *               state, failed, or SD_INIT_TIMEOUT_MS has passed. A card is
+ *               finished (READ_OCR, SPI clock, timeouts) as soon as it leaves
+ *               the idle state.
+ *
+ * Arguments   : cards       - array of ptrs to the card handles. The cs member
+ *                             of each must be set.
+ *               numOfCards  - number of cards in the array.
+ *
+ * Returns     : number of cards initialized. The initResp member of each card
+ *               is OUT_OF_IDLE if it was initialized, otherwise it holds the
+ *               Initialization Error Flags and R1 response.
+ *
+ * Notes       : No card is selected when this returns. Call sd_SelectCard
+ *               before accessing a card.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_InitCards(SDCard *cards[], uint8_t numOfCards)
+{
+  SDTimer  tmr;
+  uint8_t  idleCnt;
+  uint8_t  readyCnt = 0;
+  uint32_t resp;
+
+  // every card must be deselected for the power up clocks.
+  for (uint8_t i = 0; i < numOfCards; ++i)
+  {
+    CS_PIN_DD_OUT(&cards[i]->cs);
+    CS_PIN_HI(&cards[i]->cs);
+  }
+  activeCard = NULL;
+  sd_CsPin = NULL;
+  sd_InitSPI();
+  sd_WaitSPI(80);
+
+  //
+  // GO_IDLE_STATE, SEND_IF_COND and CRC_ON_OFF. These complete without
+  // waiting on the card, so are sent to one card after the other.
+  //
+  for (uint8_t i = 0; i < numOfCards; ++i)
+  {
+    cards[i]->clkRate = spi_GetClockRate();
+    cards[i]->cardBusy = 0;
+    cards[i]->timeouts.readMs = SD_READ_TIMEOUT_MS;
+    cards[i]->timeouts.writeMs = SD_WRITE_TIMEOUT_MS;
+    cards[i]->blckAddrStep = 1;
+    sd_SelectCard(cards[i]);
+    cards[i]->initResp = sd_InitIdle(&cards[i]->ctv);
+  }
+
+  //
+  // SD_SEND_OP_COND. Each pass polls every card that is still idle once, so
+  // the cards leave the idle state in parallel.
+  //
+  sd_TimerStart(&tmr, SD_INIT_TIMEOUT_MS);
+  do
+  {
+    idleCnt = 0;
+    for (uint8_t i = 0; i < numOfCards; ++i)
+    {
+      if (cards[i]->initResp != IN_IDLE_STATE)
+        continue;
+
+      SD_STATS_POLL();
+      sd_SelectCard(cards[i]);
+      resp = sd_InitSendOpCond();
+      if (resp == OUT_OF_IDLE)
+      {
+        resp = sd_InitReady(&cards[i]->ctv);
+        if (resp == OUT_OF_IDLE)
+          ++readyCnt;
+      }
+      else if (resp == IN_IDLE_STATE)
+        ++idleCnt;
+      cards[i]->initResp = resp;
+    }
+
+    if (idleCnt && sd_TimerExpired(&tmr))
+    {
+      for (uint8_t i = 0; i < numOfCards; ++i)
+        if (cards[i]->initResp == IN_IDLE_STATE)
+          cards[i]->initResp = FAILED_SD_SEND_OP_COND | OUT_OF_IDLE_TIMEOUT
+                               | IN_IDLE_STATE;
+      idleCnt = 0;
+    }
+  }
+  while (idleCnt);
+
+  pvt_SaveCard();
+  activeCard = NULL;
+  sd_CsPin = NULL;
+  return readyCnt;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                 SELECT CARD
+ *
+ * Description : Selects the card accessed by the SD_SPI functions. The driver
+ *               state of the previous card - SPI clock rate, pending busy,
+ *               timeouts and addressing - is saved in its handle and that of
+ *               card is restored.
+ *
+ * Arguments   : card  - ptr to the handle of the card, initialized by
+ *                       sd_InitCards.
+ * ----------------------------------------------------------------------------
+ */
+void sd_SelectCard(SDCard *card)
+{
+  if (card == activeCard)
+    return;
+
+  pvt_SaveCard();
+  activeCard = card;
+  sd_CsPin = &card->cs;
+  sd_CardBusy = card->cardBusy;
+  sd_Timeouts = card->timeouts;
+  sd_BlckAddrStep = card->blckAddrStep;
+  spi_SetClockRate(card->clkRate);
+}
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTIONS DEFINITIONS
+ ******************************************************************************
+ */
+
+// save the driver state of the active card in its handle.
+static void pvt_SaveCard(void)
+{
+  if (activeCard == NULL)
+    return;
+  activeCard->clkRate = spi_GetClockRate();
+  activeCard->cardBusy = sd_CardBusy;
+  activeCard->timeouts = sd_Timeouts;
+  activeCard->blckAddrStep = sd_BlckAddrStep;
+}
@@ -0,0 +1,169 @@
+/*
+ * File       : SD_SPI_CRC.C
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Implementation of SD_SPI_CRC.H
+ */
+
+#include <stdint.h>
+#include "sd_spi_base.h"
+
+#ifdef SD_SIM
+#define PROGMEM
+#define pgm_read_byte(addr)       (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)       (*(const uint16_t *)(addr))
+#else
+#include <avr/pgmspace.h>
+#endif
+
+/*
+ ******************************************************************************
+ *                                   TABLES
+ ******************************************************************************
+ */
+
+//
+// CRC7 of each byte value, left-aligned (CRC7 << 1). Generated with the 
+// polynomial 0x09 (x^7 + x^3 + 1) shifted to 0x12.
+//
+static const uint8_t crc7Table[256] PROGMEM =
+{
+  0x00, 0x12, 0x24, 0x36, 0x48, 0x5A, 0x6C, 0x7E,
+  0x90, 0x82, 0xB4, 0xA6, 0xD8, 0xCA, 0xFC, 0xEE,
+  0x32, 0x20, 0x16, 0x04, 0x7A, 0x68, 0x5E, 0x4C,
+  0xA2, 0xB0, 0x86, 0x94, 0xEA, 0xF8, 0xCE, 0xDC,
+  0x64, 0x76, 0x40, 0x52, 0x2C, 0x3E, 0x08, 0x1A,
+  0xF4, 0xE6, 0xD0, 0xC2, 0xBC, 0xAE, 0x98, 0x8A,
+  0x56, 0x44, 0x72, 0x60, 0x1E, 0x0C, 0x3A, 0x28,
+  0xC6, 0xD4, 0xE2, 0xF0, 0x8E, 0x9C, 0xAA, 0xB8,
+  0xC8, 0xDA, 0xEC, 0xFE, 0x80, 0x92, 0xA4, 0xB6,
+  0x58, 0x4A, 0x7C, 0x6E, 0x10, 0x02, 0x34, 0x26,
+  0xFA, 0xE8, 0xDE, 0xCC, 0xB2, 0xA0, 0x96, 0x84,
+  0x6A, 0x78, 0x4E, 0x5C, 0x22, 0x30, 0x06, 0x14,
+  0xAC, 0xBE, 0x88, 0x9A, 0xE4, 0xF6, 0xC0, 0xD2,
+  0x3C, 0x2E, 0x18, 0x0A, 0x74, 0x66, 0x50, 0x42,
+  0x9E, 0x8C, 0xBA, 0xA8, 0xD6, 0xC4, 0xF2, 0xE0,
+  0x0E, 0x1C, 0x2A, 0x38, 0x46, 0x54, 0x62, 0x70,
+  0x82, 0x90, 0xA6, 0xB4, 0xCA, 0xD8, 0xEE, 0xFC,
+  0x12, 0x00, 0x36, 0x24, 0x5A, 0x48, 0x7E, 0x6C,
+  0xB0, 0xA2, 0x94, 0x86, 0xF8, 0xEA, 0xDC, 0xCE,
+  0x20, 0x32, 0x04, 0x16, 0x68, 0x7A, 0x4C, 0x5E,
+  0xE6, 0xF4, 0xC2, 0xD0, 0xAE, 0xBC, 0x8A, 0x98,
+  0x76, 0x64, 0x52, 0x40, 0x3E, 0x2C, 0x1A, 0x08,
+  0xD4, 0xC6, 0xF0, 0xE2, 0x9C, 0x8E, 0xB8, 0xAA,
+  0x44, 0x56, 0x60, 0x72, 0x0C, 0x1E, 0x28, 0x3A,
+  0x4A, 0x58, 0x6E, 0x7C, 0x02, 0x10, 0x26, 0x34,
+  0xDA, 0xC8, 0xFE, 0xEC, 0x92, 0x80, 0xB6, 0xA4,
+  0x78, 0x6A, 0x5C, 0x4E, 0x30, 0x22, 0x14, 0x06,
+  0xE8, 0xFA, 0xCC, 0xDE, 0xA0, 0xB2, 0x84, 0x96,
+  0x2E, 0x3C, 0x0A, 0x18, 0x66, 0x74, 0x42, 0x50,
+  0xBE, 0xAC, 0x9A, 0x88, 0xF6, 0xE4, 0xD2, 0xC0,
+  0x1C, 0x0E, 0x38, 0x2A, 0x54, 0x46, 0x70, 0x62,
+  0x8C, 0x9E, 0xA8, 0xBA, 0xC4, 0xD6, 0xE0, 0xF2
+};
+
+#if SD_CRC16_NIBBLE
+// CRC16-CCITT (0x1021) of each nibble value in the upper 4 bits.
+static const uint16_t crc16Table[16] PROGMEM =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+#else
+// CRC16-CCITT (0x1021) of each byte value in the upper 8 bits.
+static const uint16_t crc16Table[256] PROGMEM =
+{
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+  0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+  0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+  0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+  0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+  0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+  0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+  0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+  0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+  0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+  0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+  0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+  0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+  0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+  0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+  0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+  0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+  0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+  0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+  0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+  0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+  0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+  0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+  0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+  0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+  0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+  0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+  0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+  0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+  0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+  0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+  0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+#endif
+
+/*
+ ******************************************************************************
+ *                                 FUNCTIONS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      CALCULATE CRC7 CHECKSUM
+ * 
+ * Description : Calculates the CRC7 (x^7 + x^3 + 1) of a byte array.
+ * 
+ * Arguments   : buf   - pointer to the bytes the CRC7 is calculated over.
+ *               len   - number of bytes.
+ * 
+ * Returns     : CRC7 in the lower 7 bits.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_CRC7(const uint8_t *buf, uint8_t len)
+{
+  uint8_t crc = 0;                          // left-aligned CRC7
+
+  while (len--)
+    crc = pgm_read_byte(&crc7Table[crc ^ *buf++]);
+  return crc >> 1;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                     CALCULATE CRC16 CHECKSUM
+ * 
+ * Description : Calculates the CRC16-CCITT (x^16 + x^12 + x^5 + 1, initial 
+ *               value 0) of a byte array, as used for SD card data blocks.
+ * 
+ * Arguments   : buf   - pointer to the bytes the CRC16 is calculated over.
+ *               len   - number of bytes.
+ * 
+ * Returns     : CRC16.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_CRC16(const uint8_t *buf, uint16_t len)
+{
+  uint16_t crc = 0;
+
+  while (len--)
+  {
+#if SD_CRC16_NIBBLE
+    crc = (crc << 4) ^ pgm_read_word(&crc16Table[(crc >> 12) ^ (*buf >> 4)]);
+    crc = (crc << 4) ^ pgm_read_word(&crc16Table[(crc >> 12) ^ (*buf & 0xF)]);
+    ++buf;
+#else
+    crc = (crc << 8) ^ pgm_read_word(&crc16Table[(crc >> 8) ^ *buf++]);
+#endif
+  }
+  return crc;
+}
@@ -0,0 +1,359 @@
+/*
+ * File       : SD_SPI_INFO.C
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Implementation of SD_SPI_INFO.H.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "sd_spi_base.h"
+#include "sd_spi_rwe.h"
+#include "sd_spi_info.h"
+
+/*
+ ******************************************************************************
+ *                                   TABLES
+ ******************************************************************************
+ */
+
+// AU_SIZE codes in units of 16 KB (32 blocks). 0 is not defined.
+static const uint16_t auSize16K[16] = {   0,    1,    2,    4,   8,  16,  32,
+                                         64,  128,  256,  512, 768, 1024,
+                                       1536, 2048, 4096};
+
+// SPEED_CLASS codes 0 to 4. Others are reserved.
+static const uint8_t speedClass[5] = { 0, 2, 4, 6, 10 };
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+static uint16_t pvt_ReadDataReg(uint8_t frameIdx, uint8_t isAppCmd,
+                                uint8_t reg[], uint8_t len);
+static uint32_t pvt_GetBits(const uint8_t reg[], uint8_t regLen,
+                            uint16_t msb, uint8_t width);
+
+/*
+ ******************************************************************************
+ *                                 FUNCTIONS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           READ CARD INFO
+ *
+ * Description : Reads all of the card's registers and decodes them into info.
+ *               Must be called after sd_InitModeSPI(&info->ctv). Fields of
+ *               registers that could not be read are left 0.
+ *
+ * Arguments   : info  - ptr to the SDCardInfo instance whose ctv member was
+ *                       set by sd_InitModeSPI.
+ *
+ * Returns     : READ_SUCCESS, or the error of the first register that could
+ *               not be read. See sd_ReadCSD.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_ReadCardInfo(SDCardInfo *info)
+{
+  uint8_t  reg[SD_STATUS_LEN];              // holds the largest register
+  uint16_t err;
+  uint16_t ret = READ_SUCCESS;
+  CTV      ctv = info->ctv;
+
+  memset(info, 0, sizeof(*info));
+  info->ctv = ctv;
+  info->timeouts = sd_Timeouts;
+
+  if ((err = sd_ReadOCR(&info->ocr)) != READ_SUCCESS)
+    ret = err;
+
+  if ((err = sd_ReadCSD(reg)) == READ_SUCCESS)
+  {
+    sd_DecodeCSD(reg, &info->csd);
+    info->byteCapacity = sd_CsdByteCapacity(&info->csd);
+    info->numOfBlcks = sd_CsdNumOfBlcks(&info->csd);
+    info->eraseSectorBlcks = (uint32_t)(info->csd.sectorSize + 1)
+                             << (info->csd.writeBlLen > 9
+                                 ? info->csd.writeBlLen - 9 : 0);
+  }
+  else if (ret == READ_SUCCESS)
+    ret = err;
+
+  if ((err = sd_ReadCID(reg)) == READ_SUCCESS)
+    sd_DecodeCID(reg, &info->cid);
+  else if (ret == READ_SUCCESS)
+    ret = err;
+
+  if ((err = sd_ReadSCR(reg)) == READ_SUCCESS)
+    sd_DecodeSCR(reg, &info->scr);
+  else if (ret == READ_SUCCESS)
+    ret = err;
+
+  if ((err = sd_ReadSDStatus(reg)) == READ_SUCCESS)
+  {
+    sd_DecodeSDStatus(reg, &info->status);
+    info->auBlcks = (uint32_t)auSize16K[info->status.auSize] * 32;
+    if (info->status.speedClass < sizeof(speedClass))
+      info->speedClass = speedClass[info->status.speedClass];
+  }
+  else if (ret == READ_SUCCESS)
+    ret = err;
+
+  return ret;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        READ CARD REGISTERS
+ *
+ * Description : Read a single register from the card. The CSD (CMD9), CID
+ *               (CMD10), SCR (ACMD51) and SD Status (ACMD13) are returned as
+ *               data blocks. The OCR (CMD58) is returned with the R1.
+ *
+ * Arguments   : reg  - array of the register's length, XXX_LEN, loaded with
+ *                      the register as sent by the card, MSB first.
+ *               ocr  - loaded with the OCR.
+ *
+ * Returns     : READ_SUCCESS, START_TOKEN_TIMEOUT or READ_CRC_ERROR. If an R1
+ *               error occurs the returned response is the R1 error and the
+ *               R1_ERROR flag is set to indicate this.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_ReadCSD(uint8_t reg[])
+{
+  return pvt_ReadDataReg(FRAME_SEND_CSD, 0, reg, CSD_LEN);
+}
+
+uint16_t sd_ReadCID(uint8_t reg[])
+{
+  return pvt_ReadDataReg(FRAME_SEND_CID, 0, reg, CID_LEN);
+}
+
+uint16_t sd_ReadSCR(uint8_t reg[])
+{
+  return pvt_ReadDataReg(FRAME_SEND_SCR, 1, reg, SCR_LEN);
+}
+
+uint16_t sd_ReadSDStatus(uint8_t reg[])
+{
+  return pvt_ReadDataReg(FRAME_SEND_STATUS, 1, reg, SD_STATUS_LEN);
+}
+
+uint16_t sd_ReadOCR(uint32_t *ocr)
+{
+  uint8_t r1;
+
+  CS_ASSERT;
+  sd_SendFixedCommand(FRAME_READ_OCR);
+  if ((r1 = sd_GetR1()) != OUT_OF_IDLE)
+  {
+    CS_DEASSERT;
+    return R1_ERROR | r1;
+  }
+  *ocr = 0;
+  for (uint8_t byteNum = 0; byteNum < OCR_LEN; ++byteNum)
+    *ocr = *ocr << 8 | sd_ReceiveByteSPI();
+  CS_DEASSERT;
+  return READ_SUCCESS;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      DECODE CARD REGISTERS
+ *
+ * Description : Decode the registers read by the functions above into their
+ *               fields. No SPI traffic.
+ *
+ * Arguments   : reg  - the register as read from the card.
+ *               xxx  - ptr to the struct instance to be loaded.
+ * ----------------------------------------------------------------------------
+ */
+void sd_DecodeCSD(const uint8_t reg[], SDCsd *csd)
+{
+  memset(csd, 0, sizeof(*csd));
+  csd->csdStructure     = pvt_GetBits(reg, CSD_LEN, 127, 2);
+  csd->taac             = pvt_GetBits(reg, CSD_LEN, 119, 8);
+  csd->nsac             = pvt_GetBits(reg, CSD_LEN, 111, 8);
+  csd->tranSpeed        = pvt_GetBits(reg, CSD_LEN, 103, 8);
+  csd->ccc              = pvt_GetBits(reg, CSD_LEN, 95, 12);
+  csd->readBlLen        = pvt_GetBits(reg, CSD_LEN, 83, 4);
+  csd->readBlPartial    = pvt_GetBits(reg, CSD_LEN, 79, 1);
+  csd->writeBlkMisalign = pvt_GetBits(reg, CSD_LEN, 78, 1);
+  csd->readBlkMisalign  = pvt_GetBits(reg, CSD_LEN, 77, 1);
+  csd->dsrImp           = pvt_GetBits(reg, CSD_LEN, 76, 1);
+  if (csd->csdStructure == CSD_VSN_SDSC)
+  {
+    csd->cSize          = pvt_GetBits(reg, CSD_LEN, 73, 12);
+    csd->vddRCurrMin    = pvt_GetBits(reg, CSD_LEN, 61, 3);
+    csd->vddRCurrMax    = pvt_GetBits(reg, CSD_LEN, 58, 3);
+    csd->vddWCurrMin    = pvt_GetBits(reg, CSD_LEN, 55, 3);
+    csd->vddWCurrMax    = pvt_GetBits(reg, CSD_LEN, 52, 3);
+    csd->cSizeMult      = pvt_GetBits(reg, CSD_LEN, 49, 3);
+  }
+  else if (csd->csdStructure == CSD_VSN_SDHC)
+    csd->cSize          = pvt_GetBits(reg, CSD_LEN, 69, 22);
+  else
+    csd->cSize          = pvt_GetBits(reg, CSD_LEN, 75, 28);
+  csd->eraseBlkEn       = pvt_GetBits(reg, CSD_LEN, 46, 1);
+  csd->sectorSize       = pvt_GetBits(reg, CSD_LEN, 45, 7);
+  csd->wpGrpSize        = pvt_GetBits(reg, CSD_LEN, 38, 7);
+  csd->wpGrpEnable      = pvt_GetBits(reg, CSD_LEN, 31, 1);
+  csd->r2wFactor        = pvt_GetBits(reg, CSD_LEN, 28, 3);
+  csd->writeBlLen       = pvt_GetBits(reg, CSD_LEN, 25, 4);
+  csd->writeBlPartial   = pvt_GetBits(reg, CSD_LEN, 21, 1);
+  csd->fileFormatGrp    = pvt_GetBits(reg, CSD_LEN, 15, 1);
+  csd->copy             = pvt_GetBits(reg, CSD_LEN, 14, 1);
+  csd->permWriteProtect = pvt_GetBits(reg, CSD_LEN, 13, 1);
+  csd->tmpWriteProtect  = pvt_GetBits(reg, CSD_LEN, 12, 1);
+  csd->fileFormat       = pvt_GetBits(reg, CSD_LEN, 11, 2);
+}
+
+void sd_DecodeCID(const uint8_t reg[], SDCid *cid)
+{
+  cid->mid = reg[0];
+  cid->oid[0] = reg[1];
+  cid->oid[1] = reg[2];
+  cid->oid[2] = '\0';
+  memcpy(cid->pnm, &reg[3], 5);
+  cid->pnm[5] = '\0';
+  cid->prv = reg[8];
+  cid->psn = pvt_GetBits(reg, CID_LEN, 55, 32);
+  cid->mdtYear = CID_MDT_YEAR_BASE + pvt_GetBits(reg, CID_LEN, 19, 8);
+  cid->mdtMonth = pvt_GetBits(reg, CID_LEN, 11, 4);
+}
+
+void sd_DecodeSCR(const uint8_t reg[], SDScr *scr)
+{
+  scr->scrStructure       = pvt_GetBits(reg, SCR_LEN, 63, 4);
+  scr->sdSpec             = pvt_GetBits(reg, SCR_LEN, 59, 4);
+  scr->dataStatAfterErase = pvt_GetBits(reg, SCR_LEN, 55, 1);
+  scr->sdSecurity         = pvt_GetBits(reg, SCR_LEN, 54, 3);
+  scr->sdBusWidths        = pvt_GetBits(reg, SCR_LEN, 51, 4);
+  scr->sdSpec3            = pvt_GetBits(reg, SCR_LEN, 47, 1);
+  scr->exSecurity         = pvt_GetBits(reg, SCR_LEN, 46, 4);
+  scr->sdSpec4            = pvt_GetBits(reg, SCR_LEN, 42, 1);
+  scr->sdSpecX            = pvt_GetBits(reg, SCR_LEN, 41, 4);
+  scr->cmdSupport         = pvt_GetBits(reg, SCR_LEN, 35, 4);
+}
+
+void sd_DecodeSDStatus(const uint8_t reg[], SDStatus *status)
+{
+  status->datBusWidth         = pvt_GetBits(reg, SD_STATUS_LEN, 511, 2);
+  status->securedMode         = pvt_GetBits(reg, SD_STATUS_LEN, 509, 1);
+  status->sdCardType          = pvt_GetBits(reg, SD_STATUS_LEN, 495, 16);
+  status->sizeOfProtectedArea = pvt_GetBits(reg, SD_STATUS_LEN, 479, 32);
+  status->speedClass          = pvt_GetBits(reg, SD_STATUS_LEN, 447, 8);
+  status->performanceMove     = pvt_GetBits(reg, SD_STATUS_LEN, 439, 8);
+  status->auSize              = pvt_GetBits(reg, SD_STATUS_LEN, 431, 4);
+  status->eraseSize           = pvt_GetBits(reg, SD_STATUS_LEN, 423, 16);
+  status->eraseTimeout        = pvt_GetBits(reg, SD_STATUS_LEN, 407, 6);
+  status->eraseOffset         = pvt_GetBits(reg, SD_STATUS_LEN, 401, 2);
+  status->uhsSpeedGrade       = pvt_GetBits(reg, SD_STATUS_LEN, 399, 4);
+  status->uhsAuSize           = pvt_GetBits(reg, SD_STATUS_LEN, 395, 4);
+  status->videoSpeedClass     = pvt_GetBits(reg, SD_STATUS_LEN, 391, 8);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          CAPACITY FROM CSD
+ *
+ * Description : Calculates the capacity of the card from its CSD fields.
+ *               sd_CsdNumOfBlcks is limited to 0xFFFFFFFF blocks (2TB), the
+ *               blocks that can be addressed with a 32-bit block address.
+ *
+ * Arguments   : csd  - ptr to the decoded CSD.
+ *
+ * Returns     : capacity in bytes / in blocks of BLOCK_LEN bytes. 0 if the CSD
+ *               version is not supported.
+ * ----------------------------------------------------------------------------
+ */
+uint64_t sd_CsdByteCapacity(const SDCsd *csd)
+{
+  // (C_SIZE + 1) * 2^(C_SIZE_MULT + 2) * 2^READ_BL_LEN
+  if (csd->csdStructure == CSD_VSN_SDSC)
+    return (uint64_t)(csd->cSize + 1) << (csd->cSizeMult + 2 + csd->readBlLen);
+
+  // (C_SIZE + 1) * 512 KB, for both version 2.0 and 3.0.
+  if (csd->csdStructure == CSD_VSN_SDHC || csd->csdStructure == CSD_VSN_SDUC)
+    return (uint64_t)(csd->cSize + 1) << 19;
+
+  return 0;
+}
+
+uint32_t sd_CsdNumOfBlcks(const SDCsd *csd)
+{
+  uint64_t numOfBlcks = sd_CsdByteCapacity(csd) / BLOCK_LEN;
+
+  return numOfBlcks > UINT32_MAX ? UINT32_MAX : numOfBlcks;
+}
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTIONS DEFINITIONS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                    READ DATA BLOCK REGISTER
+ *
+ * Description : Sends the command of frameIdx, preceded by APP_CMD if it is
+ *               an ACMD, and loads the register returned as a data block.
+ *
+ * Arguments   : frameIdx  - FRAME_XXXX index of the command.
+ *               isAppCmd  - 1 if the command is an ACMD, else 0.
+ *               reg       - array loaded with the register.
+ *               len       - length of the register in bytes.
+ *
+ * Returns     : as sd_ReadCSD.
+ * ----------------------------------------------------------------------------
+ */
+static uint16_t pvt_ReadDataReg(uint8_t frameIdx, uint8_t isAppCmd,
+                                uint8_t reg[], uint8_t len)
+{
+  uint8_t r1;
+
+  CS_ASSERT;
+  if (isAppCmd)
+  {
+    sd_SendFixedCommand(FRAME_APP_CMD);
+    if ((r1 = sd_GetR1()) != OUT_OF_IDLE)
+    {
+      CS_DEASSERT;
+      return R1_ERROR | r1;
+    }
+  }
+  sd_SendFixedCommand(frameIdx);
+  if ((r1 = sd_GetR1()) != OUT_OF_IDLE)
+  {
+    CS_DEASSERT;
+    return R1_ERROR | r1;
+  }
+
+  // SD_STATUS has an R2 response. Its second byte is not used.
+  if (isAppCmd && frameIdx == FRAME_SEND_STATUS)
+    sd_ReceiveByteSPI();
+
+  return sd_ReceiveDataBlock(reg, len);
+}
+
+// returns the field of width bits, whose MSB is bit msb, of a register.
+static uint32_t pvt_GetBits(const uint8_t reg[], uint8_t regLen,
+                            uint16_t msb, uint8_t width)
+{
+  uint32_t val = 0;
+
+  for (uint8_t i = 0; i < width; ++i)
+  {
+    uint16_t bitPos = msb - i;
+    val = val << 1 | (reg[regLen - 1 - bitPos / 8] >> (bitPos % 8) & 1);
+  }
+  return val;
+}
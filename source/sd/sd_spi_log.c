@@ -0,0 +1,348 @@
+/*
+ * File       : SD_SPI_LOG.C
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Implementation of SD_SPI_LOG.H.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "sd_spi_base.h"
+#include "sd_spi_rwe.h"
+#include "sd_spi_crc.h"
+#include "sd_spi_log.h"
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+static void    pvt_CloseBlock(SDLog *log);
+static uint8_t pvt_WriteBlocks(SDLog *log);
+static uint8_t pvt_ReadBlock(const SDLog *log, uint32_t offset,
+                             uint8_t blckArr[], uint32_t *seq);
+
+/*
+ ******************************************************************************
+ *                                  FUNCTIONS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                  FORMAT LOG
+ *
+ * Description : Erases the log's range and starts an empty log on it.
+ *
+ * Arguments   : log           - ptr to the SDLog instance.
+ *               startBlckNum  - number of the first block of the range.
+ *               numOfBlcks    - number of blocks in the range. At least 2.
+ *
+ * Returns     : LOG_SUCCESS or LOG_ERASE_ERROR.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_LogFormat(SDLog *log, uint32_t startBlckNum, uint32_t numOfBlcks)
+{
+  log->startBlckNum = startBlckNum;
+  log->numOfBlcks = numOfBlcks;
+  log->head = 0;
+  log->nextSeq = 0;
+  log->numOfFull = 0;
+  log->pos = 0;
+
+  // erased blocks read all 0's or 1's, so never hold LOG_MAGIC.
+  if (sd_EraseBlocks(startBlckNum * sd_BlckAddrStep,
+                     (startBlckNum + numOfBlcks - 1) * sd_BlckAddrStep)
+      != ERASE_SUCCESS)
+    return LOG_ERASE_ERROR;
+  return LOG_SUCCESS;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                   MOUNT LOG
+ *
+ * Description : Finds the newest block of the log on the range by bisection
+ *               and sets the log up to append after it.
+ *
+ * Arguments   : log           - ptr to the SDLog instance.
+ *               startBlckNum  - number of the first block of the range.
+ *               numOfBlcks    - number of blocks in the range. At least 2.
+ *
+ * Returns     : LOG_SUCCESS or LOG_READ_ERROR. An empty log is mounted with
+ *               head and nextSeq 0.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_LogMount(SDLog *log, uint32_t startBlckNum, uint32_t numOfBlcks)
+{
+  uint8_t *blckArr = log->buf[0];           // buffer is empty until mounted
+  uint32_t seq0, seq;
+  uint32_t lo, hi, mid;
+  uint8_t  resp;
+
+  log->startBlckNum = startBlckNum;
+  log->numOfBlcks = numOfBlcks;
+  log->head = 0;
+  log->nextSeq = 0;
+  log->numOfFull = 0;
+  log->pos = 0;
+
+  resp = pvt_ReadBlock(log, 0, blckArr, &seq0);
+  if (resp == LOG_READ_ERROR)
+    return resp;
+
+  //
+  // The first block is only missing if the log is empty, or if it was torn
+  // while the log wrapped to it. The newest block is then the last block.
+  //
+  if (resp == LOG_NO_BLOCK)
+  {
+    resp = pvt_ReadBlock(log, numOfBlcks - 1, blckArr, &seq);
+    if (resp == LOG_READ_ERROR)
+      return resp;
+    if (resp == LOG_SUCCESS)
+      log->nextSeq = seq + 1;
+    return LOG_SUCCESS;
+  }
+
+  //
+  // The sequence number of the block at offset i is seq0 + i for every block
+  // up to the newest, and not for any block after it. Find the last block
+  // for which it holds. lo always holds it, hi never does.
+  //
+  lo = 0;
+  hi = numOfBlcks;
+  while (hi - lo > 1)
+  {
+    mid = lo + (hi - lo) / 2;
+    resp = pvt_ReadBlock(log, mid, blckArr, &seq);
+    if (resp == LOG_READ_ERROR)
+      return resp;
+    if (resp == LOG_SUCCESS && seq == seq0 + mid)
+      lo = mid;
+    else
+      hi = mid;
+  }
+
+  log->head = (lo + 1) % numOfBlcks;
+  log->nextSeq = seq0 + lo + 1;
+  return LOG_SUCCESS;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                               APPEND RECORD
+ *
+ * Description : Appends a record to the log. The record is added to the block
+ *               in RAM. If it does not fit, the block is closed and the
+ *               record starts the next one. The blocks are written to the
+ *               card when SD_LOG_NUM_BLCKS are full.
+ *
+ * Arguments   : log     - ptr to the SDLog instance.
+ *               rec     - the record's bytes.
+ *               recLen  - length of the record. 1 to LOG_MAX_RECORD_LEN.
+ *
+ * Returns     : LOG_SUCCESS, LOG_INVALID_RECORD if recLen is 0, or
+ *               LOG_WRITE_ERROR if the full blocks could not be written.
+ *               The record is not appended if an error is returned.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_LogAppend(SDLog *log, const uint8_t rec[], uint8_t recLen)
+{
+  uint8_t *data;
+
+  if (recLen == 0)
+    return LOG_INVALID_RECORD;
+
+  if (log->pos + 1 + recLen > LOG_DATA_LEN)
+    pvt_CloseBlock(log);
+
+  // a block is only started once there is room for it in the buffer.
+  if (log->numOfFull == SD_LOG_NUM_BLCKS
+      && pvt_WriteBlocks(log) != LOG_SUCCESS)
+    return LOG_WRITE_ERROR;
+
+  data = &log->buf[log->numOfFull][LOG_HDR_LEN + log->pos];
+  data[0] = recLen;
+  memcpy(&data[1], rec, recLen);
+  log->pos += 1 + recLen;
+  return LOG_SUCCESS;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                   FLUSH LOG
+ *
+ * Description : Writes the blocks in RAM to the card, including the block in
+ *               progress. That block is closed, so the next record starts a
+ *               new block.
+ *
+ * Arguments   : log  - ptr to the SDLog instance.
+ *
+ * Returns     : LOG_SUCCESS or LOG_WRITE_ERROR.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_LogFlush(SDLog *log)
+{
+  if (log->pos)
+    pvt_CloseBlock(log);
+  return pvt_WriteBlocks(log);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                              READ LOG BLOCK
+ *
+ * Description : Reads a block of the log from the card and checks it.
+ *
+ * Arguments   : log      - ptr to the SDLog instance.
+ *               age      - 0 for the newest block written to the card, 1 for
+ *                          the one before it, and so on.
+ *               blckArr  - array of length BLOCK_LEN the block is read into.
+ *
+ * Returns     : LOG_SUCCESS, LOG_READ_ERROR, or LOG_NO_BLOCK if the block is
+ *               not in the log, having not been written or been overwritten.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_LogReadBlock(const SDLog *log, uint32_t age, uint8_t blckArr[])
+{
+  uint32_t seq;
+  uint8_t  resp;
+
+  if (age >= log->numOfBlcks || age >= log->nextSeq)
+    return LOG_NO_BLOCK;
+
+  resp = pvt_ReadBlock(log, (log->head + log->numOfBlcks - 1 - age)
+                            % log->numOfBlcks, blckArr, &seq);
+  if (resp == LOG_SUCCESS && seq != log->nextSeq - 1 - age)
+    return LOG_NO_BLOCK;
+  return resp;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                  GET RECORD
+ *
+ * Description : Gets a record from a block read with sd_LogReadBlock.
+ *
+ * Arguments   : blckArr  - the block.
+ *               pos      - ptr to the position of the record in the block's
+ *                          data. Set to 0 for the first record. Advanced to
+ *                          the next record.
+ *               rec      - ptr set to the record's bytes.
+ *
+ * Returns     : length of the record, or 0 if there are no more records.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_LogGetRecord(const uint8_t blckArr[], uint16_t *pos,
+                        const uint8_t **rec)
+{
+  uint16_t dataLen = ((uint16_t)blckArr[6] << 8) | blckArr[7];
+  uint8_t  recLen;
+
+  if (*pos >= dataLen)
+    return 0;
+
+  recLen = blckArr[LOG_HDR_LEN + *pos];
+  *rec = &blckArr[LOG_HDR_LEN + *pos + 1];
+  *pos += 1 + recLen;
+  return recLen;
+}
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTIONS DEFINITIONS
+ ******************************************************************************
+ */
+
+// close the block in progress. Stamps it with its header and CRC and counts
+// it as full. Its sequence number follows those of the full blocks before it.
+static void pvt_CloseBlock(SDLog *log)
+{
+  uint8_t *blck = log->buf[log->numOfFull];
+  uint32_t seq = log->nextSeq + log->numOfFull;
+  uint16_t crc;
+
+  blck[0] = (uint8_t)(LOG_MAGIC >> 8);
+  blck[1] = (uint8_t)LOG_MAGIC;
+  blck[2] = (uint8_t)(seq >> 24);
+  blck[3] = (uint8_t)(seq >> 16);
+  blck[4] = (uint8_t)(seq >> 8);
+  blck[5] = (uint8_t)seq;
+  blck[6] = (uint8_t)(log->pos >> 8);
+  blck[7] = (uint8_t)log->pos;
+  memset(&blck[LOG_HDR_LEN + log->pos], 0, LOG_DATA_LEN - log->pos);
+
+  crc = sd_CRC16(blck, BLOCK_LEN - LOG_CRC_LEN);
+  blck[BLOCK_LEN - 2] = (uint8_t)(crc >> 8);
+  blck[BLOCK_LEN - 1] = (uint8_t)crc;
+
+  ++log->numOfFull;
+  log->pos = 0;
+}
+
+//
+// write the full blocks to the card at the head of the log, in two writes if
+// the log wraps. Only called with no block in progress. Blocks that were
+// written are dropped from the buffer even if a later write fails.
+//
+static uint8_t pvt_WriteBlocks(SDLog *log)
+{
+  uint32_t n;
+  uint32_t blckAddr;
+  uint16_t resp;
+
+  while (log->numOfFull)
+  {
+    n = log->numOfBlcks - log->head;
+    if (n > log->numOfFull)
+      n = log->numOfFull;
+
+    blckAddr = (log->startBlckNum + log->head) * sd_BlckAddrStep;
+    if (n == 1)
+      resp = sd_WriteSingleBlock(blckAddr, log->buf[0]);
+    else
+      resp = sd_WriteMultipleBlocks(blckAddr, n, log->buf[0], NULL, NULL);
+    if (resp != WRITE_SUCCESS)
+      return LOG_WRITE_ERROR;
+
+    log->head = (log->head + n) % log->numOfBlcks;
+    log->nextSeq += n;
+    log->numOfFull -= n;
+    memmove(log->buf[0], log->buf[n], (size_t)log->numOfFull * BLOCK_LEN);
+  }
+  return LOG_SUCCESS;
+}
+
+//
+// read the block at offset of the log's range. Returns LOG_SUCCESS and its
+// sequence number in seq if it is a log block, LOG_NO_BLOCK if it is not, or
+// LOG_READ_ERROR.
+//
+static uint8_t pvt_ReadBlock(const SDLog *log, uint32_t offset,
+                             uint8_t blckArr[], uint32_t *seq)
+{
+  uint16_t dataLen;
+  uint16_t crc;
+
+  if (sd_ReadSingleBlock((log->startBlckNum + offset) * sd_BlckAddrStep,
+                         blckArr) != READ_SUCCESS)
+    return LOG_READ_ERROR;
+
+  dataLen = ((uint16_t)blckArr[6] << 8) | blckArr[7];
+  crc = ((uint16_t)blckArr[BLOCK_LEN - 2] << 8) | blckArr[BLOCK_LEN - 1];
+  if (blckArr[0] != (uint8_t)(LOG_MAGIC >> 8)
+      || blckArr[1] != (uint8_t)LOG_MAGIC
+      || dataLen > LOG_DATA_LEN
+      || crc != sd_CRC16(blckArr, BLOCK_LEN - LOG_CRC_LEN))
+    return LOG_NO_BLOCK;
+
+  *seq = ((uint32_t)blckArr[2] << 24) | ((uint32_t)blckArr[3] << 16)
+         | ((uint32_t)blckArr[4] << 8) | blckArr[5];
+  return LOG_SUCCESS;
+}
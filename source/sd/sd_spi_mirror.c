@@ -0,0 +1,255 @@
+/*
+ * File       : SD_SPI_MIRROR.C
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Implementation of SD_SPI_MIRROR.H.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sd_spi_base.h"
+#include "sd_spi_rwe.h"
+#include "sd_spi_card.h"
+#include "sd_spi_mirror.h"
+
+/*
+ ******************************************************************************
+ *                                   STRUCTS
+ ******************************************************************************
+ */
+
+// ctx of pvt_PassBlock. Numbers the blocks across a read that is resumed on
+// the other card.
+typedef struct MirrorRead
+{
+  SDBlockHandler blckHndlr;
+  void          *ctx;
+  uint32_t       numDone;                   // blocks passed to blckHndlr
+  uint8_t        stop;                      // blckHndlr stopped the stream
+} MirrorRead;
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+static uint16_t pvt_SelectCard(SDMirror *mirror, uint8_t cardIdx);
+static uint8_t  pvt_PassBlock(uint32_t blckIdx, const uint8_t blckArr[],
+                              void *ctx);
+
+/*
+ ******************************************************************************
+ *                                  FUNCTIONS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                     MIRRORED WRITE BLOCK(S)
+ *
+ * Description : Writes the block(s) to both cards. sd_MirrorWriteBlock 
+ *               writes the block to one card and then the other with 
+ *               sd_WriteSingleBlock. sd_MirrorWriteBlocks opens a write 
+ *               stream (sd_WriteStreamOpen) on each card and sends each block
+ *               to one card and then the other, so each card programs a block
+ *               while the block is sent to the other card.
+ *
+ * Arguments   : mirror        - ptr to the SDMirror instance.
+ *               blckNum       - number of the (first) block to be written.
+ *               numOfBlcks    - number of blocks to write.
+ *               dataArr       - data to be written, BLOCK_LEN bytes per block.
+ *                               Not used by sd_MirrorWriteBlocks if blckSrc
+ *                               is not NULL.
+ *               blckSrc, ctx  - as sd_WriteMultipleBlocks. blckSrc is called
+ *                               once for each block, for both cards.
+ *
+ * Returns     : MIRROR RESULT FLAGS.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_MirrorWriteBlock(SDMirror *mirror, uint32_t blckNum,
+                            const uint8_t dataArr[])
+{
+  uint8_t result = 0;
+
+  for (uint8_t i = 0; i < MIRROR_NUM_OF_CARDS; ++i)
+  {
+    uint16_t step = pvt_SelectCard(mirror, i);
+
+    mirror->resp[i] = sd_WriteSingleBlock(blckNum * step, dataArr);
+    if (mirror->resp[i] == WRITE_SUCCESS)
+      result |= MIRROR_SUCCESS;
+    else
+      result |= MIRROR_CARD0_ERROR << i;
+  }
+  return result;
+}
+
+uint8_t sd_MirrorWriteBlocks(SDMirror *mirror, uint32_t blckNum,
+                             uint32_t numOfBlcks, const uint8_t dataArr[],
+                             SDBlockSource blckSrc, void *ctx)
+{
+  const uint8_t *blckData;
+  uint8_t  opened = 0;                      // bit i set if card i's stream is
+  uint8_t  failed = 0;                      // open / has failed
+  uint8_t  result = 0;
+
+  for (uint8_t i = 0; i < MIRROR_NUM_OF_CARDS; ++i)
+  {
+    uint16_t step = pvt_SelectCard(mirror, i);
+
+    mirror->resp[i] = numOfBlcks ? sd_WriteStreamOpen(blckNum * step, 
+                                                      numOfBlcks)
+                                 : WRITE_SUCCESS;
+    if (mirror->resp[i] == WRITE_SUCCESS)
+      opened |= 1 << i;
+    else
+      failed |= 1 << i;
+  }
+
+  //
+  // Send each block to one card and then the other. A card programs the 
+  // block with CS deasserted while the block is sent to the other card, so
+  // it is usually ready for the next block when it is selected again.
+  //
+  for (uint32_t blckIdx = 0; blckIdx < numOfBlcks && opened & ~failed; 
+       ++blckIdx)
+  {
+    if (blckSrc)
+    {
+      if (!(blckData = blckSrc(blckIdx, ctx)))
+        break;
+    }
+    else
+      blckData = dataArr + blckIdx * BLOCK_LEN;
+
+    for (uint8_t i = 0; i < MIRROR_NUM_OF_CARDS; ++i)
+    {
+      if (failed & 1 << i)
+        continue;
+      pvt_SelectCard(mirror, i);
+      mirror->resp[i] = sd_WriteStreamBlock(blckData);
+      if (mirror->resp[i] != WRITE_SUCCESS)
+        failed |= 1 << i;
+    }
+  }
+
+  // a stream is closed after an error too, keeping the error's response.
+  for (uint8_t i = 0; i < MIRROR_NUM_OF_CARDS; ++i)
+  {
+    uint16_t resp;
+
+    if (!(opened & 1 << i))
+      continue;
+    pvt_SelectCard(mirror, i);
+    resp = sd_WriteStreamClose();
+    if (!(failed & 1 << i) && resp != WRITE_SUCCESS)
+    {
+      mirror->resp[i] = resp;
+      failed |= 1 << i;
+    }
+  }
+
+  for (uint8_t i = 0; i < MIRROR_NUM_OF_CARDS; ++i)
+    result |= failed & 1 << i ? MIRROR_CARD0_ERROR << i : MIRROR_SUCCESS;
+  return result;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      MIRRORED READ BLOCK(S)
+ *
+ * Description : Reads the block(s) from one of the cards, alternating between
+ *               the cards on each call. If the read fails, it is completed on
+ *               the other card. sd_MirrorReadBlocks resumes from the first
+ *               block not passed to blckHndlr, or reads all of the blocks
+ *               again if blckHndlr is NULL.
+ *
+ * Arguments   : mirror          - ptr to the SDMirror instance.
+ *               blckNum         - number of the (first) block to be read.
+ *               numOfBlcks      - number of blocks to read.
+ *               blckArr         - as sd_ReadSingleBlock / sd_ReadMultipleBlocks.
+ *               blckHndlr, ctx  - as sd_ReadMultipleBlocks.
+ *
+ * Returns     : MIRROR RESULT FLAGS.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sd_MirrorReadBlock(SDMirror *mirror, uint32_t blckNum,
+                           uint8_t blckArr[])
+{
+  uint8_t result = 0;
+  uint8_t first = mirror->nextRead;
+
+  mirror->nextRead = (first + 1) % MIRROR_NUM_OF_CARDS;
+  for (uint8_t n = 0; n < MIRROR_NUM_OF_CARDS; ++n)
+  {
+    uint8_t i = (first + n) % MIRROR_NUM_OF_CARDS;
+    uint16_t step = pvt_SelectCard(mirror, i);
+
+    mirror->resp[i] = sd_ReadSingleBlock(blckNum * step, blckArr);
+    if (mirror->resp[i] == READ_SUCCESS)
+      return result | MIRROR_SUCCESS;
+    result |= MIRROR_CARD0_ERROR << i;
+  }
+  return result;
+}
+
+uint8_t sd_MirrorReadBlocks(SDMirror *mirror, uint32_t blckNum,
+                            uint32_t numOfBlcks, uint8_t blckArr[],
+                            SDBlockHandler blckHndlr, void *ctx)
+{
+  MirrorRead rd = { blckHndlr, ctx, 0, 0 };
+  uint8_t    result = 0;
+  uint8_t    first = mirror->nextRead;
+
+  mirror->nextRead = (first + 1) % MIRROR_NUM_OF_CARDS;
+  for (uint8_t n = 0; n < MIRROR_NUM_OF_CARDS; ++n)
+  {
+    uint8_t i = (first + n) % MIRROR_NUM_OF_CARDS;
+    uint16_t step = pvt_SelectCard(mirror, i);
+
+    if (blckHndlr)
+      mirror->resp[i] = sd_ReadMultipleBlocks((blckNum + rd.numDone) * step,
+                                              numOfBlcks - rd.numDone, blckArr,
+                                              pvt_PassBlock, &rd);
+    else
+      mirror->resp[i] = sd_ReadMultipleBlocks(blckNum * step, numOfBlcks,
+                                              blckArr, NULL, NULL);
+    if (mirror->resp[i] != READ_SUCCESS)
+      result |= MIRROR_CARD0_ERROR << i;
+
+    // the blocks have been read if the only error was in stopping the stream.
+    if (mirror->resp[i] == READ_SUCCESS || rd.stop
+        || (blckHndlr && rd.numDone == numOfBlcks))
+      return result | MIRROR_SUCCESS;
+  }
+  return result;
+}
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTIONS DEFINITIONS
+ ******************************************************************************
+ */
+
+// select card cardIdx of the mirror. Returns its block address step.
+static uint16_t pvt_SelectCard(SDMirror *mirror, uint8_t cardIdx)
+{
+  sd_SelectCard(mirror->card[cardIdx]);
+  return sd_BlckAddrStep;
+}
+
+// SDBlockHandler of sd_MirrorReadBlocks. Passes each block on to the caller's
+// handler, numbered from the first block of the mirrored read.
+static uint8_t pvt_PassBlock(uint32_t blckIdx, const uint8_t blckArr[],
+                             void *ctx)
+{
+  MirrorRead *rd = ctx;
+
+  (void)blckIdx;
+  rd->stop = rd->blckHndlr(rd->numDone++, blckArr, rd->ctx);
+  return rd->stop;
+}
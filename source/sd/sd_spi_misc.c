@@ -12,6 +12,7 @@
 #include "prints.h"
 #include "sd_spi_base.h"
 #include "sd_spi_rwe.h"
+#include "sd_spi_info.h"
 #include "sd_spi_misc.h"
 #include "sd_spi_print.h"
 
@@ -20,8 +21,9 @@
  *                         "Private" FUNCTION PROTOTYPES  
  ******************************************************************************
  */
-static uint32_t pvt_GetByteCapacitySDHC(void);
-static uint32_t pvt_GetByteCapacitySDSC(void);
+static uint8_t  pvt_GetCSD(const CTV *ctv, SDCsd *csd);
+static uint8_t  pvt_PrintBlockHandler(uint32_t blckIdx, const uint8_t blckArr[],
+                                      void *ctx);
 
 /*
  ******************************************************************************
@@ -34,34 +36,43 @@ static uint32_t pvt_GetByteCapacitySDSC(void);
  * ----------------------------------------------------------------------------
  *                                                     CARD CAPACITY CALCULATOR
  *                                        
- * Description : Gets the total byte capacity of the SD card and returns the 
- *               value. This function actually just operates to determine the
- *               card type (SDHC or SDSC) and uses this to call the correct 
- *               "private" function that will act to get the appropriate
- *               parameters from the card used and use these to calculate the 
- *               capacity. Which parameters and how the calculation is 
- *               performed is unique to the card type. 
+ * Description : Gets the total capacity of the SD card in bytes, or in blocks
+ *               of BLOCK_LEN bytes. The CSD register is read with sd_ReadCSD
+ *               and decoded with sd_DecodeCSD from SD_SPI_INFO. The CSD 
+ *               version must match the card type. The block capacity is 
+ *               limited to the 2TB that can be addressed. See 
+ *               sd_CsdNumOfBlcks.
  * 
- * Arguments   : ctv   - ptr to a CTV struct instance that. The value of the 
- *                       'type' member is used to determine which function to 
- *                       call to calculate the byte capacity.
+ * Arguments   : ctv   - ptr to a CTV struct instance set by sd_InitModeSPI.
  *
- * Returns     : The byte capacity of the SD card. If FAILED_CAPACITY_CALC (1)
- *               is returned instead, then the calc failed. This is a generic, 
+ * Returns     : The byte / block capacity of the SD card. If 
+ *               FAILED_CAPACITY_CALC (1) is returned instead, then the calc 
+ *               failed. This is a generic, 
  *               non-descriptive error and is used simply to indicate that an 
  *               issue was encountered during the process of getting the 
  *               capacity - this could include unknown card type, R1 error, 
  *               issue getting register contents, or something else.
+ * 
+ * Notes       : Sends SEND_CSD on every call. If sd_ReadCardInfo has been 
+ *               called, use the numOfBlcks member of SDCardInfo instead.
  * ----------------------------------------------------------------------------
  */
-uint32_t sd_GetCardByteCapacity(const CTV *ctv)
+uint64_t sd_GetCardByteCapacity(const CTV *ctv)
 {
-  if (ctv->type == SDHC)
-    return pvt_GetByteCapacitySDHC();
-  else if (ctv->type == SDSC)
-    return pvt_GetByteCapacitySDSC();
-  else
+  SDCsd csd;
+
+  if (!pvt_GetCSD(ctv, &csd))
     return FAILED_CAPACITY_CALC;
+  return sd_CsdByteCapacity(&csd);
+}
+
+uint32_t sd_GetCardBlockCapacity(const CTV *ctv)
+{
+  SDCsd csd;
+
+  if (!pvt_GetCSD(ctv, &csd))
+    return FAILED_CAPACITY_CALC;
+  return sd_CsdNumOfBlcks(&csd);
 }
 
 /* 
@@ -76,36 +87,43 @@ uint32_t sd_GetCardByteCapacity(const CTV *ctv)
  *               endBlckAddr     - Address of the last block to search.
  *
  * Notes       : 1) Useful for finding which blocks may contain raw data.
- *               2) Not fast, so if using, suggest only searching over a small
- *                  range at a time.
+ *               2) The blocks are scanned with sd_ScanBlocks, so only the 
+ *                  bytes of a block up to its first non-zero byte are read.
+ *                  Printing is still slow, so suggest only searching over a 
+ *                  small range at a time.
  * ----------------------------------------------------------------------------
  */
 void sd_FindNonZeroDataBlockNums(uint32_t startBlckAddr, uint32_t endBlckAddr)
 {
   // keeps track of numbers printed on each line
   uint16_t numPerLine = 0;        
-  
-  // loop from start to end block
-  for (uint32_t blckNum = startBlckAddr; blckNum <= endBlckAddr; ++blckNum)
+  uint8_t  bitmap[NZDBN_SCAN_BLCKS / 8];
+  uint32_t numOfBlcks = (endBlckAddr - startBlckAddr) / sd_BlckAddrStep + 1;
+  uint32_t scanLen;
+
+  //
+  // scan the blocks NZDBN_SCAN_BLCKS at a time and print the address of each
+  // block that is marked as holding non-zero data.
+  //
+  for (uint32_t blckIdx = 0; blckIdx < numOfBlcks; blckIdx += scanLen)
   {
-    uint8_t blkArr[BLOCK_LEN];
-    sd_ReadSingleBlock(blckNum, blkArr);    // load block into blkArr[]
-    
-    //
-    // loop through bytes in blkArr[]. If any are non-zero then print the
-    // number that block and break to get the next block.
-    //
-    for (uint16_t byteNum = 0; byteNum < BLOCK_LEN; ++byteNum)
+    scanLen = numOfBlcks - blckIdx;
+    if (scanLen > NZDBN_SCAN_BLCKS)
+      scanLen = NZDBN_SCAN_BLCKS;
+    if (sd_ScanBlocks(startBlckAddr + blckIdx * sd_BlckAddrStep, scanLen, 0,
+                      bitmap) != READ_SUCCESS)
+      return;
+
+    for (uint32_t i = 0; i < scanLen; ++i)
     {
-      if (blkArr[byteNum] != 0)
+      if (bitmap[i / 8] & (1 << (i % 8)))
       {
         // begin new line if numPerLine is multiple of NZDBN_PER_LINE.
         if (!(numPerLine % NZDBN_PER_LINE))
           print_Str("\n\r");
         print_Str("\t\t"); 
-        print_Dec(blckNum);
+        print_Dec(startBlckAddr + (blckIdx + i) * sd_BlckAddrStep);
         ++numPerLine;
-        break;
       }
     }
   }
@@ -113,196 +131,192 @@ void sd_FindNonZeroDataBlockNums(uint32_t startBlckAddr, uint32_t endBlckAddr)
 
 /* 
  * ----------------------------------------------------------------------------
- *                                                        PRINT MULTIPLE BLOCKS
- *           
- * Description : Prints the contents of multiple blocks by calling the 
- *               READ_MULTIPLE_BLOCK SD card command. Each block read in will
- *               be printed to the screen using sd_PrintSingleBlock() function
- *               from SD_SPI_RWE.
- * 
- * Arguments   : startBlckAddr   - Address of the first block to be printed.
- *               numOfBlcks      - The number of blocks to be printed to the 
- *                                 screen starting at startBlckAddr.
+ *                                                              GET ERASED BYTE
+ *                                        
+ * Description : Reads the SCR register to get the value of the bytes of an
+ *               erased block, 0x00 or 0xFF, set by the card's 
+ *               DATA_STAT_AFTER_ERASE bit.
  * 
- * Returns     : Read Block Error (upper byte) and R1 Response (lower byte).
+ * Arguments   : erasedByte   - ptr loaded with the erased byte value.
+ *
+ * Returns     : Value returned by sd_ReadSCR.
  * ----------------------------------------------------------------------------
  */
-uint16_t sd_PrintMultipleBlocks(uint32_t startBlckAddr, uint32_t numOfBlcks)
+uint16_t sd_GetErasedByte(uint8_t *erasedByte)
 {
-  //
-  // send request for SD card to return contents of the blocks starting at the
-  // startBlckAddr. If request accepted then R1 resp is OUT_OF_IDLE.
-  //
-  CS_ASSERT;
-  sd_SendCommand(READ_MULTIPLE_BLOCK, startBlckAddr);
-  uint8_t r1 = sd_GetR1();
-  if (r1 != OUT_OF_IDLE)
+  uint8_t  reg[SCR_LEN];
+  SDScr    scr;
+  uint16_t resp;
+
+  resp = sd_ReadSCR(reg);
+  if (resp == READ_SUCCESS)
   {
-    CS_DEASSERT;
-    return (R1_ERROR | r1);
+    sd_DecodeSCR(reg, &scr);
+    *erasedByte = ERASED_BYTE(scr.dataStatAfterErase);
   }
+  return resp;
+}
 
-  //
-  // This loop will read in the next block and print its contents to the screen
-  // on each loop iteration.
-  //
-  for (uint8_t blckNum = 0; blckNum < numOfBlcks; ++blckNum)
+/* 
+ * ----------------------------------------------------------------------------
+ *                                                      FIND LAST WRITTEN BLOCK
+ *                                        
+ * Description : Finds the end of the written data of a range of blocks that
+ *               is filled in order from its first block, such as by a data
+ *               logger, with erased blocks after the data. The range is
+ *               bisected, so only about log2(number of blocks) blocks are 
+ *               read.
+ * 
+ * Arguments   : startBlckNum     - number of the first block of the range.
+ *               endBlckNum       - number of the last block of the range.
+ *               erasedByte       - byte value of erased data. See 
+ *                                  sd_GetErasedByte.
+ *               numOfWrtnBlcks   - ptr loaded with the number of written 
+ *                                  blocks at the start of the range. The last
+ *                                  written block is startBlckNum + 
+ *                                  numOfWrtnBlcks - 1. 0 if none are written.
+ *
+ * Returns     : READ_SUCCESS, or the error returned by sd_ScanBlocks.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_FindLastWrittenBlock(uint32_t startBlckNum, uint32_t endBlckNum,
+                                 uint8_t erasedByte, uint32_t *numOfWrtnBlcks)
+{
+  uint8_t  inUse = 0;                      // bit 0 set by the scan
+  uint32_t lo = 0;                          // blocks before lo are written
+  uint32_t hi = endBlckNum - startBlckNum + 1;  // blocks from hi are erased
+  uint32_t mid;
+  uint16_t resp;
+
+  while (lo < hi)
   {
-    uint8_t  blckArr[BLOCK_LEN];
-
-    // print the block number for the current iteration.
-    print_Str("\n\n\r                                    BLOCK ");
-    print_Dec(startBlckAddr + blckNum);
-    
-    //
-    // loop until Start Block Token received. Return error if max attempts
-    // reached without receiving valid response.
-    //
-    for (uint16_t attempts = 0; sd_ReceiveByteSPI() != START_BLOCK_TKN;)
-      if (++attempts > MAX_ATTEMPTS) 
-        return (START_TOKEN_TIMEOUT | r1);
-
-    // Load array with data from SD card block.
-    for (uint16_t byteNum = 0; byteNum < BLOCK_LEN; ++byteNum) 
-      blckArr[byteNum] = sd_ReceiveByteSPI();
-    
-    // 16-bit CRC. CRC is off (default) so values returned do not matter.
-    sd_ReceiveByteSPI(); 
-    sd_ReceiveByteSPI();
-
-    // print the block to the screen.
-    sd_PrintSingleBlock(blckArr);
+    // the scan stops receiving a written block at its first data byte.
+    mid = lo + (hi - lo) / 2;
+    resp = sd_ScanBlocks((startBlckNum + mid) * sd_BlckAddrStep, 1, 
+                         erasedByte, &inUse);
+    if (resp != READ_SUCCESS)
+      return resp;
+
+    if (inUse & 0x01)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
-  
-  // stop SD card from sending data blocks
-  sd_SendCommand(STOP_TRANSMISSION, 0);
-  
-  // R1b response. Don't care.
-  sd_ReceiveByteSPI(); 
-
-  CS_DEASSERT;
+
+  *numOfWrtnBlcks = lo;
   return READ_SUCCESS;
 }
 
 /* 
  * ----------------------------------------------------------------------------
- *                                                        WRITE MULTIPLE BLOCKS
- *           
- * Description : Write the contents of a byte array of length BLOCK_LEN to 
- *               multiple blocks of the SD card. The entire array will be
- *               copied to each block. This function is mostly useful for 
- *               testing the WRITE_MULTIPLE_BLOCK SD card command.
- * 
- * Arguments   : startBlckAddr   - Address of the first block to be written.
- *               numOfBlcks      - Number of blocks to be written to.
- *               dataArr         - Pointer to an array holding the data 
- *                                 contents that will be written to each of 
- *                                 the specified SD card blocks. The array 
- *                                 must be of length BLOCK_LEN.
+ *                                                          BUILD OCCUPANCY MAP
+ *                                        
+ * Description : Maps which groups of blocks of a range hold data, as a job
+ *               that is run a few blocks at a time so that it can be spread
+ *               across a main loop. sd_BuildOccupancyMap sets up the job and
+ *               clears the bitmap. Each call to sd_OccupancyMapStep then 
+ *               scans up to maxBlcks blocks, streaming the blocks of a group
+ *               with sd_FindDataBlock. A group is known to be in use at the
+ *               first byte that is not erased, so the stream is stopped there
+ *               and the rest of the group is skipped.
  * 
- * Returns     : Write Block Error (upper byte) and R1 Response (lower byte).
+ * Arguments   : map            - ptr to the SDOccupancyMap instance of the 
+ *                                job.
+ *               startBlckNum   - number of the first block of the range.
+ *               endBlckNum     - number of the last block of the range.
+ *               bitmap         - the map, of length (number of groups + 7) / 8.
+ *                                See SDOccupancyMap.
+ *               grpLen         - number of blocks mapped by each bit. The last
+ *                                group may be shorter.
+ *               erasedByte     - byte value of erased data. See 
+ *                                sd_GetErasedByte.
+ *               maxBlcks       - largest number of blocks to scan in the call.
+ *
+ * Returns     : sd_OccupancyMapStep returns OCC_MAP_IN_PROGRESS or 
+ *               OCC_MAP_DONE, or the error returned by sd_FindDataBlock. 
+ *               After an error, the next call repeats the failed scan.
  * ----------------------------------------------------------------------------
  */
-uint16_t sd_WriteMultipleBlocks(uint32_t startBlckAddr, uint32_t numOfBlcks, 
-                                const uint8_t dataArr[])
+void sd_BuildOccupancyMap(SDOccupancyMap *map, uint32_t startBlckNum,
+                          uint32_t endBlckNum, uint8_t bitmap[],
+                          uint32_t grpLen, uint8_t erasedByte)
 {
-  uint16_t retTkn = INVALID_DATA_RESPONSE;  // initialize return value
+  map->startBlckNum = startBlckNum;
+  map->numOfBlcks = endBlckNum - startBlckNum + 1;
+  map->grpLen = grpLen;
+  map->bitmap = bitmap;
+  map->erasedByte = erasedByte;
+  map->blckIdx = 0;
+
+  // groups are only marked when found in use.
+  for (uint32_t i = 0; i < (map->numOfBlcks + grpLen - 1) / grpLen; i += 8)
+    bitmap[i / 8] = 0;
+}
 
-  //
-  // send request to write to multiple blocks on the SD card beginning at the 
-  // startBlckAddr. If accepted, this will continue until the Stop Transmission
-  // byte token is sent. This is not the STOP_TRANSMISSION SD card command.
-  //
-  CS_ASSERT; 
-  sd_SendCommand(WRITE_MULTIPLE_BLOCK, startBlckAddr);
-  uint8_t r1 = sd_GetR1();
-  if (r1 != OUT_OF_IDLE)
-  {
-    CS_DEASSERT;
-    return (R1_ERROR | r1);
-  }
+uint16_t sd_OccupancyMapStep(SDOccupancyMap *map, uint32_t maxBlcks)
+{
+  uint32_t grpIdx;
+  uint32_t grpEnd;                          // index of the group's next group
+  uint32_t scanLen;
+  uint32_t usedIdx;
+  uint16_t resp;
 
-  // loop over the blocks beginning with block at startBlckAddr
-  for (uint32_t blckNum = 0; blckNum < numOfBlcks; ++blckNum)
+  while (maxBlcks && map->blckIdx < map->numOfBlcks)
   {
-    uint8_t dataRespTkn = 0;
-    
-    // send the multi-block write Start Block Token to initiate data transfer
-    sd_SendByteSPI(START_BLOCK_TKN_MBW); 
-
-    // send data for a single block to SD card, 1 byte at a time.
-    for (uint16_t byteNum = 0; byteNum < BLOCK_LEN; ++byteNum)
-      sd_SendByteSPI(dataArr[byteNum]);
-
-    // Send 16-bit CRC. Off by default, so values do not matter.
-    sd_SendByteSPI(0xFF);
-    sd_SendByteSPI(0xFF);
-  
-    //
-    // loop until valid data response token received or function exits on max 
-    // attempts limit reached without receiving valid response.
-    //
-    for (uint16_t attempts = 0; 
-         dataRespTkn != DATA_ACCEPTED_TKN
-         && dataRespTkn != CRC_ERROR_TKN 
-         && dataRespTkn != WRITE_ERROR_TKN;)
+    grpIdx = map->blckIdx / map->grpLen;
+    grpEnd = (grpIdx + 1) * map->grpLen;
+    if (grpEnd > map->numOfBlcks)
+      grpEnd = map->numOfBlcks;
+
+    // scan the rest of the group, or as much of it as is allowed.
+    scanLen = grpEnd - map->blckIdx;
+    if (scanLen > maxBlcks)
+      scanLen = maxBlcks;
+    resp = sd_FindDataBlock((map->startBlckNum + map->blckIdx) 
+                            * sd_BlckAddrStep, scanLen, map->erasedByte,
+                            &usedIdx);
+    if (resp != READ_SUCCESS)
+      return resp;
+
+    if (usedIdx < scanLen)
     {
-      dataRespTkn = sd_ReceiveByteSPI() & DATA_RESPONSE_TKN_MASK;
-      if (++attempts > MAX_ATTEMPTS)
-      {
-        CS_DEASSERT;
-        return (DATA_RESPONSE_TIMEOUT | r1);
-      }
+      map->bitmap[grpIdx / 8] |= 1 << (grpIdx % 8);
+      maxBlcks -= usedIdx + 1;
+      map->blckIdx = grpEnd;                // skip the rest of the group
     }
-
-    //
-    // if SD card signals the data was accepted by returning the Data Accepted
-    // Token then the card will enter 'busy' state while it writes data to the
-    // block. While busy, the card will hold the DO line at 0. If the max 
-    // attempts limit is reached then the function will return
-    // CARD_BUSY_TIMEOUT. If CRC_ERROR or WRITE_ERROR_TOKEN are received then 
-    // the loop breaks, at which point the function sends the stop transmit.
-    //
-    if (dataRespTkn == DATA_ACCEPTED_TKN)     
-    {
-      for (uint16_t attempts = 0; sd_ReceiveByteSPI() == 0; ++attempts)
-        if (attempts > 2 * MAX_ATTEMPTS)    // increased attempts limit
-        {
-          CS_DEASSERT;
-          return (CARD_BUSY_TIMEOUT | r1);
-        }
-      retTkn = WRITE_SUCCESS;
-    }
-    else if (dataRespTkn == CRC_ERROR_TKN)
-    {
-      retTkn = CRC_ERROR_TKN_RECEIVED;
-      break;
-    }
-    else if (dataRespTkn == WRITE_ERROR_TKN) 
+    else
     {
-      retTkn = WRITE_ERROR_TKN_RECEIVED;
-      break;
+      maxBlcks -= scanLen;
+      map->blckIdx += scanLen;
     }
   }
 
-  // Stop Transmission. 0xFD is the Stop Transmission Token
-  sd_SendByteSPI(STOP_TRANSMIT_TKN_MBW);
-  for (uint16_t attempts = 0; sd_ReceiveByteSPI() == 0; ++attempts)
-    if (attempts > 2 * MAX_ATTEMPTS)        // increased attempts limit
-    {
-      CS_DEASSERT;
-      return (CARD_BUSY_TIMEOUT | r1);
-    }
+  return map->blckIdx < map->numOfBlcks ? OCC_MAP_IN_PROGRESS : OCC_MAP_DONE;
+}
 
-  //
-  // Have found that even after CARD_BUSY is no longer true, that if another
-  // command is immediately issued, it results in errors unless some delay is
-  // added before deasserting CS here.
-  //
-  sd_WaitSPI(0x5FF);
-  CS_DEASSERT;
+/* 
+ * ----------------------------------------------------------------------------
+ *                                                        PRINT MULTIPLE BLOCKS
+ *           
+ * Description : Prints the contents of multiple blocks. The blocks are 
+ *               streamed with sd_ReadMultipleBlocks from SD_SPI_RWE and each 
+ *               block read in will be printed to the screen using 
+ *               sd_PrintSingleBlock() function from SD_SPI_PRINT.
+ * 
+ * Arguments   : startBlckAddr   - Address of the first block to be printed.
+ *               numOfBlcks      - The number of blocks to be printed to the 
+ *                                 screen starting at startBlckAddr.
+ * 
+ * Returns     : Value returned by sd_ReadMultipleBlocks.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_PrintMultipleBlocks(uint32_t startBlckAddr, uint32_t numOfBlcks)
+{
+  uint8_t blckArr[BLOCK_LEN];
 
-  return (retTkn | r1);                            // successful write.
+  // stream the blocks, printing each one as it is received.
+  return sd_ReadMultipleBlocks(startBlckAddr, numOfBlcks, blckArr,
+                               pvt_PrintBlockHandler, &startBlckAddr);
 }
 
 /* 
@@ -321,7 +335,8 @@ uint16_t sd_WriteMultipleBlocks(uint32_t startBlckAddr, uint32_t numOfBlcks,
  *                                 blocks successfully written to before a  
  *                                 write error occurred on multi-block write.
  * 
- * Returns     : Read Block Error (upper byte) and R1 Response (lower byte).
+ * Returns     : READ_SUCCESS, START_TOKEN_TIMEOUT or READ_CRC_ERROR, or 
+ *               R1_ERROR with the R1 response if a command is rejected.
  * 
  * Warning     : This function has not been tested yet.
  * ----------------------------------------------------------------------------
@@ -329,10 +344,12 @@ uint16_t sd_WriteMultipleBlocks(uint32_t startBlckAddr, uint32_t numOfBlcks,
 uint16_t sd_GetNumOfWellWrittenBlocks(uint32_t *wellWrtnBlcks)
 {
   uint8_t  r1;
+  uint8_t  buf[4];
+  uint16_t resp;
 
   // Send APP_CMD to signal next command is an ACMD type command
   CS_ASSERT;
-  sd_SendCommand(APP_CMD, 0);                             
+  sd_SendFixedCommand(FRAME_APP_CMD);
   if ((r1 = sd_GetR1()) != OUT_OF_IDLE) 
   {   
     CS_DEASSERT;
@@ -340,36 +357,19 @@ uint16_t sd_GetNumOfWellWrittenBlocks(uint32_t *wellWrtnBlcks)
   }
 
   // Get number of well written blocks
-  sd_SendCommand(SEND_NUM_WR_BLOCKS, 0);
+  sd_SendFixedCommand(FRAME_SEND_NUM_WR_BLOCKS);
   if ((r1 = sd_GetR1()) != OUT_OF_IDLE) 
   {
     CS_DEASSERT;
     return (R1_ERROR | r1);
   }
 
-  //
-  // loop until Start Block Token received. Return error if max attempts 
-  // reached without receiving a valid response.
-  //
-  for (uint16_t attempts = 0; sd_ReceiveByteSPI() != START_BLOCK_TKN;)
-    if (++attempts > MAX_ATTEMPTS) 
-      return (START_TOKEN_TIMEOUT | r1);
-  
-  // Get the number of well written blocks (32-bit)
-  *wellWrtnBlcks  = sd_ReceiveByteSPI();
-  *wellWrtnBlcks <<= 8;
-  *wellWrtnBlcks |= sd_ReceiveByteSPI();
-  *wellWrtnBlcks <<= 8;
-  *wellWrtnBlcks |= sd_ReceiveByteSPI();
-  *wellWrtnBlcks <<= 8;
-  *wellWrtnBlcks |= sd_ReceiveByteSPI();
-
-  // get 16-bit CRC bytes. CRC is off by default so values do not matter.
-  sd_ReceiveByteSPI();
-  sd_ReceiveByteSPI();
-
-  CS_DEASSERT;
+  // the count is returned as a 4 byte data block, most significant byte first.
+  if ((resp = sd_ReceiveDataBlock(buf, 4)) != READ_SUCCESS)
+    return resp;
 
+  *wellWrtnBlcks = (uint32_t)buf[0] << 24 | (uint32_t)buf[1] << 16 
+                 | (uint32_t)buf[2] << 8 | buf[3];
   return READ_SUCCESS;
 }
 
@@ -382,266 +382,53 @@ uint16_t sd_GetNumOfWellWrittenBlocks(uint32_t *wellWrtnBlcks)
 
 /* 
  * ----------------------------------------------------------------------------
- *                                  (PRIVATE) GET MEMORY CAPACITY FOR TYPE SDSC 
+ *                                                        (PRIVATE) GET CSD 
  * 
- * Description : This function will get the parameters from an SDSC type SD 
- *               card that are needed to calculate the card's capacity and use
- *               these to calculate and return the card's byte capacity.
+ * Description : Reads and decodes the CSD for the capacity functions.
  * 
- * Arguments   : void
+ * Arguments   : ctv  - ptr to the CTV instance set by sd_InitModeSPI.
+ *               csd  - ptr to the SDCsd instance to be loaded.
  * 
- * Returns     : card capacity in bytes, or FAILED_CAPACITY_CALC
+ * Returns     : 1 if the CSD was read and its version matches the card type,
+ *               else 0. SDHC type cards may have a version 2.0 or 3.0 CSD.
  * ---------------------------------------------------------------------------
  */
-static uint32_t pvt_GetByteCapacitySDSC(void)
+static uint8_t pvt_GetCSD(const CTV *ctv, SDCsd *csd)
 {
-  // CSD fields used to calculate memory capacity
-  uint8_t  readBlkLen = 0;
-  uint16_t cSize = 0;
-  uint8_t  cSizeMult = 0;
+  uint8_t reg[CSD_LEN];
 
-  //
-  // SEND_CSD (CMD9) to get the CSD register contents. The CSD register
-  // contains the necessary parameters required to calculate the card's cap.
-  //
-  CS_ASSERT;
-  sd_SendCommand(SEND_CSD, 0);
-  if (sd_GetR1() != OUT_OF_IDLE) 
-  { 
-    CS_DEASSERT; 
-    return FAILED_CAPACITY_CALC; 
-  }
+  if (sd_ReadCSD(reg) != READ_SUCCESS)
+    return 0;
+  sd_DecodeCSD(reg, csd);
 
-  //
-  // CSD_STRUCTURE
-  //
-  for (uint16_t attempts = 0; 
-       GET_CSD_VSN(sd_ReceiveByteSPI()) != CSD_VSN_SDSC;)
-    if (++attempts >= MAX_ATTEMPTS)
-    { 
-      CS_DEASSERT;
-      return FAILED_CAPACITY_CALC; 
-    }
-
-  //
-  // TAAC
-  //
-  for (uint16_t attempts = 0; !TAAC_CHK_SDSC(sd_ReceiveByteSPI());)
-    if (++attempts >= MAX_ATTEMPTS)
-    { 
-      CS_DEASSERT;
-      return FAILED_CAPACITY_CALC; 
-    }
-
-  //
-  // NSAC - Any value is valid for SDSC
-  //
-  sd_ReceiveByteSPI();
-
-  //
-  // TRAN_SPEED - this tests for default value.
-  //
-  for (uint16_t attempts = 0; sd_ReceiveByteSPI() != TRANS_SPEED_SDSC;)
-    if (++attempts >= MAX_ATTEMPTS)
-    { 
-      CS_DEASSERT;
-      return FAILED_CAPACITY_CALC; 
-    }
-
-  //
-  // CCC and READ_BL_LEN
-  //
-
-  // Next 2 bytes contain the 12-bit CCC and 4-bit READ_BL_LEN.
-  for (uint16_t attempts = 0;; ++attempts)
-  {
-    if (CCC_HI_BYTE_CHK_SDSC(sd_ReceiveByteSPI()))
-    {
-      // value required for capacity calculation
-      readBlkLen = sd_ReceiveByteSPI() & RBL_MASK_SDSC;
-      if (readBlkLen >= RBL_LO_SDSC || readBlkLen <= RBL_HI_SDSC)
-        break;
-      else
-      {
-        CS_DEASSERT;
-        return FAILED_CAPACITY_CALC;
-      }
-    }
-    if (attempts >= MAX_ATTEMPTS)
-    { 
-      CS_DEASSERT;
-      return FAILED_CAPACITY_CALC;
-    }
-  }
-
-  //
-  // C_SIZE and C_SIZE_MULT are remaining fields needed to calculate capacity
-  // 
-  for (uint16_t attempts = 0;; ++attempts)
-  {
-    // get byte containing 2 highest bits of cSize
-    cSize = sd_ReceiveByteSPI() & C_SIZE_HI_MASK_SDSC; 
-    if (cSize == C_SIZE_HI_MASK_SDSC)
-    {                   
-      // position and load rest of cSize bits
-      cSize <<= 8;           
-      cSize |= sd_ReceiveByteSPI();
-      cSize <<= 2;        
-      cSize |= sd_ReceiveByteSPI() >> 6;
-      
-      // postion and load cSizeMult bits
-      cSizeMult  = (sd_ReceiveByteSPI() & C_SIZE_MULT_HI_MASK_SDSC) << 1;
-      cSizeMult |= sd_ReceiveByteSPI() >> 7;
-
-    }
-    if (attempts >= MAX_ATTEMPTS) 
-    {
-      CS_DEASSERT; 
-      return FAILED_CAPACITY_CALC; 
-    }
-  }
-  CS_DEASSERT;
-
-  //
-  // Calculate Memory Capacity
-  //
-
-  // blockLen = 2^READ_BL_LEN
-  uint16_t blockLen = 1;                             
-  for (uint8_t pow = 0; pow < readBlkLen; ++pow) 
-    blockLen *= 2;
-
-  // mult = 2^(cSizeMult + 2)
-  uint16_t mult = 1;
-  for (uint8_t pow = 0; pow < cSizeMult + 2; ++pow) 
-    mult *= 2;
-
-  // Memory capacity in bytes. See SD card standard for calc formula.
-  return ((cSize + 1) * mult * blockLen);
+  if (ctv->type == SDHC)
+    return csd->csdStructure == CSD_VSN_SDHC 
+        || csd->csdStructure == CSD_VSN_SDUC;
+  return ctv->type == SDSC && csd->csdStructure == CSD_VSN_SDSC;
 }
 
 /* 
  * ----------------------------------------------------------------------------
- *                                  (PRIVATE) GET MEMORY CAPACITY FOR TYPE SDHC 
+ *                                              (PRIVATE) PRINT BLOCK HANDLER 
  * 
- * Description : This function will get the parameters from an SDHC type SD 
- *               card that are needed to calculate the card's capacity and use
- *               these to calculate and return the card's byte capacity.
+ * Description : SDBlockHandler used by sd_PrintMultipleBlocks. Prints the
+ *               block number followed by the block's contents.
  * 
- * Arguments   : void
+ * Arguments   : blckIdx  - index of the block in the stream.
+ *               blckArr  - the block's data.
+ *               ctx      - ptr to the start block address of the stream.
  * 
- * Returns     : card capacity in bytes, or FAILED_CAPACITY_CALC
+ * Returns     : 0, so that the stream continues.
  * ---------------------------------------------------------------------------
  */
-static uint32_t pvt_GetByteCapacitySDHC(void)
+static uint8_t pvt_PrintBlockHandler(uint32_t blckIdx, const uint8_t blckArr[],
+                                     void *ctx)
 {
-  // Only C_SIZE is needed to calculate the memory capacity of SDHC types
-  uint64_t cSize;
+  // print the block number for the current block.
+  print_Str("\n\n\r                                    BLOCK ");
+  print_Dec(*(const uint32_t *)ctx + blckIdx);
 
-  //
-  // SEND_CSD (CMD9) - Request SD card send contents of CSD register
-  //
-  CS_ASSERT;
-  sd_SendCommand(SEND_CSD, 0);              // arg = 0 for this command
-  if (sd_GetR1() != OUT_OF_IDLE)
-  {
-    CS_DEASSERT;
-    return FAILED_CAPACITY_CALC;
-  }
-  
-  //
-  // The CSD register fields accessed first, before C_SIZE, are used here to
-  // verfiy CSD is accurately being read-in, and the correct memory capacity
-  // function has been called.
-  //
-
-  //
-  // CSD_STRUCTURE - Must be 1 for SDHC/SDXC types.
-  //
-  for (uint16_t attempts = 0; 
-       GET_CSD_VSN(sd_ReceiveByteSPI()) != CSD_VSN_SDHC;)
-    if (++attempts >= MAX_ATTEMPTS)
-    { 
-      CS_DEASSERT;
-      return FAILED_CAPACITY_CALC;
-    }
-
-  //
-  // TAAC - fixed at 1ms (0x0E) for SDHC
-  //
-  for (uint16_t attempts = 0; sd_ReceiveByteSPI() != TAAC_SDHC;)
-    if (++attempts >= MAX_ATTEMPTS)
-    { 
-      CS_DEASSERT;
-      return FAILED_CAPACITY_CALC;
-    }
-
-  //
-  // NSAC - not used for SDHC, but field is still there.
-  //
-  for (uint16_t attempts = 0; sd_ReceiveByteSPI() != NSAC_SDHC;)
-    if (++attempts >= MAX_ATTEMPTS)
-    { 
-      CS_DEASSERT;
-      return FAILED_CAPACITY_CALC;
-    }
-
-  //
-  // TRAN_SPEED
-  //
-  for (uint16_t attempts = 0; sd_ReceiveByteSPI() != TRANS_SPEED_SDHC;)
-    if (++attempts >= MAX_ATTEMPTS)
-    { 
-      CS_DEASSERT;
-      return FAILED_CAPACITY_CALC; 
-    }
-
-  //
-  // CCC and READ_BL_LEN
-  //
-
-  // Next 2 bytes contain the 12-bit CCC and 4-bit READ_BL_LEN.
-  for (uint16_t attempts = 0;; ++attempts)
-  {
-    if (CCC_HI_BYTE_CHK_SDHC(sd_ReceiveByteSPI()))
-    {
-      if (sd_ReceiveByteSPI() != CCC_LO_BITS_MASK_SDHC + RBL_SDHC)
-      {
-        CS_DEASSERT; 
-        return FAILED_CAPACITY_CALC;
-      }
-      break;
-    }
-    if (attempts >= MAX_ATTEMPTS)
-    { 
-      CS_DEASSERT;
-      return FAILED_CAPACITY_CALC;
-    }
-  }
-
-  //
-  // C_SIZE is the remaining field needed to calculate capacity
-  // 
-  for (uint16_t attempts = 0;; ++attempts)
-  {
-    // Remaining bits before reaching C_SIZE
-    if (CSD_BYTE_7_CHK_SDHC(sd_ReceiveByteSPI()))
-    {
-      cSize = sd_ReceiveByteSPI() & C_SIZE_HI_MASK_SDHC;// Only [5:0] is C_SIZE
-      cSize <<= 8;           
-      cSize |= sd_ReceiveByteSPI();
-      cSize <<= 8;        
-      cSize |= sd_ReceiveByteSPI();
-      break;
-    }
-    if (attempts >= MAX_ATTEMPTS) 
-    { 
-      CS_DEASSERT; 
-      return FAILED_CAPACITY_CALC; 
-    }
-  }
-  CS_DEASSERT;
-
-  // see std for calculation description. (cSize + 1) + 512kB
-  return ((cSize + 1) * 512000);
-}    
+  // print the block to the screen.
+  sd_PrintSingleBlock(blckArr);
+  return 0;
+}
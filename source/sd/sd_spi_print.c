@@ -115,6 +115,12 @@ void sd_PrintReadError(uint8_t err)
     case START_TOKEN_TIMEOUT:
       print_Str("\n\r START_TOKEN_TIMEOUT");
       break;
+    case STOP_TRANSMISSION_ERROR:
+      print_Str("\n\r STOP_TRANSMISSION_ERROR");
+      break;
+    case READ_CRC_ERROR:
+      print_Str("\n\r READ_CRC_ERROR");
+      break;
     default:
       print_Str("\n\r UNKNOWN RESPONSE");
   }
@@ -270,4 +276,47 @@ void sd_PrintSingleBlock(const uint8_t blckArr[])
         print_Str(".");
     }
   }    
-}
\ No newline at end of file
+}
+
+#if SD_STATS
+/*
+ * ----------------------------------------------------------------------------
+ *                                                 PRINT INSTRUMENTATION COUNTERS
+ * 
+ * Description : Prints the SPI instrumentation counters (see SD_SPI_STATS.H)
+ *               of every instrumented function, one function per row.
+ * 
+ * Note        : Only available when SD_STATS is set to 1.
+ * ----------------------------------------------------------------------------
+ */
+void sd_PrintStats(void)
+{
+  char *opNames[SD_STATS_NUM_OPS] = { "sd_InitModeSPI        ",
+                                      "sd_SendCommand        ",
+                                      "sd_ReadSingleBlock    ",
+                                      "sd_WriteSingleBlock   ",
+                                      "sd_EraseBlocks        ",
+                                      "sd_ReadMultipleBlocks ",
+                                      "sd_WriteMultipleBlocks",
+                                      "sd_ScanBlocks         " };
+  SDStats st;
+
+  print_Str("\n\r FUNCTION\t\tCALLS\tSENT\tDUMMY\tPOLLS\tTICKS");
+  for (uint8_t op = 0; op < SD_STATS_NUM_OPS; ++op)
+  {
+    sd_StatsGet(op, &st);
+    print_Str("\n\r ");
+    print_Str(opNames[op]);
+    print_Str("\t");
+    print_Dec(st.calls);
+    print_Str("\t");
+    print_Dec(st.bytesSent);
+    print_Str("\t");
+    print_Dec(st.dmyBytes);
+    print_Str("\t");
+    print_Dec(st.pollIters);
+    print_Str("\t");
+    print_Dec(st.ticks);
+  }
+}
+#endif
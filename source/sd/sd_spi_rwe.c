@@ -9,9 +9,27 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
 #include "sd_spi_base.h"
 #include "sd_spi_rwe.h"
 
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+static uint8_t  pvt_StopTransmission(void);    // CMD12 and wait on busy
+static uint16_t pvt_OpenWriteMultiple(uint32_t startBlckAddr, 
+                                      uint32_t numOfBlcks);
+static uint16_t pvt_SendWriteBlock(const uint8_t blckData[]);
+static uint8_t  pvt_WaitWriteBusy(void);
+static void     pvt_SendBlockCRC(const uint8_t blckArr[]);
+static uint8_t  pvt_ReceiveBlockCRC(const uint8_t blckArr[]);
+static uint16_t pvt_ScanBlocks(uint32_t startBlckAddr, uint32_t numOfBlcks,
+                               uint8_t erasedByte, uint8_t bitmap[],
+                               uint32_t *firstUsed);
+
 /*
  ******************************************************************************
  *                                 FUNCTIONS   
@@ -39,6 +57,9 @@
 uint16_t sd_ReadSingleBlock(uint32_t blckAddr, uint8_t blckArr[])
 {
   uint8_t r1;                               // for R1 response
+  SDTimer tmr;
+
+  SD_STATS_BEGIN(SD_STATS_OP_READ);
 
   // request contents of a single block on SD card at blckAddr.
   CS_ASSERT;
@@ -47,33 +68,204 @@ uint16_t sd_ReadSingleBlock(uint32_t blckAddr, uint8_t blckArr[])
   if (r1 != OUT_OF_IDLE)
   {
     CS_DEASSERT;
-    return (R1_ERROR | r1);
+    return SD_STATS_END(SD_STATS_OP_READ, R1_ERROR | r1);
   }
 
   //
   // loop until the Start Block Token is received from the SD card,
   // indicating data from requested blckAddr is about to be sent.
   //
-  for (uint8_t attempt = 0; sd_ReceiveByteSPI() != START_BLOCK_TKN; ++attempt)
-    if (attempt >= MAX_ATTEMPTS)
+  sd_TimerStart(&tmr, sd_Timeouts.readMs);
+  while (sd_ReceiveByteSPI() != START_BLOCK_TKN)
+  {
+    SD_STATS_POLL();
+    if (sd_TimerExpired(&tmr))
     {
       CS_DEASSERT;
-      return (START_TOKEN_TIMEOUT);
+      return SD_STATS_END(SD_STATS_OP_READ, START_TOKEN_TIMEOUT);
     }
+  }
 
   // Load SD card block into array.         
-  for (uint16_t byte = 0; byte < BLOCK_LEN; ++byte)
-    blckArr[byte] = sd_ReceiveByteSPI();
+  sd_ReceiveBlockSPI(blckArr, BLOCK_LEN);
 
-  // Get 16-bit CRC. Don't need.
-  sd_ReceiveByteSPI();
-  sd_ReceiveByteSPI();
+  // Get 16-bit CRC. Only checked if SD_CRC_CHECK is set.
+  uint8_t crcOk = pvt_ReceiveBlockCRC(blckArr);
   
   // clear any remaining data from the SPDR
   sd_ReceiveByteSPI();          
 
   CS_DEASSERT;
-  return (READ_SUCCESS);
+  return SD_STATS_END(SD_STATS_OP_READ, crcOk ? READ_SUCCESS : READ_CRC_ERROR);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                          READ MULTIPLE BLOCKS
+ * 
+ * Description : Streams numOfBlcks consecutive data blocks from the SD card, 
+ *               beginning at startBlckAddr, using READ_MULTIPLE_BLOCK (CMD18).
+ *               STOP_TRANSMISSION (CMD12) is sent once the last block has been
+ *               received, or when blckHndlr requests the stream be stopped.
+ * 
+ * Arguments   : startBlckAddr  - address of the first block to be read.
+ *               numOfBlcks     - number of blocks to read.
+ *               blckArr        - if blckHndlr is NULL, the array the blocks
+ *                                are loaded into, one after the other. It must
+ *                                be of length numOfBlcks * BLOCK_LEN. If
+ *                                blckHndlr is not NULL, each block is loaded 
+ *                                into this array before blckHndlr is called
+ *                                and it need only be of length BLOCK_LEN.
+ *               blckHndlr      - function called with each block, or NULL.
+ *                                See SDBlockHandler.
+ *               ctx            - passed through to blckHndlr.
+ * 
+ * Returns     : If an R1 error occurs when sending the READ command the 
+ *               returned response is the R1 error and the R1_ERROR flag is 
+ *               set to indicate this. If no R1 error occurs, the function 
+ *               returns one of the READ BLOCK ERROR flags.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_ReadMultipleBlocks(uint32_t startBlckAddr, uint32_t numOfBlcks, 
+                               uint8_t blckArr[], SDBlockHandler blckHndlr,
+                               void *ctx)
+{
+  uint8_t r1;                               // for R1 response
+  uint8_t stop = 0;                         // set by blckHndlr to stop
+  SDTimer tmr;
+
+  SD_STATS_BEGIN(SD_STATS_OP_READ_MULT);
+
+  if (!numOfBlcks)
+    return SD_STATS_END(SD_STATS_OP_READ_MULT, READ_SUCCESS);
+
+  // request the card stream the blocks beginning at startBlckAddr.
+  CS_ASSERT;
+  sd_SendCommand(READ_MULTIPLE_BLOCK, startBlckAddr);
+  r1 = sd_GetR1();
+  if (r1 != OUT_OF_IDLE)
+  {
+    CS_DEASSERT;
+    return SD_STATS_END(SD_STATS_OP_READ_MULT, R1_ERROR | r1);
+  }
+
+  for (uint32_t blckIdx = 0; blckIdx < numOfBlcks && !stop; ++blckIdx)
+  {
+    // each block is preceded by its own Start Block Token.
+    sd_TimerStart(&tmr, sd_Timeouts.readMs);
+    while (sd_ReceiveByteSPI() != START_BLOCK_TKN)
+    {
+      SD_STATS_POLL();
+      if (sd_TimerExpired(&tmr))
+      {
+        pvt_StopTransmission();
+        CS_DEASSERT;
+        return SD_STATS_END(SD_STATS_OP_READ_MULT, START_TOKEN_TIMEOUT);
+      }
+    }
+
+    // load the block into the array, or into its slot of the array.
+    if (blckHndlr)
+      sd_ReceiveBlockSPI(blckArr, BLOCK_LEN);
+    else
+      sd_ReceiveBlockSPI(blckArr + blckIdx * BLOCK_LEN, BLOCK_LEN);
+
+    // Get 16-bit CRC. Only checked if SD_CRC_CHECK is set.
+    if (!pvt_ReceiveBlockCRC(blckHndlr ? blckArr 
+                                       : blckArr + blckIdx * BLOCK_LEN))
+    {
+      pvt_StopTransmission();
+      CS_DEASSERT;
+      return SD_STATS_END(SD_STATS_OP_READ_MULT, READ_CRC_ERROR);
+    }
+
+    if (blckHndlr)
+      stop = blckHndlr(blckIdx, blckArr, ctx);
+  }
+
+  // stop the card sending data blocks.
+  if (pvt_StopTransmission() != OUT_OF_IDLE)
+  {
+    CS_DEASSERT;
+    return SD_STATS_END(SD_STATS_OP_READ_MULT, STOP_TRANSMISSION_ERROR);
+  }
+
+  CS_DEASSERT;
+  return SD_STATS_END(SD_STATS_OP_READ_MULT, READ_SUCCESS);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                  SCAN BLOCKS
+ * 
+ * Description : Finds which of numOfBlcks consecutive blocks, beginning at 
+ *               startBlckAddr, hold data. The blocks are streamed with 
+ *               READ_MULTIPLE_BLOCK (CMD18) and each byte is compared with
+ *               erasedByte as it is received. A block is in use once a byte
+ *               differs, so the rest of it is not needed. The stream is then
+ *               stopped with STOP_TRANSMISSION (CMD12) part way through the
+ *               block, CS is deasserted, and the stream is restarted at the
+ *               next block. See SCAN_FINISH_LEN.
+ * 
+ * Arguments   : startBlckAddr  - address of the first block to scan.
+ *               numOfBlcks     - number of blocks to scan.
+ *               erasedByte     - byte value of erased data, 0x00 or 0xFF. See
+ *                                sd_GetErasedByte (SD_SPI_MISC).
+ *               bitmap         - bit i (bit i % 8 of bitmap[i / 8]) is set if
+ *                                block i of the scan is in use, and cleared 
+ *                                if it is erased. Must be of length 
+ *                                (numOfBlcks + 7) / 8.
+ * 
+ * Returns     : If an R1 error occurs when sending the READ command the 
+ *               returned response is the R1 error and the R1_ERROR flag is 
+ *               set to indicate this. If no R1 error occurs, the function 
+ *               returns one of the READ BLOCK ERROR flags.
+ * 
+ * Notes       : 1) Blocks whose bytes all equal erasedByte are taken to be
+ *                  erased, even if they were written.
+ *               2) The CRC of the blocks is not checked.
+ *               3) Bits of bitmap past the last block are not changed. If an
+ *                  error is returned, neither are the bits of the blocks from
+ *                  the one that failed.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_ScanBlocks(uint32_t startBlckAddr, uint32_t numOfBlcks,
+                       uint8_t erasedByte, uint8_t bitmap[])
+{
+  uint16_t resp;
+
+  SD_STATS_BEGIN(SD_STATS_OP_SCAN);
+  resp = pvt_ScanBlocks(startBlckAddr, numOfBlcks, erasedByte, bitmap, NULL);
+  return SD_STATS_END(SD_STATS_OP_SCAN, resp);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                              FIND DATA BLOCK
+ * 
+ * Description : Finds the first block in use of numOfBlcks consecutive 
+ *               blocks, beginning at startBlckAddr. The blocks are scanned as
+ *               by sd_ScanBlocks, and the stream is stopped at the first byte
+ *               that is not erased.
+ * 
+ * Arguments   : startBlckAddr  - address of the first block to scan.
+ *               numOfBlcks     - number of blocks to scan.
+ *               erasedByte     - byte value of erased data, 0x00 or 0xFF.
+ *               blckIdx        - ptr loaded with the index in the scan of the
+ *                                first block in use, or with numOfBlcks if 
+ *                                every block is erased.
+ * 
+ * Returns     : As sd_ScanBlocks.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_FindDataBlock(uint32_t startBlckAddr, uint32_t numOfBlcks,
+                          uint8_t erasedByte, uint32_t *blckIdx)
+{
+  uint16_t resp;
+
+  SD_STATS_BEGIN(SD_STATS_OP_SCAN);
+  resp = pvt_ScanBlocks(startBlckAddr, numOfBlcks, erasedByte, NULL, blckIdx);
+  return SD_STATS_END(SD_STATS_OP_SCAN, resp);
 }
 
 /*
@@ -92,6 +284,9 @@ uint16_t sd_ReadSingleBlock(uint32_t blckAddr, uint8_t blckArr[])
  *               returned response is the R1 error and the R1_ERROR 
  *               flag is set to indicate this. If no R1 error occurs, the 
  *               function returns one of the WRITE BLOCK ERROR flags.   
+ * 
+ * Notes       : Returns once the card accepts the data. The card may still be
+ *               programming the block. See sd_IsBusy.
  * ----------------------------------------------------------------------------
  */
 uint16_t sd_WriteSingleBlock(uint32_t blckAddr, const uint8_t dataArr[])
@@ -99,25 +294,23 @@ uint16_t sd_WriteSingleBlock(uint32_t blckAddr, const uint8_t dataArr[])
   uint8_t r1;                               // for R1 response
   uint8_t dataRespTkn = 0;
 
+  SD_STATS_BEGIN(SD_STATS_OP_WRITE);
+
   // send Write Single Block command to write data to blckAddr on SD card.
   CS_ASSERT;    
   sd_SendCommand(WRITE_BLOCK, blckAddr);
   if ((r1 = sd_GetR1()) != OUT_OF_IDLE)
   {
     CS_DEASSERT;
-    return (R1_ERROR | r1);
+    return SD_STATS_END(SD_STATS_OP_WRITE, R1_ERROR | r1);
   }
 
   // send Start Block Token (0xFE) to initiate data transfer
   sd_SendByteSPI(START_BLOCK_TKN); 
 
-  // send data to write to SD card.
-  for (uint16_t pos = 0; pos < BLOCK_LEN; ++pos) 
-    sd_SendByteSPI(dataArr[pos]);
-
-  // Send 16-bit CRC. CRC should be off (default), so these do not matter.
-  sd_SendByteSPI(DMY_TKN);
-  sd_SendByteSPI(DMY_TKN);
+  // send data to write to SD card, followed by its 16-bit CRC.
+  sd_SendBlockSPI(dataArr, BLOCK_LEN);
+  pvt_SendBlockCRC(dataArr);
   
   //
   // loop until valid data response token received or function exits on 
@@ -128,44 +321,194 @@ uint16_t sd_WriteSingleBlock(uint32_t blckAddr, const uint8_t dataArr[])
        && dataRespTkn != CRC_ERROR_TKN 
        && dataRespTkn != WRITE_ERROR_TKN;)
   {
+    SD_STATS_POLL();
     dataRespTkn = sd_ReceiveByteSPI() & DATA_RESPONSE_TKN_MASK;
     if (++attempts > MAX_ATTEMPTS)
     {
       CS_DEASSERT;
-      return (DATA_RESPONSE_TIMEOUT);
+      return SD_STATS_END(SD_STATS_OP_WRITE, DATA_RESPONSE_TIMEOUT);
     }
   }
   
   //
   // if SD card signals the data was accepted by returning the Data Accepted
   // Token then the card will enter 'busy' state while it writes the data to 
-  // the block. While busy, the card will hold the DO line at 0. If the max
-  // attempt limit is reached then the function will return CARD_BUSY_TIMEOUT.
+  // the block. Return without waiting. The card keeps programming with CS
+  // deasserted and the next command waits for it (see sd_IsBusy).
   //
   if (dataRespTkn == DATA_ACCEPTED_TKN)
   { 
-    for (uint16_t attempts = 0; sd_ReceiveByteSPI() == 0; ++attempts)
-      if (attempts > 4 * MAX_ATTEMPTS)      // increased attempts limit
-      {
-        CS_DEASSERT;
-        return (CARD_BUSY_TIMEOUT);
-      }
-
+    sd_CardBusy = sd_Timeouts.writeMs;
     CS_DEASSERT;
-    return (WRITE_SUCCESS);
+    return SD_STATS_END(SD_STATS_OP_WRITE, WRITE_SUCCESS);
   }
   else if (dataRespTkn == CRC_ERROR_TKN) 
   {
     CS_DEASSERT;
-    return (CRC_ERROR_TKN_RECEIVED);
+    return SD_STATS_END(SD_STATS_OP_WRITE, CRC_ERROR_TKN_RECEIVED);
   }
   else if (dataRespTkn == WRITE_ERROR_TKN)
   {
   CS_DEASSERT;
-  return (WRITE_ERROR_TKN_RECEIVED);
+  return SD_STATS_END(SD_STATS_OP_WRITE, WRITE_ERROR_TKN_RECEIVED);
   }
 
-  return (INVALID_DATA_RESPONSE) ;
+  return SD_STATS_END(SD_STATS_OP_WRITE, INVALID_DATA_RESPONSE);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        WRITE MULTIPLE BLOCKS
+ * 
+ * Description : Streams data to numOfBlcks consecutive blocks on the SD card,
+ *               beginning at startBlckAddr, using WRITE_MULTIPLE_BLOCK (CMD25).
+ *               SET_WR_BLK_ERASE_COUNT (ACMD23) is sent first with numOfBlcks
+ *               so the card can pre-erase the blocks to be written.
+ * 
+ * Arguments   : startBlckAddr  - address of the first block to be written.
+ *               numOfBlcks     - number of blocks to write.
+ *               dataArr        - if blckSrc is NULL, the data to be written, 
+ *                                one block after the other. Must be of length
+ *                                numOfBlcks * BLOCK_LEN. Not used otherwise.
+ *               blckSrc        - function called for the data of each block, 
+ *                                or NULL. See SDBlockSource.
+ *               ctx            - passed through to blckSrc.
+ * 
+ * Returns     : If an R1 error occurs when sending ACMD23 or the WRITE command, 
+ *               the returned response is the R1 error and the R1_ERROR flag is
+ *               set to indicate this. If no R1 error occurs, the function 
+ *               returns one of the WRITE BLOCK ERROR flags.
+ * 
+ * Notes       : 1) If WRITE_ERROR_TKN_RECEIVED is returned, the number of 
+ *                  blocks written can be found with 
+ *                  sd_GetNumOfWellWrittenBlocks.
+ *               2) Returns once the Stop Transmission Token is sent. The card
+ *                  may still be programming the last block. See sd_IsBusy.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_WriteMultipleBlocks(uint32_t startBlckAddr, uint32_t numOfBlcks, 
+                                const uint8_t dataArr[], SDBlockSource blckSrc,
+                                void *ctx)
+{
+  uint16_t retTkn = WRITE_SUCCESS;          // initialize return value
+  const uint8_t *blckData;                  // data of the current block
+
+  SD_STATS_BEGIN(SD_STATS_OP_WRITE_MULT);
+
+  if (!numOfBlcks)
+    return SD_STATS_END(SD_STATS_OP_WRITE_MULT, WRITE_SUCCESS);
+
+  retTkn = pvt_OpenWriteMultiple(startBlckAddr, numOfBlcks);
+  if (retTkn != WRITE_SUCCESS)
+    return SD_STATS_END(SD_STATS_OP_WRITE_MULT, retTkn);
+
+  CS_ASSERT;
+  for (uint32_t blckIdx = 0; blckIdx < numOfBlcks; ++blckIdx)
+  {
+    // get the data for this block, or its slot in dataArr.
+    if (blckSrc)
+    {
+      if (!(blckData = blckSrc(blckIdx, ctx)))
+        break;
+    }
+    else
+      blckData = dataArr + blckIdx * BLOCK_LEN;
+
+    //
+    // if the data was accepted the card is busy, holding DO at 0, while it 
+    // writes the block. On CRC or write error, stop sending blocks.
+    //
+    retTkn = pvt_SendWriteBlock(blckData);
+    if (retTkn == DATA_RESPONSE_TIMEOUT)
+    {
+      CS_DEASSERT;
+      return SD_STATS_END(SD_STATS_OP_WRITE_MULT, retTkn);
+    }
+    if (retTkn != WRITE_SUCCESS)
+      break;
+    if (!pvt_WaitWriteBusy())
+    {
+      CS_DEASSERT;
+      return SD_STATS_END(SD_STATS_OP_WRITE_MULT, CARD_BUSY_TIMEOUT);
+    }
+  }
+
+  //
+  // Stop Transmission Token. The card goes busy one byte after the token
+  // while it finishes programming. As with sd_WriteSingleBlock, return 
+  // without waiting and let the next command wait for the card.
+  //
+  sd_SendByteSPI(STOP_TRANSMIT_TKN_MBW);
+  sd_ReceiveByteSPI();
+  sd_CardBusy = sd_Timeouts.writeMs;
+  CS_DEASSERT;
+
+  return SD_STATS_END(SD_STATS_OP_WRITE_MULT, retTkn);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           WRITE BLOCK STREAM
+ * 
+ * Description : A multi-block write (WRITE_MULTIPLE_BLOCK) that is run one 
+ *               block per call, with CS deasserted between calls. The card 
+ *               programs each block while CS is deasserted, so the bus can be
+ *               used for another card in the meantime. sd_WriteStreamOpen 
+ *               sends ACMD23 and CMD25, sd_WriteStreamBlock sends the next
+ *               block, and sd_WriteStreamClose sends the Stop Transmission 
+ *               Token.
+ * 
+ * Arguments   : startBlckAddr  - address of the first block to be written.
+ *               numOfBlcks     - number of blocks that will be written.
+ *               blckData       - data of the block. Length BLOCK_LEN.
+ * 
+ * Returns     : sd_WriteStreamOpen returns as sd_WriteMultipleBlocks if an R1
+ *               error occurs, else WRITE_SUCCESS. sd_WriteStreamBlock and 
+ *               sd_WriteStreamClose return one of the WRITE BLOCK ERROR 
+ *               flags. CARD_BUSY_TIMEOUT is returned if the card is still 
+ *               programming the last block after the write timeout.
+ * 
+ * Notes       : 1) No other command may be sent to the card while its stream
+ *                  is open. The stream must be closed after an error.
+ *               2) The functions return without waiting for the card to 
+ *                  program the block. See sd_IsBusy.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_WriteStreamOpen(uint32_t startBlckAddr, uint32_t numOfBlcks)
+{
+  return pvt_OpenWriteMultiple(startBlckAddr, numOfBlcks);
+}
+
+uint16_t sd_WriteStreamBlock(const uint8_t blckData[])
+{
+  uint16_t retTkn;
+
+  CS_ASSERT;
+  if (!pvt_WaitWriteBusy())
+  {
+    CS_DEASSERT;
+    return CARD_BUSY_TIMEOUT;
+  }
+  retTkn = pvt_SendWriteBlock(blckData);
+  if (retTkn == WRITE_SUCCESS)
+    sd_CardBusy = sd_Timeouts.writeMs;
+  CS_DEASSERT;
+  return retTkn;
+}
+
+uint16_t sd_WriteStreamClose(void)
+{
+  CS_ASSERT;
+  if (!pvt_WaitWriteBusy())
+  {
+    CS_DEASSERT;
+    return CARD_BUSY_TIMEOUT;
+  }
+  sd_SendByteSPI(STOP_TRANSMIT_TKN_MBW);
+  sd_ReceiveByteSPI();
+  sd_CardBusy = sd_Timeouts.writeMs;
+  CS_DEASSERT;
+  return WRITE_SUCCESS;
 }
 
 /*
@@ -182,19 +525,25 @@ uint16_t sd_WriteSingleBlock(uint32_t blckAddr, const uint8_t dataArr[])
  *               response other OUT_OF_IDLE is returned by the SD card when
  *               issuing one of the in this function, then the R1_ERROR flag is
  *               also set and the lower byte will contain this R1 response.
+ * 
+ * Notes       : Returns once the card accepts the ERASE command. The card may
+ *               still be erasing. See sd_IsBusy.
  * ----------------------------------------------------------------------------
  */
 uint16_t sd_EraseBlocks(uint32_t startBlckAddr, uint32_t endBlckAddr)
 {
   uint8_t r1;                               // for R1 responses
   
+  SD_STATS_BEGIN(SD_STATS_OP_ERASE);
+
   // set Start Address for erase block
   CS_ASSERT;
   sd_SendCommand(ERASE_WR_BLK_START_ADDR, startBlckAddr);
   r1 = sd_GetR1();
   CS_DEASSERT;
   if (r1 != OUT_OF_IDLE) 
-    return (SET_ERASE_START_ADDR_ERROR | R1_ERROR | r1);
+    return SD_STATS_END(SD_STATS_OP_ERASE, 
+                        SET_ERASE_START_ADDR_ERROR | R1_ERROR | r1);
   
   // set End Address for erase block
   CS_ASSERT;
@@ -202,23 +551,391 @@ uint16_t sd_EraseBlocks(uint32_t startBlckAddr, uint32_t endBlckAddr)
   r1 = sd_GetR1();
   CS_DEASSERT;
   if (r1 != OUT_OF_IDLE) 
-    return (SET_ERASE_END_ADDR_ERROR | R1_ERROR | r1);
+    return SD_STATS_END(SD_STATS_OP_ERASE, 
+                        SET_ERASE_END_ADDR_ERROR | R1_ERROR | r1);
 
   // erase all blocks between, and including, start and end address
   CS_ASSERT;
-  sd_SendCommand(ERASE, 0);                 // arg = 0 for this command      
+  sd_SendFixedCommand(FRAME_ERASE);
   r1 = sd_GetR1 ();
   if (r1 != OUT_OF_IDLE)
   {
     CS_DEASSERT;
-    return (ERASE_ERROR | R1_ERROR | r1);
+    return SD_STATS_END(SD_STATS_OP_ERASE, ERASE_ERROR | R1_ERROR | r1);
+  }
+
+  //
+  // Busy (0) signal is returned until the erase completes. Return without 
+  // waiting. The next command waits for the card (see sd_IsBusy).
+  //
+  sd_CardBusy = sd_EraseTimeoutMs(startBlckAddr, endBlckAddr);
+  CS_DEASSERT;
+  return SD_STATS_END(SD_STATS_OP_ERASE, ERASE_SUCCESS);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                  COPY BLOCKS
+ * 
+ * Description : Copies numOfBlcks consecutive blocks beginning at srcBlckAddr
+ *               to the blocks beginning at dstBlckAddr. The blocks are read
+ *               a batch at a time into the batch buffer with 
+ *               READ_MULTIPLE_BLOCK (CMD18), and the batch is then written
+ *               with WRITE_MULTIPLE_BLOCK (CMD25), so each command, access 
+ *               time and pre-erase is shared by the blocks of a batch. If the
+ *               ranges overlap with the destination after the source, the 
+ *               blocks are copied from the end of the range backwards.
+ * 
+ * Arguments   : srcBlckAddr   - address of the first block to be copied.
+ *               dstBlckAddr   - address of the block it is copied to.
+ *               numOfBlcks    - number of blocks to copy.
+ *               batch         - buffer the blocks are read into. 
+ *               batchLen      - length of batch. A batch is batchLen / 
+ *                               BLOCK_LEN blocks, and must be at least 1.
+ * 
+ * Returns     : COPY_SUCCESS, COPY_INVALID_BUFFER, or COPY_READ_ERROR / 
+ *               COPY_WRITE_ERROR with the response of the read / write that
+ *               failed. See COPY BLOCK ERROR FLAGS.
+ * 
+ * Notes       : 1) A card has a single data line, so a read cannot overlap a
+ *                  write. The card programs the last blocks written while the
+ *                  next READ_MULTIPLE_BLOCK waits for it.
+ *               2) On an error, the blocks of the reads and writes before the
+ *                  one that failed have been copied.
+ * ----------------------------------------------------------------------------
+ */
+uint16_t sd_CopyBlocks(uint32_t srcBlckAddr, uint32_t dstBlckAddr,
+                       uint32_t numOfBlcks, uint8_t batch[], 
+                       uint16_t batchLen)
+{
+  uint32_t batchBlcks = batchLen / BLOCK_LEN;
+  uint32_t numDone = 0;
+  uint32_t len;                             // blocks in the batch
+  uint32_t idx;                             // index of the batch's first block
+  uint16_t resp;
+  uint8_t  backward = dstBlckAddr > srcBlckAddr 
+                   && dstBlckAddr < srcBlckAddr + numOfBlcks * sd_BlckAddrStep;
+
+  if (batchBlcks == 0)
+    return COPY_INVALID_BUFFER;
+
+  while (numDone < numOfBlcks)
+  {
+    len = numOfBlcks - numDone;
+    if (len > batchBlcks)
+      len = batchBlcks;
+    idx = backward ? numOfBlcks - numDone - len : numDone;
+
+    // read the batch from the source.
+    resp = sd_ReadMultipleBlocks(srcBlckAddr + idx * sd_BlckAddrStep, len, 
+                                 batch, NULL, NULL);
+    if (resp != READ_SUCCESS)
+      return COPY_READ_ERROR | resp;
+
+    // write it to the destination.
+    if (len == 1)
+      resp = sd_WriteSingleBlock(dstBlckAddr + idx * sd_BlckAddrStep, batch);
+    else
+      resp = sd_WriteMultipleBlocks(dstBlckAddr + idx * sd_BlckAddrStep, len,
+                                    batch, NULL, NULL);
+    if (resp != WRITE_SUCCESS)
+      return COPY_WRITE_ERROR | resp;
+
+    numDone += len;
   }
+  return COPY_SUCCESS;
+}
 
-  // wait for erase to finish. Busy (0) signal returned until erase completes.
-  for (uint16_t attempts = 0; sd_ReceiveByteSPI() == 0; ++attempts)
-    if(attempts++ > 4 * MAX_ATTEMPTS) 
-      return (ERASE_BUSY_TIMEOUT);
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTIONS DEFINITIONS
+ ******************************************************************************
+ */
 
+/*
+ * ----------------------------------------------------------------------------
+ *                                                            STOP TRANSMISSION
+ * 
+ * Description : Sends STOP_TRANSMISSION (CMD12) to end a multi-block read and
+ *               waits for the card to leave the busy state of the R1b response.
+ *               CS must be asserted.
+ * 
+ * Returns     : R1 response to CMD12. R1_TIMEOUT is returned if the R1 is not
+ *               received or the card remains busy.
+ * 
+ * Notes       : The byte received immediately after CMD12 is a stuff byte, 
+ *               which may still hold block data, so it is discarded.
+ * ----------------------------------------------------------------------------
+ */
+static uint8_t pvt_StopTransmission(void)
+{
+  uint8_t r1;
+  SDTimer tmr;
+
+  sd_SendFixedCommand(FRAME_STOP_TRANSMISSION);
+  sd_ReceiveByteSPI();                      // stuff byte
+  r1 = sd_GetR1();
+  
+  // R1b response. Card holds DO low (0) while busy.
+  sd_TimerStart(&tmr, sd_Timeouts.writeMs);
+  while (sd_ReceiveByteSPI() == 0)
+  {
+    SD_STATS_POLL();
+    if (sd_TimerExpired(&tmr))
+      return R1_TIMEOUT;
+  }
+  return r1;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                       OPEN MULTI-BLOCK WRITE
+ * 
+ * Description : Sends SET_WR_BLK_ERASE_COUNT (ACMD23) and WRITE_MULTIPLE_BLOCK
+ *               (CMD25). The card then waits for the first block, so CS is 
+ *               deasserted before returning.
+ * 
+ * Arguments   : startBlckAddr  - address of the first block to be written.
+ *               numOfBlcks     - number of blocks that will be written.
+ * 
+ * Returns     : WRITE_SUCCESS, or R1_ERROR with the R1 response.
+ * ----------------------------------------------------------------------------
+ */
+static uint16_t pvt_OpenWriteMultiple(uint32_t startBlckAddr, 
+                                      uint32_t numOfBlcks)
+{
+  uint8_t r1;
+
+  //
+  // SET_WR_BLK_ERASE_COUNT (ACMD23) tells the card how many blocks will be
+  // written so they may be erased before the data arrives. The card clears
+  // the setting at the end of the write.
+  //
+  CS_ASSERT;
+  sd_SendFixedCommand(FRAME_APP_CMD);
+  if ((r1 = sd_GetR1()) != OUT_OF_IDLE)
+  {
+    CS_DEASSERT;
+    return R1_ERROR | r1;
+  }
+  sd_SendCommand(SET_WR_BLK_ERASE_COUNT, numOfBlcks > MAX_WR_BLK_ERASE_COUNT
+                                         ? MAX_WR_BLK_ERASE_COUNT : numOfBlcks);
+  r1 = sd_GetR1();
   CS_DEASSERT;
-  return ERASE_SUCCESS;
-}
\ No newline at end of file
+  if (r1 != OUT_OF_IDLE)
+    return R1_ERROR | r1;
+
+  //
+  // send request to write to multiple blocks on the SD card beginning at the 
+  // startBlckAddr. If accepted, this will continue until the Stop Transmission
+  // byte token is sent. This is not the STOP_TRANSMISSION SD card command.
+  //
+  CS_ASSERT; 
+  sd_SendCommand(WRITE_MULTIPLE_BLOCK, startBlckAddr);
+  r1 = sd_GetR1();
+  CS_DEASSERT;
+  if (r1 != OUT_OF_IDLE)
+    return R1_ERROR | r1;
+  return WRITE_SUCCESS;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                 SEND MULTI-BLOCK WRITE BLOCK
+ * 
+ * Description : Sends a block of a multi-block write and receives its data
+ *               response token. CS must be asserted, and is left asserted.
+ * 
+ * Arguments   : blckData  - the block's data. Length BLOCK_LEN.
+ * 
+ * Returns     : WRITE_SUCCESS if the data was accepted, else 
+ *               CRC_ERROR_TKN_RECEIVED, WRITE_ERROR_TKN_RECEIVED or 
+ *               DATA_RESPONSE_TIMEOUT.
+ * ----------------------------------------------------------------------------
+ */
+static uint16_t pvt_SendWriteBlock(const uint8_t blckData[])
+{
+  uint8_t dataRespTkn = 0;
+
+  // send the multi-block write Start Block Token to initiate data transfer
+  sd_SendByteSPI(START_BLOCK_TKN_MBW); 
+  sd_SendBlockSPI(blckData, BLOCK_LEN);
+  pvt_SendBlockCRC(blckData);
+
+  //
+  // loop until valid data response token received or function exits on max 
+  // attempts limit reached without receiving valid response.
+  //
+  for (uint8_t attempts = 0; 
+          dataRespTkn != DATA_ACCEPTED_TKN
+       && dataRespTkn != CRC_ERROR_TKN 
+       && dataRespTkn != WRITE_ERROR_TKN;)
+  {
+    SD_STATS_POLL();
+    dataRespTkn = sd_ReceiveByteSPI() & DATA_RESPONSE_TKN_MASK;
+    if (++attempts > MAX_ATTEMPTS)
+      return DATA_RESPONSE_TIMEOUT;
+  }
+
+  if (dataRespTkn == DATA_ACCEPTED_TKN)
+    return WRITE_SUCCESS;
+  if (dataRespTkn == CRC_ERROR_TKN)
+    return CRC_ERROR_TKN_RECEIVED;
+  return WRITE_ERROR_TKN_RECEIVED;
+}
+
+// waits while the card holds DO at 0 programming a block. CS must be 
+// asserted. Returns 1 once the card is ready, or 0 on the write timeout.
+static uint8_t pvt_WaitWriteBusy(void)
+{
+  SDTimer tmr;
+
+  sd_TimerStart(&tmr, sd_Timeouts.writeMs);
+  while (sd_ReceiveByteSPI() == 0)
+  {
+    SD_STATS_POLL();
+    if (sd_TimerExpired(&tmr))
+      return 0;
+  }
+  return 1;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                         SEND DATA BLOCK CRC
+ * 
+ * Description : Sends the 16-bit CRC that follows a data block written to the
+ *               card. If SD_CRC_CHECK is 0 the card ignores the CRC, so dummy
+ *               bytes are sent instead of calculating it.
+ * 
+ * Arguments   : blckArr  - the block's data. Length BLOCK_LEN.
+ * ----------------------------------------------------------------------------
+ */
+static void pvt_SendBlockCRC(const uint8_t blckArr[])
+{
+#if SD_CRC_CHECK
+  uint16_t crc = sd_CRC16(blckArr, BLOCK_LEN);
+
+  sd_SendByteSPI(crc >> 8);
+  sd_SendByteSPI(crc);
+#else
+  (void)blckArr;
+  sd_SendByteSPI(DMY_TKN);
+  sd_SendByteSPI(DMY_TKN);
+#endif
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      RECEIVE DATA BLOCK CRC
+ * 
+ * Description : Receives the 16-bit CRC that follows a data block read from
+ *               the card and, if SD_CRC_CHECK is 1, verifies it.
+ * 
+ * Arguments   : blckArr  - the block's data. Length BLOCK_LEN.
+ * 
+ * Returns     : 1 if the CRC matches or SD_CRC_CHECK is 0, else 0.
+ * ----------------------------------------------------------------------------
+ */
+static uint8_t pvt_ReceiveBlockCRC(const uint8_t blckArr[])
+{
+  uint16_t crc = sd_ReceiveByteSPI();
+
+  crc = crc << 8 | sd_ReceiveByteSPI();
+#if SD_CRC_CHECK
+  return crc == sd_CRC16(blckArr, BLOCK_LEN);
+#else
+  (void)blckArr;
+  (void)crc;
+  return 1;
+#endif
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                        (PRIVATE) SCAN BLOCKS
+ * 
+ * Description : Scans blocks for sd_ScanBlocks and sd_FindDataBlock. If bitmap
+ *               is not NULL, the bit of each block is set or cleared. If it
+ *               is NULL, the scan stops at the first block in use and its
+ *               index is loaded into firstUsed.
+ * ----------------------------------------------------------------------------
+ */
+static uint16_t pvt_ScanBlocks(uint32_t startBlckAddr, uint32_t numOfBlcks,
+                               uint8_t erasedByte, uint8_t bitmap[],
+                               uint32_t *firstUsed)
+{
+  uint8_t  r1;                              // for R1 response
+  uint32_t blckIdx = 0;
+  uint16_t pos;
+  uint8_t  inUse;
+  SDTimer  tmr;
+
+  if (firstUsed)
+    *firstUsed = numOfBlcks;
+
+  while (blckIdx < numOfBlcks)
+  {
+    // (re)start the stream at the next block to be scanned.
+    CS_ASSERT;
+    sd_SendCommand(READ_MULTIPLE_BLOCK, 
+                   startBlckAddr + blckIdx * sd_BlckAddrStep);
+    r1 = sd_GetR1();
+    if (r1 != OUT_OF_IDLE)
+    {
+      CS_DEASSERT;
+      return R1_ERROR | r1;
+    }
+
+    while (blckIdx < numOfBlcks)
+    {
+      sd_TimerStart(&tmr, sd_Timeouts.readMs);
+      while (sd_ReceiveByteSPI() != START_BLOCK_TKN)
+      {
+        SD_STATS_POLL();
+        if (sd_TimerExpired(&tmr))
+        {
+          pvt_StopTransmission();
+          CS_DEASSERT;
+          return START_TOKEN_TIMEOUT;
+        }
+      }
+
+      // test each byte as it is received. Stop at the first in use byte 
+      // unless the end of the block is close and the scan continues.
+      inUse = 0;
+      for (pos = 0; pos < BLOCK_LEN; ++pos)
+        if (sd_ReceiveByteSPI() != erasedByte)
+        {
+          inUse = 1;
+          if (firstUsed || BLOCK_LEN - pos > SCAN_FINISH_LEN)
+            break;
+        }
+
+      if (bitmap && inUse)
+        bitmap[blckIdx / 8] |= 1 << (blckIdx % 8);
+      else if (bitmap)
+        bitmap[blckIdx / 8] &= ~(1 << (blckIdx % 8));
+      else if (inUse)
+      {
+        *firstUsed = blckIdx;
+        numOfBlcks = blckIdx + 1;           // ends the scan at this block
+      }
+      ++blckIdx;
+
+      if (pos < BLOCK_LEN)                  // block abandoned
+        break;
+      sd_ReceiveByteSPI();                  // CRC, not checked
+      sd_ReceiveByteSPI();
+    }
+
+    // stop the stream, part way through a block if it was abandoned.
+    if (pvt_StopTransmission() != OUT_OF_IDLE)
+    {
+      CS_DEASSERT;
+      return STOP_TRANSMISSION_ERROR;
+    }
+    CS_DEASSERT;
+  }
+  return READ_SUCCESS;
+}
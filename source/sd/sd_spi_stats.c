@@ -0,0 +1,145 @@
+/*
+ * File       : SD_SPI_STATS.C
+ * Version    : 1.0
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Implementation of SD_SPI_STATS.H. Only compiled in if SD_STATS is 1.
+ */
+
+#include <stdint.h>
+#include "sd_spi_base.h"
+
+#if SD_STATS
+
+/*
+ ******************************************************************************
+ *                                  VARIABLES
+ ******************************************************************************
+ */
+
+static SDStats  stats[SD_STATS_NUM_OPS];
+static uint16_t lastTick;                   // tick of the last update
+static uint8_t  activeOps;                  // bit n set while op n executes
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+static void pvt_AddTicks(void);
+
+/*
+ ******************************************************************************
+ *                                 FUNCTIONS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                 RESET INSTRUMENTATION COUNTERS
+ *
+ * Description : Clears the counters of every instrumented function and starts
+ *               the tick timer.
+ * ----------------------------------------------------------------------------
+ */
+void sd_StatsReset(void)
+{
+  for (uint8_t op = 0; op < SD_STATS_NUM_OPS; ++op)
+  {
+    stats[op].calls = 0;
+    stats[op].bytesSent = 0;
+    stats[op].dmyBytes = 0;
+    stats[op].pollIters = 0;
+    stats[op].ticks = 0;
+  }
+  activeOps = 0;
+
+#ifndef SD_SIM
+  TCCR1A = 0;                               // normal mode, free-running
+  TCCR1B = SD_TIMER_PRESCALE;
+#endif
+  lastTick = sd_GetTick();
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                   GET INSTRUMENTATION COUNTERS
+ *
+ * Description : Copies the counters recorded for one instrumented function.
+ *
+ * Arguments   : op     - one of the SD_STATS_OP_XXXX indexes.
+ *               stats  - ptr to the SDStats instance to be loaded.
+ * ----------------------------------------------------------------------------
+ */
+void sd_StatsGet(uint8_t op, SDStats *st)
+{
+  if (op < SD_STATS_NUM_OPS)
+    *st = stats[op];
+}
+
+// marks op as executing. Its ticks are counted from here.
+void sd_StatsBegin(uint8_t op)
+{
+  pvt_AddTicks();
+  ++stats[op].calls;
+  activeOps |= 1 << op;
+}
+
+// marks op as finished, after adding its last elapsed ticks.
+void sd_StatsEnd(uint8_t op)
+{
+  pvt_AddTicks();
+  activeOps &= ~(1 << op);
+}
+
+// adds n to the selected counter of every executing op.
+void sd_StatsCount(uint8_t cnt, uint16_t n)
+{
+  pvt_AddTicks();
+  for (uint8_t op = 0; op < SD_STATS_NUM_OPS; ++op)
+  {
+    if (!(activeOps & 1 << op))
+      continue;
+    if (cnt == SD_STATS_CNT_SENT)
+      stats[op].bytesSent += n;
+    else if (cnt == SD_STATS_CNT_DMY)
+      stats[op].dmyBytes += n;
+    else
+      stats[op].pollIters += n;
+  }
+}
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTIONS DEFINITIONS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                           ADD ELAPSED TICKS
+ *
+ * Description : Adds the ticks elapsed since the last update to every 
+ *               executing op. The tick counter is 16 bits, so the elapsed
+ *               ticks are accumulated at every count rather than taken as the
+ *               difference of an op's start and end ticks. An op is then
+ *               timed correctly however long it runs, as long as a byte or
+ *               polling iteration is counted at least every 2^16 ticks, as 
+ *               with SDTimer.
+ * ----------------------------------------------------------------------------
+ */
+static void pvt_AddTicks(void)
+{
+  uint16_t now = sd_GetTick();
+  uint16_t elapsed = now - lastTick;        // 16-bit wrap is handled
+
+  lastTick = now;
+  for (uint8_t op = 0; op < SD_STATS_NUM_OPS; ++op)
+    if (activeOps & 1 << op)
+      stats[op].ticks += elapsed;
+}
+
+#endif //SD_STATS
@@ -0,0 +1,968 @@
+/*
+ * File       : SIM_SD.C
+ * Version    : 1.0
+ * Target     : Host (Linux)
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Description: Implements SIM_SD.H. A byte-level model of an SD card running
+ *              in SPI mode. Every call to sim_sd_Exchange is one byte (8
+ *              clocks) on the bus: the card shifts out the next byte of any
+ *              pending response and shifts in the host's byte, which may
+ *              complete a command frame or a data block.
+ *
+ *              Timing is measured in bytes. NCR is fixed at one byte, the
+ *              read access time (NAC) and the write/erase busy periods are
+ *              set by SimCardConfig.
+ *
+ *              Up to SIM_MAX_CARDS cards share the bus, each with its own CS
+ *              line. Every byte clocked reaches all of them, so a card that is
+ *              not selected still counts down its busy and power up time.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim_sd.h"
+
+/*
+ ******************************************************************************
+ *                                    MACROS
+ ******************************************************************************
+ */
+
+// Commands understood by the simulated card.
+#define CMD_GO_IDLE_STATE           0
+#define CMD_SWITCH_FUNC             6
+#define CMD_SEND_IF_COND            8
+#define CMD_SEND_CSD                9
+#define CMD_SEND_CID                10
+#define CMD_STOP_TRANSMISSION       12
+#define CMD_SEND_STATUS             13
+#define CMD_SET_BLOCKLEN            16
+#define CMD_READ_SINGLE_BLOCK       17
+#define CMD_READ_MULTIPLE_BLOCK     18
+#define CMD_WRITE_BLOCK             24
+#define CMD_WRITE_MULTIPLE_BLOCK    25
+#define CMD_ERASE_WR_BLK_START_ADDR 32
+#define CMD_ERASE_WR_BLK_END_ADDR   33
+#define CMD_ERASE                   38
+#define CMD_APP_CMD                 55
+#define CMD_READ_OCR                58
+#define CMD_CRC_ON_OFF              59
+#define ACMD_SD_STATUS              13
+#define ACMD_SEND_NUM_WR_BLOCKS     22
+#define ACMD_SET_WR_BLK_ERASE_COUNT 23
+#define ACMD_SD_SEND_OP_COND        41
+#define ACMD_SEND_SCR               51
+
+// R1 response flags
+#define R1_READY                    0x00
+#define R1_IDLE                     0x01
+#define R1_ILLEGAL_COMMAND          0x04
+#define R1_COM_CRC_ERROR            0x08
+#define R1_ERASE_SEQUENCE_ERROR     0x10
+#define R1_ADDRESS_ERROR            0x20
+#define R1_PARAMETER_ERROR          0x40
+
+// Tokens
+#define DMY_TKN                     0xFF
+#define BUSY_TKN                    0x00
+#define START_BLOCK_TKN             0xFE
+#define START_BLOCK_TKN_MBW         0xFC
+#define STOP_TRANSMIT_TKN_MBW       0xFD
+#define DATA_ACCEPTED_RESP          0xE5
+#define DATA_CRC_ERROR_RESP         0xEB
+#define DATA_WRITE_ERROR_RESP       0xED
+#define DATA_ERROR_OUT_OF_RANGE     0x08
+
+// Command frame
+#define CMD_FRAME_LEN               6
+#define CMD_FRAME_START_MASK        0xC0
+#define CMD_FRAME_START             0x40
+#define CMD_INDEX_MASK              0x3F
+
+// ACMD41 Host Capacity Support and Host Over 2TB support bits
+#define HCS_BIT                     0x40000000
+#define HO2T_BIT                    0x08000000
+
+// Num of busy bytes following STOP_TRANSMISSION during a multi-block read.
+#define STOP_TRAN_BUSY              2
+
+// Register lengths in bytes
+#define CSD_LEN                     16
+#define CID_LEN                     16
+#define SCR_LEN                     8
+#define SD_STATUS_LEN               64
+#define SWITCH_STATUS_LEN           64
+#define NUM_WR_BLOCKS_LEN           4
+
+// Output queue length. Must hold the longest queued response.
+#define OUT_Q_LEN                   1024
+
+// Card states
+#define ST_CMD                      0       // waiting for a command frame
+#define ST_RX_TKN                   1       // waiting for a write block token
+#define ST_RX_DATA                  2       // receiving a write data block
+#define ST_TX_READ                  3       // streaming CMD18 read blocks
+
+/*
+ ******************************************************************************
+ *                                  VARIABLES
+ ******************************************************************************
+ */
+
+typedef struct SimCard
+{
+  FILE          *img;
+  SimCardConfig  cfg;
+  uint8_t        cs;                         // level of the CS line
+  uint8_t        spiMode;                    // set by the first CMD0
+  uint8_t        idle;
+  uint8_t        appCmd;                     // next command is ACMD
+  uint8_t        crcOn;
+  uint8_t        highSpeed;                  // set by CMD6 mode 1
+  uint16_t       idlePolls;                  // ACMD41 polls left while idle
+  uint8_t        powerUp;                    // set by the first ACMD41
+  uint32_t       powerUpStart;               // bus byte of the first ACMD41
+  uint8_t        state;
+  uint8_t        multi;                      // multi-block write active
+  uint32_t       blck;                       // block of current read/write
+  uint8_t        frame[CMD_FRAME_LEN];
+  uint8_t        frameLen;
+  uint8_t        rxBuf[SIM_BLOCK_LEN + 2];   // data block + CRC16
+  uint16_t       rxLen;
+  uint32_t       eraseStart;
+  uint32_t       eraseEnd;
+  uint8_t        eraseSeq;                   // bit 0 = start, bit 1 = end set
+  uint32_t       wellWrtn;                   // for SEND_NUM_WR_BLOCKS
+  uint32_t       busy;                       // busy bytes remaining
+  uint8_t        outQ[OUT_Q_LEN];
+  uint16_t       qHead;
+  uint16_t       qLen;
+} SimCard;
+
+static SimCard  cards[SIM_MAX_CARDS];
+static SimCard *card = &cards[0];           // card being accessed
+
+static SimStats stats;
+static uint32_t busBytes;                   // bytes clocked, never reset
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTION PROTOTYPES
+ ******************************************************************************
+ */
+
+static void     pvt_Push(uint8_t byte);
+static uint8_t  pvt_Pop(void);
+static void     pvt_PushR1(uint8_t r1);
+static void     pvt_PushDataBlock(const uint8_t *data, uint16_t len);
+static uint8_t  pvt_CRC7(const uint8_t *buf, uint16_t len);
+static uint16_t pvt_CRC16(const uint8_t *buf, uint16_t len);
+static uint8_t  pvt_ArgToBlock(uint32_t arg, uint32_t *blck);
+static void     pvt_ReadImg(uint32_t blck, uint8_t *buf);
+static void     pvt_WriteImg(uint32_t blck, const uint8_t *buf);
+static void     pvt_QueueReadBlock(void);
+static void     pvt_ReceiveByte(uint8_t mosi);
+static void     pvt_FrameByte(uint8_t mosi);
+static void     pvt_Command(void);
+static void     pvt_DataBlockDone(void);
+static void     pvt_SetBits(uint8_t *reg, uint8_t regLen, uint8_t msb,
+                            uint8_t width, uint32_t val);
+static void     pvt_BuildCSD(uint8_t *csd);
+static void     pvt_BuildCID(uint8_t *cid);
+static void     pvt_BuildSCR(uint8_t *scr);
+
+/*
+ ******************************************************************************
+ *                                  FUNCTIONS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      OPEN SIMULATED SD CARD
+ *
+ * Description : Creates a simulated card and attaches its backing image. 
+ *               sim_sd_Open opens card 0.
+ *
+ * Arguments   : cardNum  - card number, 0 to SIM_MAX_CARDS - 1.
+ *               imgPath  - path to the image file. It is created if it does
+ *                          not exist and extended to the card's capacity if
+ *                          it is too short. If NULL, an anonymous temporary
+ *                          image is used.
+ *               cfg      - card configuration. If NULL the SIM_DFLT_XXXX
+ *                          settings and an SDHC card are used.
+ *
+ * Returns     : SIM_OPEN_SUCCESS or SIM_OPEN_FAILED.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sim_sd_Open(const char *imgPath, const SimCardConfig *cfg)
+{
+  return sim_sd_OpenCard(0, imgPath, cfg);
+}
+
+uint8_t sim_sd_OpenCard(uint8_t cardNum, const char *imgPath, 
+                        const SimCardConfig *cfg)
+{
+  if (cardNum >= SIM_MAX_CARDS)
+    return SIM_OPEN_FAILED;
+
+  sim_sd_CloseCard(cardNum);
+  card = &cards[cardNum];
+  memset(card, 0, sizeof(*card));
+  card->cs = 1;
+
+  if (cfg)
+    card->cfg = *cfg;
+  else
+  {
+    card->cfg.numOfBlcks  = SIM_DFLT_NUM_OF_BLCKS;
+    card->cfg.ccs         = SIM_CCS_SDHC;
+    card->cfg.idlePolls   = SIM_DFLT_IDLE_POLLS;
+    card->cfg.accessDelay = SIM_DFLT_ACCESS_DELAY;
+    card->cfg.writeBusy   = SIM_DFLT_WRITE_BUSY;
+    card->cfg.eraseBusy   = SIM_DFLT_ERASE_BUSY;
+  }
+
+  if (imgPath == NULL)
+    card->img = tmpfile();
+  else if ((card->img = fopen(imgPath, "r+b")) == NULL)
+    card->img = fopen(imgPath, "w+b");
+  if (card->img == NULL)
+    return SIM_OPEN_FAILED;
+
+  // extend the image to the card's capacity. New blocks read as 0x00.
+  long imgLen = (long)card->cfg.numOfBlcks * SIM_BLOCK_LEN;
+  if (fseek(card->img, 0, SEEK_END) || ftell(card->img) < imgLen)
+  {
+    if (ftruncate(fileno(card->img), imgLen))
+    {
+      sim_sd_CloseCard(cardNum);
+      return SIM_OPEN_FAILED;
+    }
+  }
+
+  sim_sd_ResetStats();
+  return SIM_OPEN_SUCCESS;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                     CLOSE SIMULATED SD CARD
+ *
+ * Description : Flushes and detaches the image of a simulated card. 
+ *               sim_sd_Close closes card 0.
+ *
+ * Arguments   : cardNum  - card number, 0 to SIM_MAX_CARDS - 1.
+ * ----------------------------------------------------------------------------
+ */
+void sim_sd_Close(void)
+{
+  sim_sd_CloseCard(0);
+}
+
+void sim_sd_CloseCard(uint8_t cardNum)
+{
+  if (cardNum >= SIM_MAX_CARDS)
+    return;
+  if (cards[cardNum].img)
+    fclose(cards[cardNum].img);
+  cards[cardNum].img = NULL;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                         SET CHIP SELECT LEVEL
+ *
+ * Description : Drives the CS line of a simulated card. Deselecting the card
+ *               discards any part of a response that has not been clocked
+ *               out, and any partial command frame or data block. sim_sd_SetCS
+ *               drives the CS line of card 0.
+ *
+ * Arguments   : cardNum  - card number, 0 to SIM_MAX_CARDS - 1.
+ *               level    - 0 selects the card, any other value deselects it.
+ * ----------------------------------------------------------------------------
+ */
+void sim_sd_SetCS(uint8_t level)
+{
+  sim_sd_SetCardCS(0, level);
+}
+
+void sim_sd_SetCardCS(uint8_t cardNum, uint8_t level)
+{
+  if (cardNum >= SIM_MAX_CARDS)
+    return;
+
+  card = &cards[cardNum];
+  card->cs = level ? 1 : 0;
+  if (card->cs)
+  {
+    card->qLen = 0;
+    card->frameLen = 0;
+    if (card->state == ST_RX_DATA)
+      card->state = card->multi ? ST_RX_TKN : ST_CMD;
+  }
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                             EXCHANGE SPI BYTE
+ *
+ * Description : Clocks a single byte through the simulated cards. Only the 
+ *               selected card drives DO. If more than one card is selected,
+ *               DO is the AND of their outputs.
+ *
+ * Arguments   : mosi  - byte sent to the card by the host.
+ *
+ * Returns     : byte sent by the card to the host during the same 8 clocks.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t sim_sd_Exchange(uint8_t mosi)
+{
+  uint8_t miso = DMY_TKN;
+
+  ++stats.bytes;
+  ++busBytes;
+
+  for (card = cards; card < cards + SIM_MAX_CARDS; ++card)
+  {
+    // a deselected card drives nothing, but keeps programming.
+    if (card->cs)
+    {
+      if (card->busy)
+        --card->busy;
+      continue;
+    }
+    ++stats.selBytes;
+
+    // the outgoing byte is determined before the incoming byte is processed.
+    if (card->state == ST_TX_READ && !card->qLen)
+      pvt_QueueReadBlock();
+    if (card->qLen)
+      miso &= pvt_Pop();
+    else if (card->busy)
+    {
+      --card->busy;
+      ++stats.busyBytes;
+      miso &= BUSY_TKN;
+    }
+
+    if (card->img)
+      pvt_ReceiveByte(mosi);
+  }
+  card = cards;
+  return miso;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                       GET / RESET COUNTERS
+ *
+ * Description : sim_sd_GetStats copies the simulator counters into stats.
+ *               sim_sd_ResetStats clears them.
+ * ----------------------------------------------------------------------------
+ */
+void sim_sd_GetStats(SimStats *st)
+{
+  *st = stats;
+}
+
+void sim_sd_ResetStats(void)
+{
+  memset(&stats, 0, sizeof(stats));
+}
+
+/*
+ ******************************************************************************
+ *                        "PRIVATE" FUNCTIONS DEFINITIONS
+ ******************************************************************************
+ */
+
+// add a byte to the end of the output queue.
+static void pvt_Push(uint8_t byte)
+{
+  if (card->qLen < OUT_Q_LEN)
+    card->outQ[(card->qHead + card->qLen++) % OUT_Q_LEN] = byte;
+}
+
+// remove the byte at the front of the output queue.
+static uint8_t pvt_Pop(void)
+{
+  uint8_t byte = card->outQ[card->qHead];
+  card->qHead = (card->qHead + 1) % OUT_Q_LEN;
+  --card->qLen;
+  return byte;
+}
+
+// queue an R1 response preceded by one byte of NCR.
+static void pvt_PushR1(uint8_t r1)
+{
+  pvt_Push(DMY_TKN);
+  pvt_Push(r1);
+}
+
+// queue a data block: NAC, start block token, data, CRC16.
+static void pvt_PushDataBlock(const uint8_t *data, uint16_t len)
+{
+  uint16_t crc = pvt_CRC16(data, len);
+
+  for (uint8_t nac = 0; nac < card->cfg.accessDelay; ++nac)
+    pvt_Push(DMY_TKN);
+  pvt_Push(START_BLOCK_TKN);
+  for (uint16_t pos = 0; pos < len; ++pos)
+    pvt_Push(data[pos]);
+  pvt_Push(crc >> 8);
+  pvt_Push(crc);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                      CALCULATE CRC7 CHECKSUM
+ *
+ * Description : CRC7 (x^7 + x^3 + 1) over a byte buffer. Bitwise on purpose,
+ *               so the simulator does not share an implementation with the
+ *               SD module it checks.
+ * ----------------------------------------------------------------------------
+ */
+static uint8_t pvt_CRC7(const uint8_t *buf, uint16_t len)
+{
+  uint8_t crc = 0;
+
+  for (uint16_t pos = 0; pos < len; ++pos)
+  {
+    uint8_t byte = buf[pos];
+    for (uint8_t bit = 0; bit < 8; ++bit)
+    {
+      crc <<= 1;
+      if ((byte ^ crc) & 0x80)
+        crc ^= 0x09;
+      byte <<= 1;
+    }
+  }
+  return crc & 0x7F;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                     CALCULATE CRC16 CHECKSUM
+ *
+ * Description : CRC16-CCITT (x^16 + x^12 + x^5 + 1, init 0) over a buffer.
+ * ----------------------------------------------------------------------------
+ */
+static uint16_t pvt_CRC16(const uint8_t *buf, uint16_t len)
+{
+  uint16_t crc = 0;
+
+  for (uint16_t pos = 0; pos < len; ++pos)
+  {
+    crc ^= (uint16_t)buf[pos] << 8;
+    for (uint8_t bit = 0; bit < 8; ++bit)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+//
+// converts a command argument to a block number according to the card's
+// addressing mode. Returns the R1 error flag for a bad address, else 0.
+//
+static uint8_t pvt_ArgToBlock(uint32_t arg, uint32_t *blck)
+{
+  if (card->cfg.ccs == SIM_CCS_SDSC)
+  {
+    if (arg % SIM_BLOCK_LEN)
+      return R1_ADDRESS_ERROR;
+    arg /= SIM_BLOCK_LEN;
+  }
+  if (arg >= card->cfg.numOfBlcks)
+    return R1_PARAMETER_ERROR;
+  *blck = arg;
+  return 0;
+}
+
+static void pvt_ReadImg(uint32_t blck, uint8_t *buf)
+{
+  memset(buf, 0, SIM_BLOCK_LEN);
+  if (!fseek(card->img, (long)blck * SIM_BLOCK_LEN, SEEK_SET))
+    if (fread(buf, 1, SIM_BLOCK_LEN, card->img) != SIM_BLOCK_LEN)
+      memset(buf, 0, SIM_BLOCK_LEN);
+}
+
+static void pvt_WriteImg(uint32_t blck, const uint8_t *buf)
+{
+  if (!fseek(card->img, (long)blck * SIM_BLOCK_LEN, SEEK_SET))
+    fwrite(buf, 1, SIM_BLOCK_LEN, card->img);
+}
+
+// queue the next block of a multi-block read, or the out of range token.
+static void pvt_QueueReadBlock(void)
+{
+  uint8_t blckArr[SIM_BLOCK_LEN];
+
+  if (card->blck >= card->cfg.numOfBlcks)
+  {
+    pvt_Push(DATA_ERROR_OUT_OF_RANGE);
+    card->state = ST_CMD;
+    return;
+  }
+  pvt_ReadImg(card->blck++, blckArr);
+  pvt_PushDataBlock(blckArr, SIM_BLOCK_LEN);
+  ++stats.blcksRead;
+}
+
+// processes a byte received from the host according to the card's state.
+static void pvt_ReceiveByte(uint8_t mosi)
+{
+  switch (card->state)
+  {
+    case ST_CMD:
+    case ST_TX_READ:
+      pvt_FrameByte(mosi);
+      break;
+
+    case ST_RX_TKN:
+      if (card->busy)
+        break;
+      if (mosi == (card->multi ? START_BLOCK_TKN_MBW : START_BLOCK_TKN))
+      {
+        card->rxLen = 0;
+        card->state = ST_RX_DATA;
+      }
+      else if (card->multi && mosi == STOP_TRANSMIT_TKN_MBW)
+      {
+        card->multi = 0;
+        card->state = ST_CMD;
+        card->busy = card->cfg.writeBusy;
+      }
+      else if ((mosi & CMD_FRAME_START_MASK) == CMD_FRAME_START)
+      {
+        // write abandoned by the host.
+        card->multi = 0;
+        card->state = ST_CMD;
+        pvt_FrameByte(mosi);
+      }
+      break;
+
+    case ST_RX_DATA:
+      card->rxBuf[card->rxLen++] = mosi;
+      if (card->rxLen == sizeof(card->rxBuf))
+        pvt_DataBlockDone();
+      break;
+  }
+}
+
+// assembles command frames.
+static void pvt_FrameByte(uint8_t mosi)
+{
+  if (!card->frameLen && (mosi & CMD_FRAME_START_MASK) != CMD_FRAME_START)
+    return;
+  card->frame[card->frameLen++] = mosi;
+  if (card->frameLen == CMD_FRAME_LEN)
+  {
+    card->frameLen = 0;
+    pvt_Command();
+  }
+}
+
+// executes a completed command frame.
+static void pvt_Command(void)
+{
+  uint8_t  cmd = card->frame[0] & CMD_INDEX_MASK;
+  uint32_t arg = (uint32_t)card->frame[1] << 24 | (uint32_t)card->frame[2] << 16
+               | (uint32_t)card->frame[3] << 8  | card->frame[4];
+  uint8_t  app = card->appCmd;
+  uint8_t  r1;
+  uint8_t  err;
+  uint32_t blck = 0;
+
+  // the card does not respond to commands while it is busy.
+  if (card->busy)
+    return;
+
+  ++stats.cmds;
+  card->appCmd = 0;
+
+  // until the first CMD0 the card is in SD mode and ignores everything else.
+  if (!card->spiMode && cmd != CMD_GO_IDLE_STATE)
+    return;
+
+  r1 = card->idle ? R1_IDLE : R1_READY;
+
+  // CMD0 and CMD8 are always CRC checked. Others only if CRC is on.
+  if (cmd == CMD_GO_IDLE_STATE || cmd == CMD_SEND_IF_COND || card->crcOn)
+    if (card->frame[5] != (pvt_CRC7(card->frame, 5) << 1 | 1))
+    {
+      pvt_PushR1(r1 | R1_COM_CRC_ERROR);
+      return;
+    }
+
+  // only STOP_TRANSMISSION is accepted while streaming read data.
+  if (card->state == ST_TX_READ)
+  {
+    if (cmd != CMD_STOP_TRANSMISSION)
+      return;
+    card->qLen = 0;
+    card->state = ST_CMD;
+    pvt_Push(DMY_TKN);                      // stuff byte
+    pvt_PushR1(r1);
+    card->busy = STOP_TRAN_BUSY;
+    return;
+  }
+
+  // while idle, only the initialization commands are legal.
+  if (card->idle && !(cmd == CMD_GO_IDLE_STATE || cmd == CMD_SEND_IF_COND
+                  || cmd == CMD_APP_CMD       || cmd == CMD_READ_OCR
+                  || cmd == CMD_CRC_ON_OFF
+                  || (app && cmd == ACMD_SD_SEND_OP_COND)))
+  {
+    pvt_PushR1(r1 | R1_ILLEGAL_COMMAND);
+    return;
+  }
+
+  if (app)
+  {
+    switch (cmd)
+    {
+      case ACMD_SD_STATUS:
+      {
+        uint8_t sdStatus[SD_STATUS_LEN] = {0};
+        sdStatus[8] = 0x04;                 // SPEED_CLASS (class 10)
+        sdStatus[10] = 0x90;                // AU_SIZE (4 MB)
+        sdStatus[12] = 0x01;                // ERASE_SIZE (1 AU)
+        sdStatus[13] = 0x05 << 2 | 0x01;    // ERASE_TIMEOUT, ERASE_OFFSET
+        pvt_PushR1(r1);
+        pvt_Push(0);                        // second byte of R2
+        pvt_PushDataBlock(sdStatus, SD_STATUS_LEN);
+        return;
+      }
+      case ACMD_SEND_NUM_WR_BLOCKS:
+      {
+        uint8_t nwb[NUM_WR_BLOCKS_LEN] = { card->wellWrtn >> 24,
+                                           card->wellWrtn >> 16,
+                                           card->wellWrtn >> 8,
+                                           card->wellWrtn };
+        pvt_PushR1(r1);
+        pvt_PushDataBlock(nwb, NUM_WR_BLOCKS_LEN);
+        return;
+      }
+      case ACMD_SET_WR_BLK_ERASE_COUNT:
+        pvt_PushR1(r1);
+        return;
+      case ACMD_SD_SEND_OP_COND:
+        if (card->idle)
+        {
+          if (!card->powerUp)
+          {
+            card->powerUp = 1;
+            card->powerUpStart = busBytes;
+          }
+          if (card->idlePolls)
+            --card->idlePolls;
+          else if (busBytes - card->powerUpStart >= card->cfg.idleBytes
+                   && (card->cfg.ccs == SIM_CCS_SDSC 
+                       || ((arg & HCS_BIT) 
+                           && (!card->cfg.co2t || (arg & HO2T_BIT)))))
+            card->idle = 0;
+        }
+        pvt_PushR1(card->idle ? R1_IDLE : R1_READY);
+        return;
+      case ACMD_SEND_SCR:
+      {
+        uint8_t scr[SCR_LEN];
+        pvt_BuildSCR(scr);
+        pvt_PushR1(r1);
+        pvt_PushDataBlock(scr, SCR_LEN);
+        return;
+      }
+      default:
+        break;                              // fall through to standard cmds
+    }
+  }
+
+  switch (cmd)
+  {
+    case CMD_GO_IDLE_STATE:
+      card->spiMode = 1;
+      card->idle = 1;
+      card->crcOn = 0;
+      card->highSpeed = 0;
+      card->multi = 0;
+      card->eraseSeq = 0;
+      card->idlePolls = card->cfg.idlePolls;
+      card->powerUp = 0;
+      pvt_PushR1(R1_IDLE);
+      break;
+
+    case CMD_SWITCH_FUNC:
+    {
+      // Only function group 1 (access mode) is modelled. It supports
+      // default (0) and high speed (1). 0xF keeps the current function.
+      uint8_t status[SWITCH_STATUS_LEN] = {0};
+      uint8_t fn = arg & 0x0F;
+      if (fn == 0x0F)
+        fn = card->highSpeed;
+      else if (fn > 1)
+        fn = 0x0F;                          // not supported
+      status[1] = 100;                      // max current (mA)
+      status[12] = 0x80;                    // group 1 support, fn 15
+      status[13] = 0x03;                    // group 1 support, fn 1 and 0
+      status[16] = fn;                      // group 1 selected function
+      status[17] = 1;                       // data structure version
+      if ((arg & 0x80000000) && fn != 0x0F)
+        card->highSpeed = fn;
+      pvt_PushR1(r1);
+      pvt_PushDataBlock(status, SWITCH_STATUS_LEN);
+      break;
+    }
+
+    case CMD_SEND_IF_COND:
+      pvt_PushR1(r1);
+      pvt_Push(0);
+      pvt_Push(0);
+      pvt_Push((arg >> 8) & 0x0F);          // voltage accepted
+      pvt_Push(arg);                        // check pattern echo
+      break;
+
+    case CMD_SEND_CSD:
+    {
+      uint8_t csd[CSD_LEN];
+      pvt_BuildCSD(csd);
+      pvt_PushR1(r1);
+      pvt_PushDataBlock(csd, CSD_LEN);
+      break;
+    }
+
+    case CMD_SEND_CID:
+    {
+      uint8_t cid[CID_LEN];
+      pvt_BuildCID(cid);
+      pvt_PushR1(r1);
+      pvt_PushDataBlock(cid, CID_LEN);
+      break;
+    }
+
+    case CMD_STOP_TRANSMISSION:
+      pvt_PushR1(r1);
+      break;
+
+    case CMD_SEND_STATUS:
+      pvt_PushR1(r1);
+      pvt_Push(0);
+      break;
+
+    case CMD_SET_BLOCKLEN:
+      pvt_PushR1(arg == SIM_BLOCK_LEN ? r1 : r1 | R1_PARAMETER_ERROR);
+      break;
+
+    case CMD_READ_SINGLE_BLOCK:
+    case CMD_READ_MULTIPLE_BLOCK:
+      if ((err = pvt_ArgToBlock(arg, &blck)))
+      {
+        pvt_PushR1(r1 | err);
+        break;
+      }
+      pvt_PushR1(r1);
+      card->blck = blck;
+      if (cmd == CMD_READ_MULTIPLE_BLOCK)
+        card->state = ST_TX_READ;
+      else
+        pvt_QueueReadBlock();
+      break;
+
+    case CMD_WRITE_BLOCK:
+    case CMD_WRITE_MULTIPLE_BLOCK:
+      if ((err = pvt_ArgToBlock(arg, &blck)))
+      {
+        pvt_PushR1(r1 | err);
+        break;
+      }
+      pvt_PushR1(r1);
+      card->blck = blck;
+      card->multi = (cmd == CMD_WRITE_MULTIPLE_BLOCK);
+      card->wellWrtn = 0;
+      card->state = ST_RX_TKN;
+      break;
+
+    case CMD_ERASE_WR_BLK_START_ADDR:
+    case CMD_ERASE_WR_BLK_END_ADDR:
+      if ((err = pvt_ArgToBlock(arg, &blck)))
+      {
+        card->eraseSeq = 0;
+        pvt_PushR1(r1 | err);
+        break;
+      }
+      if (cmd == CMD_ERASE_WR_BLK_START_ADDR)
+      {
+        card->eraseStart = blck;
+        card->eraseSeq = 1;
+      }
+      else if (card->eraseSeq & 1)
+      {
+        card->eraseEnd = blck;
+        card->eraseSeq |= 2;
+      }
+      else
+      {
+        pvt_PushR1(r1 | R1_ERASE_SEQUENCE_ERROR);
+        break;
+      }
+      pvt_PushR1(r1);
+      break;
+
+    case CMD_ERASE:
+    {
+      uint8_t zeros[SIM_BLOCK_LEN] = {0};
+
+      if (card->eraseSeq != 3 || card->eraseEnd < card->eraseStart)
+      {
+        card->eraseSeq = 0;
+        pvt_PushR1(r1 | R1_ERASE_SEQUENCE_ERROR);
+        break;
+      }
+      for (uint32_t b = card->eraseStart; b <= card->eraseEnd; ++b)
+        pvt_WriteImg(b, zeros);
+      card->eraseSeq = 0;
+      pvt_PushR1(r1);
+      card->busy = card->cfg.eraseBusy;
+      break;
+    }
+
+    case CMD_APP_CMD:
+      card->appCmd = 1;
+      pvt_PushR1(r1);
+      break;
+
+    case CMD_READ_OCR:
+      pvt_PushR1(r1);
+      pvt_Push((card->idle ? 0 : 0x80)
+               | (!card->idle && card->cfg.ccs == SIM_CCS_SDHC ? 0x40 : 0)
+               | (!card->idle && card->cfg.co2t ? 0x08 : 0));
+      pvt_Push(0xFF);                       // 2.7 - 3.6V window
+      pvt_Push(0x80);
+      pvt_Push(0x00);
+      break;
+
+    case CMD_CRC_ON_OFF:
+      card->crcOn = arg & 1;
+      pvt_PushR1(r1);
+      break;
+
+    default:
+      pvt_PushR1(r1 | R1_ILLEGAL_COMMAND);
+      break;
+  }
+}
+
+// handles a completed write data block.
+static void pvt_DataBlockDone(void)
+{
+  uint16_t crc = (uint16_t)card->rxBuf[SIM_BLOCK_LEN] << 8
+               | card->rxBuf[SIM_BLOCK_LEN + 1];
+
+  card->state = card->multi ? ST_RX_TKN : ST_CMD;
+
+  if (card->crcOn && crc != pvt_CRC16(card->rxBuf, SIM_BLOCK_LEN))
+  {
+    pvt_Push(DATA_CRC_ERROR_RESP);
+    return;
+  }
+  if (card->blck >= card->cfg.numOfBlcks)
+  {
+    pvt_Push(DATA_WRITE_ERROR_RESP);
+    return;
+  }
+
+  pvt_WriteImg(card->blck++, card->rxBuf);
+  ++card->wellWrtn;
+  ++stats.blcksWrtn;
+  pvt_Push(DATA_ACCEPTED_RESP);
+  card->busy = card->cfg.writeBusy;
+}
+
+// sets a field of width bits, whose MSB is bit msb, in a big-endian register.
+static void pvt_SetBits(uint8_t *reg, uint8_t regLen, uint8_t msb,
+                        uint8_t width, uint32_t val)
+{
+  for (uint8_t i = 0; i < width; ++i)
+  {
+    uint8_t bitPos = msb - i;
+    uint8_t byteNum = regLen - 1 - bitPos / 8;
+    if ((val >> (width - 1 - i)) & 1)
+      reg[byteNum] |= 1 << (bitPos % 8);
+    else
+      reg[byteNum] &= ~(1 << (bitPos % 8));
+  }
+}
+
+static void pvt_BuildCSD(uint8_t *csd)
+{
+  memset(csd, 0, CSD_LEN);
+
+  if (card->cfg.co2t)
+  {
+    uint32_t cSize = card->cfg.numOfBlcks / 1024;
+    pvt_SetBits(csd, CSD_LEN, 127, 2, 2);           // CSD_STRUCTURE
+    pvt_SetBits(csd, CSD_LEN, 119, 8, 0x0E);        // TAAC
+    pvt_SetBits(csd, CSD_LEN, 111, 8, 0x00);        // NSAC
+    pvt_SetBits(csd, CSD_LEN, 75, 28, cSize ? cSize - 1 : 0);  // C_SIZE
+  }
+  else if (card->cfg.ccs == SIM_CCS_SDHC)
+  {
+    uint32_t cSize = card->cfg.numOfBlcks / 1024;
+    pvt_SetBits(csd, CSD_LEN, 127, 2, 1);           // CSD_STRUCTURE
+    pvt_SetBits(csd, CSD_LEN, 119, 8, 0x0E);        // TAAC
+    pvt_SetBits(csd, CSD_LEN, 111, 8, 0x00);        // NSAC
+    pvt_SetBits(csd, CSD_LEN, 69, 22, cSize ? cSize - 1 : 0);  // C_SIZE
+  }
+  else
+  {
+    uint32_t cSize = card->cfg.numOfBlcks / 512;
+    pvt_SetBits(csd, CSD_LEN, 127, 2, 0);           // CSD_STRUCTURE
+    pvt_SetBits(csd, CSD_LEN, 119, 8, 0x26);        // TAAC (1.5 ms)
+    pvt_SetBits(csd, CSD_LEN, 111, 8, 0x00);        // NSAC
+    pvt_SetBits(csd, CSD_LEN, 79, 1, 1);            // READ_BL_PARTIAL
+    pvt_SetBits(csd, CSD_LEN, 73, 12, cSize ? cSize - 1 : 0);  // C_SIZE
+    pvt_SetBits(csd, CSD_LEN, 61, 3, 7);            // VDD_R_CURR_MIN
+    pvt_SetBits(csd, CSD_LEN, 58, 3, 7);            // VDD_R_CURR_MAX
+    pvt_SetBits(csd, CSD_LEN, 55, 3, 7);            // VDD_W_CURR_MIN
+    pvt_SetBits(csd, CSD_LEN, 52, 3, 7);            // VDD_W_CURR_MAX
+    pvt_SetBits(csd, CSD_LEN, 49, 3, 7);            // C_SIZE_MULT
+  }
+  pvt_SetBits(csd, CSD_LEN, 103, 8,                 // TRAN_SPEED
+              card->highSpeed ? 0x5A : 0x32);        // (50 MHz / 25 MHz)
+  pvt_SetBits(csd, CSD_LEN, 95, 12, 0x5B5);         // CCC
+  pvt_SetBits(csd, CSD_LEN, 83, 4, 9);              // READ_BL_LEN
+  pvt_SetBits(csd, CSD_LEN, 46, 1, 1);              // ERASE_BLK_EN
+  pvt_SetBits(csd, CSD_LEN, 45, 7, 0x7F);           // SECTOR_SIZE
+  pvt_SetBits(csd, CSD_LEN, 28, 3, 2);              // R2W_FACTOR
+  pvt_SetBits(csd, CSD_LEN, 25, 4, 9);              // WRITE_BL_LEN
+  pvt_SetBits(csd, CSD_LEN, 14, 1, 1);              // COPY
+  csd[CSD_LEN - 1] = pvt_CRC7(csd, CSD_LEN - 1) << 1 | 1;
+}
+
+static void pvt_BuildCID(uint8_t *cid)
+{
+  memset(cid, 0, CID_LEN);
+  pvt_SetBits(cid, CID_LEN, 127, 8, 0x03);          // MID
+  pvt_SetBits(cid, CID_LEN, 119, 16, 'S' << 8 | 'D'); // OID
+  memcpy(&cid[3], "SIMSD", 5);                      // PNM
+  pvt_SetBits(cid, CID_LEN, 63, 8, 0x10);           // PRV
+  pvt_SetBits(cid, CID_LEN, 55, 32, 0x12345678);    // PSN
+  pvt_SetBits(cid, CID_LEN, 19, 12, 24 << 4 | 1);   // MDT (2024-01)
+  cid[CID_LEN - 1] = pvt_CRC7(cid, CID_LEN - 1) << 1 | 1;
+}
+
+static void pvt_BuildSCR(uint8_t *scr)
+{
+  memset(scr, 0, SCR_LEN);
+  pvt_SetBits(scr, SCR_LEN, 59, 4, 2);              // SD_SPEC
+  pvt_SetBits(scr, SCR_LEN, 55, 1, 0);              // DATA_STAT_AFTER_ERASE
+  pvt_SetBits(scr, SCR_LEN, 54, 3,                  // SD_SECURITY
+              card->cfg.ccs == SIM_CCS_SDHC ? 3 : 2);
+  pvt_SetBits(scr, SCR_LEN, 51, 4, 0x5);            // SD_BUS_WIDTHS
+  pvt_SetBits(scr, SCR_LEN, 47, 1, 1);              // SD_SPEC3
+}
@@ -0,0 +1,135 @@
+/*
+ * File       : SIM_SPI.C
+ * Version    : 1.0
+ * Target     : Host (Linux)
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Description: Implements SIM_SPI.H. Routes the SPI traffic of the SD module
+ *              to the simulated SD card.
+ */
+
+#include <stdint.h>
+#include "sim_sd.h"
+#include "sim_spi.h"
+
+// stands in for the SPI data register (SPDR).
+static uint8_t spdr = 0xFF;
+
+// divisor shift of the current SPI clock rate (F_CPU >> clkDivShift).
+static uint8_t clkDivShift = 6;
+
+/*
+ ******************************************************************************
+ *                                  FUNCTIONS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                         INITIALIZE SPI PORT INTO MASTER MODE
+ *
+ * Description : Deselects the simulated card. There is no port to set up.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterInit(void)
+{
+  SS_HI;
+  clkDivShift = 6;                          // F_CPU/64, as on the AVR
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                             SPI RECEIVE BYTE
+ *
+ * Description : Gets the byte returned by the simulated card during the last
+ *               call to spi_MasterTransmit.
+ *
+ * Returns     : byte received from the simulated card.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t spi_MasterReceive(void)
+{
+  return spdr;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                            SPI TRANSMIT BYTE
+ *
+ * Description : Exchanges a byte with the simulated card.
+ *
+ * Arguments   : byte - data byte to be sent to the card.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterTransmit(uint8_t byte)
+{
+  spdr = sim_sd_Exchange(byte);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                    SPI START TRANSMIT BYTE
+ *
+ * Description : Same as spi_MasterTransmit. Provided for the interrupt-driven
+ *               users of AVR_SPI, which poll for completion instead.
+ *
+ * Arguments   : byte - data byte to be sent to the card.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterStartTransmit(uint8_t byte)
+{
+  spdr = sim_sd_Exchange(byte);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                 SPI RECEIVE / TRANSMIT BLOCK
+ *
+ * Description : Block forms of the above. spi_MasterReceiveBlock clocks 0xFF
+ *               for each byte and stores what the card returns in buf.
+ *               spi_MasterTransmitBlock sends len bytes from buf.
+ *
+ * Arguments   : buf  - array to load / array holding the bytes to send.
+ *               len  - number of bytes. Must be at least 1.
+ * ----------------------------------------------------------------------------
+ */
+void spi_MasterReceiveBlock(uint8_t *buf, uint16_t len)
+{
+  while (len--)
+    *buf++ = spdr = sim_sd_Exchange(0xFF);
+}
+
+void spi_MasterTransmitBlock(const uint8_t *buf, uint16_t len)
+{
+  while (len--)
+    spdr = sim_sd_Exchange(*buf++);
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                  SET / GET SPI CLOCK RATE
+ *
+ * Description : Same divisor selection as AVR_SPI. The simulated card is not
+ *               timed, so the rate is only recorded so that it can be checked.
+ *
+ * Arguments   : maxRate  - maximum SPI clock rate in Hz.
+ *
+ * Returns     : SPI clock rate in Hz that was set / is currently set.
+ * ----------------------------------------------------------------------------
+ */
+uint32_t spi_SetClockRate(uint32_t maxRate)
+{
+  uint8_t shift = SPI_CLK_DIV_SHIFT_MIN;
+
+  while (shift < SPI_CLK_DIV_SHIFT_MAX && (F_CPU >> shift) > maxRate)
+    ++shift;
+  clkDivShift = shift;
+  return F_CPU >> shift;
+}
+
+uint32_t spi_GetClockRate(void)
+{
+  return F_CPU >> clkDivShift;
+}
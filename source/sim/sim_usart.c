@@ -0,0 +1,64 @@
+/*
+ * File       : SIM_USART.C
+ * Version    : 1.0
+ * Target     : Host (Linux)
+ * License    : GNU GPLv3
+ * Author     : Joshua Fain
+ * Copyright (c) 2020 - 2024
+ *
+ * Description:  Host-side implementation of AVR_USART.H. Characters are
+ *               written to stdout and read from stdin so the print functions
+ *               can be used with the simulated SD card.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "avr_usart.h"
+
+/*
+ ******************************************************************************
+ *                                  FUNCTIONS
+ ******************************************************************************
+ */
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                             INITIALIZE USART
+ *
+ * Description : Nothing to initialize on the host.
+ * ----------------------------------------------------------------------------
+ */
+void usart_Init(void)
+{
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                                USART RECEIVE
+ *
+ * Description : Receive a character from stdin.
+ *
+ * Returns     : character received, or '\r' at end of input.
+ * ----------------------------------------------------------------------------
+ */
+uint8_t usart_Receive(void)
+{
+  int c = getchar();
+  return (c == EOF || c == '\n') ? '\r' : (uint8_t)c;
+}
+
+/*
+ * ----------------------------------------------------------------------------
+ *                                                               USART TRANSMIT
+ *
+ * Description : Sends a character to stdout.
+ *
+ * Arguments   : data - data to send.
+ * ----------------------------------------------------------------------------
+ */
+void usart_Transmit(uint8_t data)
+{
+  // the print functions terminate lines with "\n\r". Drop the '\r'.
+  if (data != '\r')
+    putchar(data);
+}
@@ -0,0 +1,970 @@
+/*
+ * File       : SD_SIM_TEST.C
+ * Author     : Joshua Fain
+ * Target     : Host (Linux)
+ * License    : GNU GPLv3
+ * Copyright (c) 2020 - 2024
+ *
+ * Host-side test of the SD_SPI module files against the simulated SD card in
+ * SIM_SD. Runs the initialization routine and the read, write and erase
+ * functions against an SDHC and an SDSC card, verifies the data that comes
+ * back, and prints the number of SPI bytes each operation clocked.
+ *
+ * Usage : sd_sim_test [image]
+ *         If image is given, the SDHC card is backed by that file, otherwise
+ *         temporary images are used.
+ *
+ * Returns 0 if every check passed, else the number of failed checks.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "avr_usart.h"
+#include "prints.h"
+#include "sd_spi_base.h"
+#include "sd_spi_rwe.h"
+#include "sd_spi_info.h"
+#include "sd_spi_misc.h"
+#include "sd_spi_print.h"
+#include "sd_spi_cache.h"
+#include "sd_spi_async.h"
+#include "sd_spi_card.h"
+#include "sd_spi_mirror.h"
+#include "sd_spi_log.h"
+#include "sim_sd.h"
+
+#define TEST_BLK_ADDR        20             // block used by the tests
+#define TEST_NUM_OF_BLKS     4              // blocks used by multi-blk tests
+#define TEST_NUM_OF_STRM     300            // blocks streamed by read tests
+#define TEST_IDLE_BYTES      8000           // card power up, multi-card tests
+#define TEST_LOG_BLK         1000           // first block of the ring log
+#define TEST_LOG_NUM_OF_BLKS 16             // blocks in the ring log
+#define TEST_LOG_REC_LEN     100            // 4 records per log block
+#define TEST_FILL_BLK        2000           // first block of the filled range
+#define TEST_FILL_NUM_OF_BLKS 1000          // blocks in the filled range
+#define TEST_FILL_WRTN_BLKS  137            // blocks written to the range
+
+// simulated cards the tests are run against.
+static const SimCardConfig sdhcCfg =
+{
+  .numOfBlcks  = SIM_DFLT_NUM_OF_BLCKS,
+  .ccs         = SIM_CCS_SDHC,
+  .idlePolls   = SIM_DFLT_IDLE_POLLS,
+  .accessDelay = SIM_DFLT_ACCESS_DELAY,
+  .writeBusy   = SIM_DFLT_WRITE_BUSY,
+  .eraseBusy   = SIM_DFLT_ERASE_BUSY
+};
+
+static const SimCardConfig sdscCfg =
+{
+  .numOfBlcks  = 0x2000,                    // 4 MB
+  .ccs         = SIM_CCS_SDSC,
+  .idlePolls   = SIM_DFLT_IDLE_POLLS,
+  .accessDelay = SIM_DFLT_ACCESS_DELAY,
+  .writeBusy   = SIM_DFLT_WRITE_BUSY,
+  .eraseBusy   = SIM_DFLT_ERASE_BUSY
+};
+
+// over 2TB (SDUC) card. Capacity is still small, see SimCardConfig.
+static const SimCardConfig sducCfg =
+{
+  .numOfBlcks  = SIM_DFLT_NUM_OF_BLCKS,
+  .ccs         = SIM_CCS_SDHC,
+  .idlePolls   = SIM_DFLT_IDLE_POLLS,
+  .accessDelay = SIM_DFLT_ACCESS_DELAY,
+  .writeBusy   = SIM_DFLT_WRITE_BUSY,
+  .eraseBusy   = SIM_DFLT_ERASE_BUSY,
+  .co2t        = 1
+};
+
+static uint16_t failCnt = 0;
+
+// ctx of countBlocks. Counts the blocks streamed, stopping at stopAt if set.
+typedef struct BlockCount
+{
+  uint32_t cnt;
+  uint32_t stopAt;
+} BlockCount;
+
+// local functions
+static void     check(char *name, uint8_t pass);
+static void     printSpiCost(char *op);
+static uint32_t blkAddr(const CTV *ctv, uint32_t blkNum);
+static uint8_t  countBlocks(uint32_t blckIdx, const uint8_t blckArr[],
+                            void *ctx);
+static const uint8_t *patternBlock(uint32_t blckIdx, void *ctx);
+static void     runTests(const char *imgPath, const SimCardConfig *cfg);
+static void     crcTests(void);
+static void     capacityTests(void);
+static void     multiCardTests(void);
+static void     asyncDone(uint16_t err, void *ctx);
+
+int main(int argc, char *argv[])
+{
+  usart_Init();
+
+  print_Str("\n\r >> CRC");
+  crcTests();
+
+  print_Str("\n\n\r >> CSD capacity");
+  capacityTests();
+
+  print_Str("\n\r >> SDHC card");
+  runTests(argc > 1 ? argv[1] : NULL, &sdhcCfg);
+
+  print_Str("\n\n\r >> SDSC card");
+  runTests(NULL, &sdscCfg);
+
+  print_Str("\n\n\r >> SDUC card");
+  runTests(NULL, &sducCfg);
+
+  print_Str("\n\n\r >> Two cards");
+  multiCardTests();
+
+  print_Str("\n\n\r >> Failed checks: ");
+  print_Dec(failCnt);
+  print_Str("\n\r");
+  return failCnt;
+}
+
+//
+// LOCAL FUNCTION - checks sd_CRC7 and sd_CRC16 against known values.
+//
+static void crcTests(void)
+{
+  const uint8_t cmd0[] = { 0x40, 0x00, 0x00, 0x00, 0x00 };
+  const uint8_t cmd8[] = { 0x48, 0x00, 0x00, 0x01, 0xAA };
+  uint8_t       blckArr[BLOCK_LEN];
+
+  check("CRC7 of CMD0 is 0x4A", sd_CRC7(cmd0, sizeof(cmd0)) == 0x4A);
+  check("CRC7 of CMD8 is 0x43", sd_CRC7(cmd8, sizeof(cmd8)) == 0x43);
+
+  memset(blckArr, 0xFF, BLOCK_LEN);
+  check("CRC16 of 0xFF block is 0x7FA1", sd_CRC16(blckArr, BLOCK_LEN) 
+                                         == 0x7FA1);
+  check("CRC16 of \"123456789\" is 0x31C3",
+        sd_CRC16((const uint8_t *)"123456789", 9) == 0x31C3);
+}
+
+//
+// LOCAL FUNCTION - checks the capacity decoded from CSDs of cards too large
+//                  to simulate with an image.
+//
+static void capacityTests(void)
+{
+  // version 2.0, C_SIZE = 0x01DCFF: 61056 * 512 KB = 59.6 GB (64 GB card)
+  const uint8_t csdV2[CSD_LEN] = { 0x40, 0x0E, 0x00, 0x32, 0x5B, 0x59, 0x00,
+                                   0x01, 0xDC, 0xFF, 0x7F, 0x80, 0x0A, 0x40,
+                                   0x00, 0x01 };
+  // version 3.0, C_SIZE = 0x0FFFFFF: 2^24 * 512 KB = 8 TB
+  const uint8_t csdV3[CSD_LEN] = { 0x80, 0x0E, 0x00, 0x32, 0x5B, 0x59, 0x00,
+                                   0xFF, 0xFF, 0xFF, 0x7F, 0x80, 0x0A, 0x40,
+                                   0x00, 0x01 };
+  SDCsd csd;
+
+  sd_DecodeCSD(csdV2, &csd);
+  check("CSD v2 64 GB byte capacity", 
+        sd_CsdByteCapacity(&csd) == 0x1DD00ULL * 512 * 1024);
+  check("CSD v2 64 GB block capacity", 
+        sd_CsdNumOfBlcks(&csd) == 0x1DD00UL * 1024);
+
+  sd_DecodeCSD(csdV3, &csd);
+  check("CSD v3 C_SIZE", csd.csdStructure == CSD_VSN_SDUC 
+                         && csd.cSize == 0xFFFFFF);
+  check("CSD v3 8 TB byte capacity", 
+        sd_CsdByteCapacity(&csd) == 0x1000000ULL * 512 * 1024);
+  check("CSD v3 block capacity limited to 32-bit", 
+        sd_CsdNumOfBlcks(&csd) == UINT32_MAX);
+}
+
+//
+// LOCAL FUNCTION - initializes two cards with sd_InitCards and checks that 
+//                  each is accessed through its own handle.
+//
+static void multiCardTests(void)
+{
+  SimCardConfig cfg[SIM_MAX_CARDS] = { sdhcCfg, sdscCfg };
+  SDCard        card0 = { .cs = { 0 } };
+  SDCard        card1 = { .cs = { 1 } };
+  SDCard       *cards[] = { &card0, &card1 };
+  uint8_t       blckArr[BLOCK_LEN];
+  uint8_t       match;
+  SimStats      st;
+  uint32_t      seqBytes = 0;
+
+  for (uint8_t i = 0; i < SIM_MAX_CARDS; ++i)
+  {
+    cfg[i].idleBytes = TEST_IDLE_BYTES;
+    if (sim_sd_OpenCard(i, NULL, &cfg[i]) != SIM_OPEN_SUCCESS)
+    {
+      check("sim_sd_OpenCard", 0);
+      return;
+    }
+  }
+
+  // one card after the other, as with sd_InitModeSPI.
+  for (uint8_t i = 0; i < SIM_MAX_CARDS; ++i)
+  {
+    sim_sd_ResetStats();
+    check("sd_InitCards single card", sd_InitCards(&cards[i], 1) == 1);
+    sim_sd_GetStats(&st);
+    seqBytes += st.bytes;
+  }
+
+  sim_sd_ResetStats();
+  check("sd_InitCards two cards", sd_InitCards(cards, 2) == 2
+        && card0.initResp == OUT_OF_IDLE && card1.initResp == OUT_OF_IDLE);
+  printSpiCost("sd_InitCards");
+  sim_sd_GetStats(&st);
+  check("two card init takes about as long as one",
+        st.bytes < seqBytes * 3 / 4);
+  check("card types", card0.ctv.type == SDHC && card1.ctv.type == SDSC);
+
+  // same block, different data, on each card.
+  for (uint8_t i = 0; i < SIM_MAX_CARDS; ++i)
+  {
+    memset(blckArr, 0xA0 + i, BLOCK_LEN);
+    sd_SelectCard(cards[i]);
+    check("sd_WriteSingleBlock to selected card",
+          sd_WriteSingleBlock(blkAddr(&cards[i]->ctv, TEST_BLK_ADDR), blckArr)
+          == WRITE_SUCCESS);
+  }
+
+  for (uint8_t i = 0; i < SIM_MAX_CARDS; ++i)
+  {
+    sd_SelectCard(cards[i]);
+    match = sd_ReadSingleBlock(blkAddr(&cards[i]->ctv, TEST_BLK_ADDR), 
+                               blckArr) == READ_SUCCESS;
+    for (uint16_t pos = 0; pos < BLOCK_LEN; ++pos)
+      if (blckArr[pos] != 0xA0 + i)
+        match = 0;
+    check("read from selected card matches its data", match);
+  }
+
+  //
+  // MIRROR
+  //
+  SDMirror   mirror = { .card = { &card0, &card1 } };
+  BlockCount bc = { 0, 0 };
+  uint8_t    result = MIRROR_SUCCESS;
+
+  sim_sd_ResetStats();
+  for (uint8_t blk = 0; blk < TEST_NUM_OF_BLKS; ++blk)
+  {
+    memset(blckArr, 0xB0 + blk, BLOCK_LEN);
+    result |= sd_MirrorWriteBlock(&mirror, TEST_BLK_ADDR + blk, blckArr);
+  }
+  check("sd_MirrorWriteBlock", result == MIRROR_SUCCESS);
+  printSpiCost("sd_MirrorWriteBlock x 4");
+  sim_sd_GetStats(&st);
+  check("each card programs while the other is written", st.busyBytes == 0);
+
+  match = 1;
+  for (uint8_t i = 0; i < SIM_MAX_CARDS; ++i)
+  {
+    sd_SelectCard(cards[i]);
+    for (uint8_t blk = 0; blk < TEST_NUM_OF_BLKS; ++blk)
+    {
+      sd_ReadSingleBlock(blkAddr(&cards[i]->ctv, TEST_BLK_ADDR + blk), 
+                         blckArr);
+      if (blckArr[0] != 0xB0 + blk || blckArr[BLOCK_LEN - 1] != 0xB0 + blk)
+        match = 0;
+    }
+  }
+  check("mirrored blocks on both cards", match);
+
+  sim_sd_ResetStats();
+  check("sd_MirrorWriteBlocks",
+        sd_MirrorWriteBlocks(&mirror, TEST_BLK_ADDR + TEST_NUM_OF_BLKS, 
+                             TEST_NUM_OF_BLKS, NULL, patternBlock, blckArr)
+        == MIRROR_SUCCESS);
+  printSpiCost("sd_MirrorWriteBlocks x 4");
+  sim_sd_GetStats(&st);
+  // only the last block of the second card is waited on, to close its stream.
+  check("blocks interleaved so each card programs while the other is written", 
+        st.busyBytes < SIM_DFLT_WRITE_BUSY);
+
+  match = 1;
+  for (uint8_t i = 0; i < SIM_MAX_CARDS; ++i)
+  {
+    sd_SelectCard(cards[i]);
+    for (uint8_t blk = 0; blk < TEST_NUM_OF_BLKS; ++blk)
+    {
+      sd_ReadSingleBlock(blkAddr(&cards[i]->ctv, 
+                                 TEST_BLK_ADDR + TEST_NUM_OF_BLKS + blk), 
+                         blckArr);
+      if (blckArr[1] != (1 ^ blk) || blckArr[200] != (200 ^ blk))
+        match = 0;
+    }
+  }
+  check("streamed mirrored blocks on both cards", match);
+
+  check("sd_MirrorReadBlocks", 
+        sd_MirrorReadBlocks(&mirror, TEST_BLK_ADDR, TEST_NUM_OF_BLKS, blckArr,
+                            countBlocks, &bc) == MIRROR_SUCCESS
+        && bc.cnt == TEST_NUM_OF_BLKS);
+
+  // a card that no longer responds. Reads are completed on the other card.
+  sim_sd_CloseCard(1);
+  result = 0;
+  match = 1;
+  for (uint8_t blk = 0; blk < 2; ++blk)
+  {
+    result |= sd_MirrorReadBlock(&mirror, TEST_BLK_ADDR + blk, blckArr);
+    if (blckArr[0] != 0xB0 + blk)
+      match = 0;
+  }
+  check("sd_MirrorReadBlock falls back to the other card",
+        result == (MIRROR_SUCCESS | MIRROR_CARD1_ERROR) && match);
+  check("sd_MirrorWriteBlock with one card failed",
+        sd_MirrorWriteBlock(&mirror, TEST_BLK_ADDR, blckArr) 
+        == (MIRROR_SUCCESS | MIRROR_CARD1_ERROR));
+
+  for (uint8_t i = 0; i < SIM_MAX_CARDS; ++i)
+    sim_sd_CloseCard(i);
+}
+
+//
+// LOCAL FUNCTION - runs the test sequence against a single simulated card.
+//
+static void runTests(const char *imgPath, const SimCardConfig *cfg)
+{
+  CTV      ctv;
+  uint32_t initResp;
+  uint8_t  dataArr[BLOCK_LEN];
+  uint8_t  blckArr[BLOCK_LEN];
+  uint8_t  match;
+
+  if (sim_sd_Open(imgPath, cfg) != SIM_OPEN_SUCCESS)
+  {
+    check("sim_sd_Open", 0);
+    return;
+  }
+
+  for (uint16_t pos = 0; pos < BLOCK_LEN; ++pos)
+    dataArr[pos] = pos * 7 + 3;
+
+#if SD_STATS
+  sd_StatsReset();
+#endif
+
+  //
+  // INITIALIZATION
+  //
+  check("init SPI clock <= 400 kHz",
+        spi_SetClockRate(SD_INIT_CLK_RATE) <= SD_INIT_CLK_RATE);
+  sim_sd_ResetStats();
+  initResp = sd_InitModeSPI(&ctv);
+  if (initResp != OUT_OF_IDLE)
+  {
+    print_Str("\n\r    Initialization Error Response: ");
+    sd_PrintInitErrorResponse(initResp);
+    sd_PrintR1(initResp);
+  }
+  check("sd_InitModeSPI", initResp == OUT_OF_IDLE);
+  printSpiCost("sd_InitModeSPI");
+  if (initResp != OUT_OF_IDLE)
+  {
+    sim_sd_Close();
+    return;
+  }
+  check("card type", ctv.type == (cfg->ccs == SIM_CCS_SDHC ? SDHC : SDSC));
+  check("SPI clock after init is F_CPU/2", spi_GetClockRate() == F_CPU / 2);
+  if (ctv.type == SDHC)
+    check("SDHC timeouts are spec max", 
+             sd_Timeouts.readMs == SD_READ_TIMEOUT_MS
+          && sd_Timeouts.writeMs == SD_WRITE_TIMEOUT_MS);
+  else
+    check("SDSC timeouts from CSD within spec max",
+             sd_Timeouts.readMs && sd_Timeouts.readMs <= SD_READ_TIMEOUT_MS
+          && sd_Timeouts.writeMs >= sd_Timeouts.readMs
+          && sd_Timeouts.writeMs <= SD_WRITE_TIMEOUT_MS);
+
+  sim_sd_ResetStats();
+  CS_ASSERT;
+  sd_SendFixedCommand(FRAME_SEND_STATUS);
+  match = sd_GetR1() == OUT_OF_IDLE && sd_ReceiveByteSPI() == 0;
+  CS_DEASSERT;
+  check("sd_SendFixedCommand SEND_STATUS", match);
+  printSpiCost("sd_SendFixedCommand");
+
+  //
+  // WARM RESET
+  //
+  CTV      warmCtv = ctv;
+  SimStats st;
+
+  sim_sd_ResetStats();
+  check("sd_WarmInitModeSPI", sd_WarmInitModeSPI(&warmCtv) == OUT_OF_IDLE
+        && warmCtv.type == ctv.type && warmCtv.version == ctv.version);
+  printSpiCost("sd_WarmInitModeSPI");
+  sim_sd_GetStats(&st);
+  check("warm init skips GO_IDLE_STATE and SD_SEND_OP_COND", st.cmds == 4);
+
+  warmCtv.type = !ctv.type;
+  sim_sd_ResetStats();
+  check("sd_WarmInitModeSPI falls back to full init on type mismatch",
+        sd_WarmInitModeSPI(&warmCtv) == OUT_OF_IDLE 
+        && warmCtv.type == ctv.type);
+  sim_sd_GetStats(&st);
+  check("full init was run", st.cmds > 4);
+
+  //
+  // CARD INFO
+  //
+  SDCardInfo info;
+
+  info.ctv = ctv;
+  check("sd_ReadCardInfo", sd_ReadCardInfo(&info) == READ_SUCCESS);
+  check("info CSD version matches card type",
+        info.csd.csdStructure == (cfg->co2t        ? CSD_VSN_SDUC 
+                                  : ctv.type == SDHC ? CSD_VSN_SDHC 
+                                                     : CSD_VSN_SDSC));
+  check("info OCR CCS matches card type", 
+        !!(info.ocr & 0x40000000) == (ctv.type == SDHC));
+  check("info OCR CO2T", !!(info.ocr & 0x08000000) == cfg->co2t);
+  check("info capacity from CSD", info.numOfBlcks == cfg->numOfBlcks
+             && info.byteCapacity == (uint64_t)cfg->numOfBlcks * BLOCK_LEN);
+  check("sd_GetCardByteCapacity", 
+        sd_GetCardByteCapacity(&ctv) == info.byteCapacity);
+  check("sd_GetCardBlockCapacity", 
+        sd_GetCardBlockCapacity(&ctv) == info.numOfBlcks);
+  check("info erase sector is 64 KB", info.eraseSectorBlcks == 128);
+  check("info CID", !strcmp(info.cid.pnm, "SIMSD") 
+                    && !strcmp(info.cid.oid, "SD") && info.cid.mdtYear == 2024
+                    && info.cid.mdtMonth == 1 && info.cid.psn == 0x12345678);
+  check("info SCR", info.scr.sdSpec == 2 && info.scr.sdSpec3 == 1
+                    && info.scr.sdBusWidths == 0x5);
+  check("info SD Status", info.speedClass == 10 && info.auBlcks == 8192);
+  check("info timeouts", info.timeouts.readMs == sd_Timeouts.readMs
+                         && info.timeouts.writeMs == sd_Timeouts.writeMs);
+
+  //
+  // HIGH SPEED
+  //
+  uint8_t csd[CSD_LEN];
+
+  sim_sd_ResetStats();
+  check("sd_SwitchHighSpeed", sd_SwitchHighSpeed() == HS_SWITCH_SUCCESS);
+  printSpiCost("sd_SwitchHighSpeed");
+  check("TRAN_SPEED is 50 MHz after switch",
+        sd_ReadCSD(csd) == READ_SUCCESS && csd[3] == 0x5A);
+  check("SPI clock after switch is F_CPU/2", spi_GetClockRate() == F_CPU / 2);
+
+  //
+  // WRITE, READ
+  //
+  sim_sd_ResetStats();
+  check("sd_WriteSingleBlock",
+        sd_WriteSingleBlock(blkAddr(&ctv, TEST_BLK_ADDR), dataArr)
+        == WRITE_SUCCESS);
+  printSpiCost("sd_WriteSingleBlock");
+
+  uint16_t busyPolls = 0;
+
+  check("card busy after sd_WriteSingleBlock returns", sd_IsBusy());
+  while (sd_IsBusy())
+    ++busyPolls;
+  check("sd_IsBusy clears once programmed", busyPolls > 0 && !sd_IsBusy());
+
+  sim_sd_ResetStats();
+  check("sd_ReadSingleBlock",
+        sd_ReadSingleBlock(blkAddr(&ctv, TEST_BLK_ADDR), blckArr)
+        == READ_SUCCESS);
+  printSpiCost("sd_ReadSingleBlock");
+
+  match = 1;
+  for (uint16_t pos = 0; pos < BLOCK_LEN; ++pos)
+    if (blckArr[pos] != dataArr[pos])
+      match = 0;
+  check("read data matches written data", match);
+
+  //
+  // ERASE
+  //
+  sim_sd_ResetStats();
+  check("sd_EraseBlocks",
+        sd_EraseBlocks(blkAddr(&ctv, TEST_BLK_ADDR),
+                       blkAddr(&ctv, TEST_BLK_ADDR)) == ERASE_SUCCESS);
+  printSpiCost("sd_EraseBlocks");
+
+  sd_ReadSingleBlock(blkAddr(&ctv, TEST_BLK_ADDR), blckArr);
+  match = 1;
+  for (uint16_t pos = 0; pos < BLOCK_LEN; ++pos)
+    if (blckArr[pos] != 0)
+      match = 0;
+  check("erased block reads 0", match);
+
+  //
+  // WRITE MULTIPLE BLOCKS
+  //
+  uint8_t    multArr[TEST_NUM_OF_BLKS * BLOCK_LEN];
+  BlockCount blckCnt = { 0, 0 };
+
+  for (uint32_t blk = 0; blk < TEST_NUM_OF_BLKS; ++blk)
+    for (uint16_t pos = 0; pos < BLOCK_LEN; ++pos)
+      multArr[blk * BLOCK_LEN + pos] = pos + blk * 31;
+
+  sim_sd_ResetStats();
+  check("sd_WriteMultipleBlocks",
+        sd_WriteMultipleBlocks(blkAddr(&ctv, TEST_BLK_ADDR), TEST_NUM_OF_BLKS,
+                               multArr, NULL, NULL) == WRITE_SUCCESS);
+  printSpiCost("sd_WriteMultipleBlocks");
+
+  match = 1;
+  for (uint32_t blk = 0; blk < TEST_NUM_OF_BLKS; ++blk)
+  {
+    sd_ReadSingleBlock(blkAddr(&ctv, TEST_BLK_ADDR + blk), blckArr);
+    for (uint16_t pos = 0; pos < BLOCK_LEN; ++pos)
+      if (blckArr[pos] != multArr[blk * BLOCK_LEN + pos])
+        match = 0;
+  }
+  check("multi-block data matches", match);
+
+  check("sd_WriteMultipleBlocks from source",
+        sd_WriteMultipleBlocks(blkAddr(&ctv, TEST_BLK_ADDR + TEST_NUM_OF_BLKS),
+                               TEST_NUM_OF_BLKS, NULL, patternBlock, blckArr)
+        == WRITE_SUCCESS);
+
+  uint32_t wellWrtn = 0;
+
+  check("sd_GetNumOfWellWrittenBlocks",
+        sd_GetNumOfWellWrittenBlocks(&wellWrtn) == READ_SUCCESS
+        && wellWrtn == TEST_NUM_OF_BLKS);
+
+  match = 1;
+  for (uint32_t blk = 0; blk < TEST_NUM_OF_BLKS; ++blk)
+  {
+    sd_ReadSingleBlock(blkAddr(&ctv, TEST_BLK_ADDR + TEST_NUM_OF_BLKS + blk),
+                       blckArr);
+    for (uint16_t pos = 0; pos < BLOCK_LEN; ++pos)
+      if (blckArr[pos] != (uint8_t)(pos ^ blk))
+        match = 0;
+  }
+  check("sourced block data matches", match);
+
+  //
+  // READ MULTIPLE BLOCKS
+  //
+  memset(multArr, 0, sizeof(multArr));
+  sim_sd_ResetStats();
+  check("sd_ReadMultipleBlocks",
+        sd_ReadMultipleBlocks(blkAddr(&ctv, TEST_BLK_ADDR), TEST_NUM_OF_BLKS,
+                              multArr, NULL, NULL) == READ_SUCCESS);
+  printSpiCost("sd_ReadMultipleBlocks");
+
+  match = 1;
+  for (uint32_t blk = 0; blk < TEST_NUM_OF_BLKS; ++blk)
+    for (uint16_t pos = 0; pos < BLOCK_LEN; ++pos)
+      if (multArr[blk * BLOCK_LEN + pos] != (uint8_t)(pos + blk * 31))
+        match = 0;
+  check("streamed blocks match", match);
+
+#if SD_STATS
+  SDStats stBefore, stAfter;
+
+  sd_StatsGet(SD_STATS_OP_READ_MULT, &stBefore);
+#endif
+  check("sd_ReadMultipleBlocks > 255 blocks",
+        sd_ReadMultipleBlocks(blkAddr(&ctv, 0), TEST_NUM_OF_STRM, blckArr,
+                              countBlocks, &blckCnt) == READ_SUCCESS
+        && blckCnt.cnt == TEST_NUM_OF_STRM);
+#if SD_STATS
+  // over 2^16 ticks in the simulator, where a tick is a byte time.
+  sd_StatsGet(SD_STATS_OP_READ_MULT, &stAfter);
+  check("sd_ReadMultipleBlocks ticks cover every byte clocked",
+        stAfter.ticks - stBefore.ticks 
+        >= stAfter.bytesSent - stBefore.bytesSent 
+           + stAfter.dmyBytes - stBefore.dmyBytes);
+#endif
+
+  blckCnt.cnt = 0;
+  blckCnt.stopAt = 3;
+  check("sd_ReadMultipleBlocks stopped by handler",
+        sd_ReadMultipleBlocks(blkAddr(&ctv, 0), TEST_NUM_OF_STRM, blckArr,
+                              countBlocks, &blckCnt) == READ_SUCCESS
+        && blckCnt.cnt == 3);
+  check("card ready after stream stopped",
+        sd_ReadSingleBlock(blkAddr(&ctv, TEST_BLK_ADDR), blckArr) 
+        == READ_SUCCESS && blckArr[1] == 1);
+
+  //
+  // BLOCK CACHE
+  //
+  SDCacheStats cacheSt;
+  SimStats     simSt;
+  const uint8_t order[TEST_NUM_OF_BLKS] = { 2, 0, 3, 1 };
+
+  sd_CacheInit(&ctv);
+  sim_sd_ResetStats();
+  for (uint8_t i = 0; i < TEST_NUM_OF_BLKS; ++i)
+  {
+    dataArr[0] = order[i];
+    sd_CacheWriteBlock(blkAddr(&ctv, TEST_BLK_ADDR + order[i]), dataArr);
+  }
+  sim_sd_GetStats(&simSt);
+  check("cached writes clock no SPI bytes", simSt.bytes == 0);
+
+  check("sd_CacheFlush", sd_CacheFlush() == WRITE_SUCCESS);
+  printSpiCost("sd_CacheFlush");
+  sim_sd_GetStats(&simSt);
+  sd_CacheGetStats(&cacheSt);
+  check("dirty run flushed with one multi-block write",
+        simSt.blcksWrtn == TEST_NUM_OF_BLKS && cacheSt.writeCmds == 1
+        && cacheSt.writeBacks == TEST_NUM_OF_BLKS);
+
+  sim_sd_ResetStats();
+  sd_CacheResetStats();
+  match = 1;
+  for (uint8_t i = 0; i < TEST_NUM_OF_BLKS; ++i)
+  {
+    sd_CacheReadBlock(blkAddr(&ctv, TEST_BLK_ADDR + i), blckArr);
+    if (blckArr[0] != i || blckArr[1] != dataArr[1])
+      match = 0;
+  }
+  sim_sd_GetStats(&simSt);
+  sd_CacheGetStats(&cacheSt);
+  check("cached reads hit", match && simSt.bytes == 0 
+        && cacheSt.hits == TEST_NUM_OF_BLKS && cacheSt.misses == 0);
+
+  // dirty the LRU block, then force it out by reading other blocks.
+  dataArr[0] = 0xA5;
+  sd_CacheWriteBlock(blkAddr(&ctv, TEST_BLK_ADDR), dataArr);
+  for (uint32_t blk = 0; blk < SD_CACHE_NUM_BLCKS; ++blk)
+    sd_CacheReadBlock(blkAddr(&ctv, blk), blckArr);
+  sd_CacheGetStats(&cacheSt);
+  sd_ReadSingleBlock(blkAddr(&ctv, TEST_BLK_ADDR), blckArr);
+  check("evicted dirty block written back",
+        blckArr[0] == 0xA5 && cacheSt.writeBacks == 1
+        && cacheSt.misses == SD_CACHE_NUM_BLCKS);
+
+  //
+  // ASYNC READ / WRITE
+  //
+  uint16_t asyncErr = 0;
+  uint32_t polls = 0;
+
+  for (uint16_t pos = 0; pos < BLOCK_LEN; ++pos)
+    dataArr[pos] = pos * 5 + 1;
+
+  sim_sd_ResetStats();
+  check("sd_WriteBlockAsync submitted",
+        sd_WriteBlockAsync(blkAddr(&ctv, TEST_BLK_ADDR), dataArr, asyncDone,
+                           &asyncErr));
+  check("second request refused while busy",
+        !sd_ReadBlockAsync(blkAddr(&ctv, TEST_BLK_ADDR), blckArr, NULL, NULL));
+  while (sd_AsyncPoll() != SD_ASYNC_DONE)
+    ++polls;
+  printSpiCost("sd_WriteBlockAsync");
+  check("async write completes over many polls",
+        asyncErr == WRITE_SUCCESS && sd_AsyncResult() == WRITE_SUCCESS
+        && polls > BLOCK_LEN && sd_AsyncPoll() == SD_ASYNC_IDLE);
+
+  memset(blckArr, 0, BLOCK_LEN);
+  asyncErr = 0;
+  sim_sd_ResetStats();
+  sd_ReadBlockAsync(blkAddr(&ctv, TEST_BLK_ADDR), blckArr, asyncDone,
+                    &asyncErr);
+  while (sd_AsyncPoll() != SD_ASYNC_DONE)
+    ;
+  printSpiCost("sd_ReadBlockAsync");
+  check("async read matches async write",
+        asyncErr == READ_SUCCESS && !memcmp(blckArr, dataArr, BLOCK_LEN));
+  check("blocking read after async",
+        sd_ReadSingleBlock(blkAddr(&ctv, TEST_BLK_ADDR), blckArr) 
+        == READ_SUCCESS && !memcmp(blckArr, dataArr, BLOCK_LEN));
+
+  //
+  // RING LOG
+  //
+  SDLog          log, mnt;
+  uint8_t        rec[TEST_LOG_REC_LEN];
+  const uint8_t *recPtr;
+  uint16_t       recPos;
+  uint8_t        recLen;
+  uint8_t        logResp = LOG_SUCCESS;
+
+  check("sd_LogFormat", sd_LogFormat(&log, TEST_LOG_BLK, TEST_LOG_NUM_OF_BLKS)
+        == LOG_SUCCESS);
+  check("sd_LogMount empty log", 
+        sd_LogMount(&mnt, TEST_LOG_BLK, TEST_LOG_NUM_OF_BLKS) == LOG_SUCCESS
+        && mnt.head == 0 && mnt.nextSeq == 0);
+
+  sim_sd_ResetStats();
+  for (uint8_t r = 0; r < 40; ++r)
+  {
+    memset(rec, r, TEST_LOG_REC_LEN);
+    logResp |= sd_LogAppend(&log, rec, TEST_LOG_REC_LEN);
+  }
+  sim_sd_GetStats(&simSt);
+  check("sd_LogAppend batches blocks in RAM",
+        logResp == LOG_SUCCESS && simSt.blcksWrtn == 8);
+  check("sd_LogFlush", sd_LogFlush(&log) == LOG_SUCCESS);
+  printSpiCost("sd_LogAppend x 40 + sd_LogFlush");
+  sim_sd_GetStats(&simSt);
+  check("records written as 10 blocks", simSt.blcksWrtn == 10
+        && log.head == 10 && log.nextSeq == 10);
+
+  sim_sd_ResetStats();
+  sd_LogMount(&mnt, TEST_LOG_BLK, TEST_LOG_NUM_OF_BLKS);
+  printSpiCost("sd_LogMount");
+  sim_sd_GetStats(&simSt);
+  check("sd_LogMount finds head by bisection",
+        mnt.head == 10 && mnt.nextSeq == 10 && simSt.blcksRead <= 5);
+
+  // 40 more records wrap the log.
+  for (uint8_t r = 40; r < 80; ++r)
+  {
+    memset(rec, r, TEST_LOG_REC_LEN);
+    logResp |= sd_LogAppend(&mnt, rec, TEST_LOG_REC_LEN);
+  }
+  logResp |= sd_LogFlush(&mnt);
+  sim_sd_ResetStats();
+  sd_LogMount(&log, TEST_LOG_BLK, TEST_LOG_NUM_OF_BLKS);
+  sim_sd_GetStats(&simSt);
+  check("sd_LogMount after the log wraps", logResp == LOG_SUCCESS
+        && log.head == 4 && log.nextSeq == 20 && simSt.blcksRead <= 5);
+
+  match = sd_LogReadBlock(&log, 0, blckArr) == LOG_SUCCESS;
+  recPos = 0;
+  for (uint8_t r = 76; r < 80; ++r)
+  {
+    recLen = sd_LogGetRecord(blckArr, &recPos, &recPtr);
+    if (recLen != TEST_LOG_REC_LEN || recPtr[0] != r 
+        || recPtr[TEST_LOG_REC_LEN - 1] != r)
+      match = 0;
+  }
+  check("sd_LogReadBlock newest block records", 
+        match && sd_LogGetRecord(blckArr, &recPos, &recPtr) == 0);
+  recPos = 0;
+  check("sd_LogReadBlock oldest block",
+        sd_LogReadBlock(&log, 15, blckArr) == LOG_SUCCESS
+        && sd_LogGetRecord(blckArr, &recPos, &recPtr) == TEST_LOG_REC_LEN
+        && recPtr[0] == 16);
+  check("sd_LogReadBlock overwritten block",
+        sd_LogReadBlock(&log, 16, blckArr) == LOG_NO_BLOCK);
+
+  // newest blocks torn by a power failure, then torn back to the first block.
+  sd_WriteSingleBlock(blkAddr(&ctv, TEST_LOG_BLK + 3), dataArr);
+  sd_LogMount(&log, TEST_LOG_BLK, TEST_LOG_NUM_OF_BLKS);
+  check("sd_LogMount skips torn newest block",
+        log.head == 3 && log.nextSeq == 19);
+  sd_WriteMultipleBlocks(blkAddr(&ctv, TEST_LOG_BLK), 3, NULL, 
+                         patternBlock, dataArr);
+  sd_LogMount(&log, TEST_LOG_BLK, TEST_LOG_NUM_OF_BLKS);
+  check("sd_LogMount with torn first block",
+        log.head == 0 && log.nextSeq == 16);
+
+  //
+  // FIND LAST WRITTEN BLOCK
+  //
+  uint8_t  erasedByte = 0xAA;
+  uint32_t numOfWrtn = 0;
+
+  check("sd_GetErasedByte", sd_GetErasedByte(&erasedByte) == READ_SUCCESS
+        && erasedByte == 0x00);
+  sd_EraseBlocks(blkAddr(&ctv, TEST_FILL_BLK), 
+                 blkAddr(&ctv, TEST_FILL_BLK + TEST_FILL_NUM_OF_BLKS - 1));
+  check("sd_FindLastWrittenBlock empty range",
+        sd_FindLastWrittenBlock(TEST_FILL_BLK, 
+                                TEST_FILL_BLK + TEST_FILL_NUM_OF_BLKS - 1,
+                                erasedByte, &numOfWrtn) == READ_SUCCESS
+        && numOfWrtn == 0);
+
+  sd_WriteMultipleBlocks(blkAddr(&ctv, TEST_FILL_BLK), TEST_FILL_WRTN_BLKS, 
+                         NULL, patternBlock, dataArr);
+  sim_sd_ResetStats();
+  sd_FindLastWrittenBlock(TEST_FILL_BLK, 
+                          TEST_FILL_BLK + TEST_FILL_NUM_OF_BLKS - 1,
+                          erasedByte, &numOfWrtn);
+  printSpiCost("sd_FindLastWrittenBlock");
+  sim_sd_GetStats(&simSt);
+  check("sd_FindLastWrittenBlock bisects the range",
+        numOfWrtn == TEST_FILL_WRTN_BLKS && simSt.cmds <= 2 * 10);
+
+  sd_FindLastWrittenBlock(TEST_FILL_BLK, TEST_FILL_BLK + TEST_FILL_WRTN_BLKS - 1,
+                          erasedByte, &numOfWrtn);
+  check("sd_FindLastWrittenBlock full range", 
+        numOfWrtn == TEST_FILL_WRTN_BLKS);
+
+  //
+  // SCAN BLOCKS
+  //
+  uint8_t        bitmap[(TEST_FILL_WRTN_BLKS + 7) / 8];
+  const uint16_t usedPos[] = { 0, BLOCK_LEN - 1, BLOCK_LEN / 2 };
+  const uint8_t  usedBlk[] = { 3, 5, 9 };  // of the 16 scanned
+
+  // blocks in use from their first byte, their last byte and their middle.
+  for (uint8_t i = 0; i < sizeof(usedBlk); ++i)
+  {
+    memset(blckArr, 0, BLOCK_LEN);
+    blckArr[usedPos[i]] = 0x5A;
+    sd_WriteSingleBlock(blkAddr(&ctv, TEST_FILL_BLK + 200 + usedBlk[i]), 
+                        blckArr);
+  }
+  memset(bitmap, 0xFF, sizeof(bitmap));
+  check("sd_ScanBlocks bitmap",
+        sd_ScanBlocks(blkAddr(&ctv, TEST_FILL_BLK + 200), 16, erasedByte, 
+                      bitmap) == READ_SUCCESS
+        && bitmap[0] == 0x28 && bitmap[1] == 0x02);
+
+  memset(bitmap, 0, sizeof(bitmap));
+  sim_sd_ResetStats();
+  check("sd_ScanBlocks written range",
+        sd_ScanBlocks(blkAddr(&ctv, TEST_FILL_BLK), TEST_FILL_WRTN_BLKS, 
+                      erasedByte, bitmap) == READ_SUCCESS
+        && bitmap[0] == 0xFF 
+        && bitmap[sizeof(bitmap) - 1] == (1 << (TEST_FILL_WRTN_BLKS % 8)) - 1);
+  printSpiCost("sd_ScanBlocks written range");
+  sim_sd_GetStats(&simSt);
+  check("sd_ScanBlocks abandons blocks in use",
+        simSt.bytes < TEST_FILL_WRTN_BLKS * BLOCK_LEN / 4);
+
+  //
+  // OCCUPANCY MAP. Groups of 16 blocks over the first 256 blocks of the
+  // filled range. Blocks 0 to 136, 203, 205 and 209 are in use.
+  //
+  SDOccupancyMap occMap;
+  uint8_t        occBitmap[2];
+  uint16_t       occResp;
+  uint16_t       steps = 0;
+
+  sd_BuildOccupancyMap(&occMap, TEST_FILL_BLK, TEST_FILL_BLK + 255, occBitmap,
+                       16, erasedByte);
+  sim_sd_ResetStats();
+  do
+  {
+    occResp = sd_OccupancyMapStep(&occMap, 20);
+    ++steps;
+  }
+  while (occResp == OCC_MAP_IN_PROGRESS);
+  printSpiCost("sd_OccupancyMapStep x 20 blocks");
+  sim_sd_GetStats(&simSt);
+  check("sd_OccupancyMapStep builds the map incrementally",
+        occResp == OCC_MAP_DONE && steps > 1 
+        && occBitmap[0] == 0xFF && occBitmap[1] == 0x31);
+  check("groups in use are skipped after their first data byte",
+        simSt.bytes < 7 * 16 * (BLOCK_LEN + 3));
+
+  //
+  // COPY BLOCKS. The first 10 blocks of the filled range hold patternBlock 
+  // data, copied to block 300 of the range, then moved 2 blocks up.
+  //
+  static uint8_t copyBatch[4 * BLOCK_LEN];
+  uint32_t pairCmds;
+
+  sim_sd_ResetStats();
+  for (uint8_t blk = 0; blk < 10; ++blk)
+  {
+    sd_ReadSingleBlock(blkAddr(&ctv, TEST_FILL_BLK + blk), blckArr);
+    sd_WriteSingleBlock(blkAddr(&ctv, TEST_FILL_BLK + 400 + blk), blckArr);
+  }
+  printSpiCost("CMD17 / CMD24 copy x 10");
+  sim_sd_GetStats(&simSt);
+  pairCmds = simSt.cmds;
+
+  sim_sd_ResetStats();
+  check("sd_CopyBlocks", 
+        sd_CopyBlocks(blkAddr(&ctv, TEST_FILL_BLK), 
+                      blkAddr(&ctv, TEST_FILL_BLK + 300), 10,
+                      copyBatch, sizeof copyBatch) == COPY_SUCCESS);
+  printSpiCost("sd_CopyBlocks x 10");
+  sim_sd_GetStats(&simSt);
+  check("sd_CopyBlocks uses fewer commands than single block pairs",
+        simSt.cmds < pairCmds && simSt.blcksWrtn == 10);
+
+  check("sd_CopyBlocks overlapping ranges",
+        sd_CopyBlocks(blkAddr(&ctv, TEST_FILL_BLK + 300), 
+                      blkAddr(&ctv, TEST_FILL_BLK + 302), 10,
+                      copyBatch, sizeof copyBatch) == COPY_SUCCESS);
+  match = 1;
+  for (uint8_t blk = 0; blk < 10; ++blk)
+  {
+    sd_ReadSingleBlock(blkAddr(&ctv, TEST_FILL_BLK + 302 + blk), blckArr);
+    if (blckArr[1] != (1 ^ blk) || blckArr[200] != (200 ^ blk))
+      match = 0;
+  }
+  check("copied blocks match the source", match);
+  check("sd_CopyBlocks rejects a batch shorter than a block",
+        sd_CopyBlocks(blkAddr(&ctv, TEST_FILL_BLK),
+                      blkAddr(&ctv, TEST_FILL_BLK + 300), 1,
+                      copyBatch, BLOCK_LEN - 1) == COPY_INVALID_BUFFER);
+
+#if SD_STATS
+  print_Str("\n");
+  sd_PrintStats();
+#endif
+
+  sim_sd_Close();
+}
+
+//
+// LOCAL FUNCTION - prints the result of a single check and counts failures.
+//
+static void check(char *name, uint8_t pass)
+{
+  print_Str(pass ? "\n\r    PASS  " : "\n\r    FAIL  ");
+  print_Str(name);
+  if (!pass)
+    ++failCnt;
+}
+
+//
+// LOCAL FUNCTION - prints the SPI traffic since the last sim_sd_ResetStats.
+//
+static void printSpiCost(char *op)
+{
+  SimStats st;
+
+  sim_sd_GetStats(&st);
+  print_Str("\n\r          ");
+  print_Str(op);
+  print_Str(": bytes = ");
+  print_Dec(st.bytes);
+  print_Str(", cmds = ");
+  print_Dec(st.cmds);
+  print_Str(", busy bytes = ");
+  print_Dec(st.busyBytes);
+}
+
+//
+// LOCAL FUNCTION - returns the address argument of block blkNum for the card.
+//
+static uint32_t blkAddr(const CTV *ctv, uint32_t blkNum)
+{
+  return (ctv->type == SDHC) ? blkNum : blkNum * BLOCK_LEN;
+}
+
+//
+// LOCAL FUNCTION - SDBlockHandler that counts the blocks streamed.
+//
+static uint8_t countBlocks(uint32_t blckIdx, const uint8_t blckArr[],
+                           void *ctx)
+{
+  BlockCount *bc = ctx;
+
+  (void)blckIdx;
+  (void)blckArr;
+  return ++bc->cnt == bc->stopAt;
+}
+
+//
+// LOCAL FUNCTION - SDBlockSource that fills ctx with a pattern for each block.
+//
+static const uint8_t *patternBlock(uint32_t blckIdx, void *ctx)
+{
+  uint8_t *blckArr = ctx;
+
+  for (uint16_t pos = 0; pos < BLOCK_LEN; ++pos)
+    blckArr[pos] = pos ^ blckIdx;
+  return blckArr;
+}
+
+//
+// LOCAL FUNCTION - SDAsyncCallback that stores the result of the request.
+//
+static void asyncDone(uint16_t err, void *ctx)
+{
+  *(uint16_t *)ctx = err;
+}
@@ -15,6 +15,7 @@
  * over data on an SD card.
  */
 
+#include <stddef.h>
 #include <avr/io.h>
 #include "avr_usart.h"
 #include "prints.h"
@@ -43,6 +44,7 @@
 #define TEST_INTERACTIVE_USER_SECTION              0
 #define TEST_MEMORY_CAPACITY                       0
 #define TEST_FIND_NONZERO_DATA_BLOCKS              0
+#define TEST_FIND_LAST_WRITTEN_BLOCK               0
 
 //
 // ----------------------------------------------------------------------------
@@ -143,8 +145,9 @@ uint32_t enterBlockNumber();
 // ----------------------------------------------------------------------------
 //                                                         TEST_MEMORY_CAPACITY
 //
-// The section calls the function sd_GetCardByteCapacity which will calculate
-// and return the card's data capacity in bytes. No additional macro parameters
+// The section calls the functions sd_GetCardByteCapacity and 
+// sd_GetCardBlockCapacity which will calculate and return the card's data 
+// capacity in bytes and in blocks. No additional macro parameters
 // are required for this function.
 //
 
@@ -164,6 +167,21 @@ uint32_t enterBlockNumber();
 #define END_BLK_ADDR_FNZDB    10000
 #endif
 
+// ----------------------------------------------------------------------------
+//                                                 TEST_FIND_LAST_WRITTEN_BLOCK
+//
+// Demos the function sd_FindLastWrittenBlock which finds the end of the data
+// in the range of START_BLK_NUM_FLWB to END_BLK_NUM_FLWB (inclusive), for a
+// range that is written in order from its first block, such as by a data
+// logger. The range is bisected, so only about log2 of the number of blocks 
+// are read rather than every block as with sd_FindNonZeroDataBlockNums.
+//
+#if TEST_FIND_LAST_WRITTEN_BLOCK
+// block number range to search for the last written block.
+#define START_BLK_NUM_FLWB    0 
+#define END_BLK_NUM_FLWB      10000
+#endif
+
 int main(void)                                        
 {
   // Initialize usart. Required for any printing to terminal.
@@ -374,7 +392,7 @@ int main(void)
                     "Getting R2 response.");
           
           CS_ASSERT;             
-          sd_SendCommand(SEND_STATUS, 0);
+          sd_SendFixedCommand(FRAME_SEND_STATUS);
           uint16_t r2 = sd_GetR1();         // The first byte of R2 is R1
           r2 <<= 8;
           r2 |= sd_ReceiveByteSPI();
@@ -568,7 +586,10 @@ int main(void)
     //
     #if TEST_ERASE_WRITE_MULTIPLE_BLOCKS
 
-    uint8_t  dataArrWMB[BLOCK_LEN] = WRITE_STR_WMB;   // data to be written
+    // data to be written. WRITE_STR_WMB is copied to the start of each block
+    uint8_t  dataArrWMB[NUM_OF_BLKS_WMB * BLOCK_LEN] = WRITE_STR_WMB;
+    for (uint16_t pos = BLOCK_LEN; pos < NUM_OF_BLKS_WMB * BLOCK_LEN; ++pos)
+      dataArrWMB[pos] = dataArrWMB[pos % BLOCK_LEN];
     uint64_t endEraseBlkAddr = START_BLK_ADDR_WMB + NUM_OF_BLKS_WMB - 1;
     uint16_t errWMB;
 
@@ -636,7 +657,7 @@ int main(void)
     print_Dec(endEraseBlkAddr);
     
     errWMB = sd_WriteMultipleBlocks(START_BLK_ADDR_WMB, NUM_OF_BLKS_WMB, 
-                                    dataArrWMB);
+                                    dataArrWMB, NULL, NULL);
     if (errWMB != WRITE_SUCCESS)       // if write multiple blocks failed
     { 
       print_Str("\n\r >> sd_WriteMultipleBlocks() returned ");
@@ -660,7 +681,7 @@ int main(void)
           print_Str("\n\n\r >> WRITE_ERROR_TOKEN set."
                     "\n\r >> Getting STATUS (R2) response.");
           CS_ASSERT;             
-          sd_SendCommand(SEND_STATUS, 0);
+          sd_SendFixedCommand(FRAME_SEND_STATUS);
           uint16_t r2 = sd_GetR1();         // The first byte of R2 is R1
           r2 <<= 8;
           r2 |= sd_ReceiveByteSPI();
@@ -799,9 +820,12 @@ int main(void)
     //
     #if TEST_MEMORY_CAPACITY
 
+    // print_Dec is 32-bit, so the byte capacity is printed in KB.
     print_Str("\n\n\n\r Memory capacity = ");
-    print_Dec(sd_GetCardByteCapacity(&ctv));
-    print_Str(" Bytes");
+    print_Dec(sd_GetCardByteCapacity(&ctv) / 1024);
+    print_Str(" KB, ");
+    print_Dec(sd_GetCardBlockCapacity(&ctv));
+    print_Str(" Blocks");
 
     #endif
     //
@@ -827,6 +851,50 @@ int main(void)
     //
     // END TEST                                   TEST_FIND_NONZERO_DATA_BLOCKS
     // ------------------------------------------------------------------------
+
+
+
+    // ------------------------------------------------------------------------
+    // BEGIN TEST                                  TEST_FIND_LAST_WRITTEN_BLOCK
+    //
+    #if TEST_FIND_LAST_WRITTEN_BLOCK
+
+    uint8_t  erasedByte;
+    uint32_t numOfWrtnBlcks;
+    uint16_t findResp;
+
+    print_Str("\n\n\r\r sd_FindLastWrittenBlock() \n\r");
+    findResp = sd_GetErasedByte(&erasedByte);
+    if (findResp == READ_SUCCESS)
+      findResp = sd_FindLastWrittenBlock(START_BLK_NUM_FLWB, END_BLK_NUM_FLWB,
+                                         erasedByte, &numOfWrtnBlcks);
+    if (findResp != READ_SUCCESS)
+    {
+      print_Str("\n\r >> sd_FindLastWrittenBlock() returned ");
+      if (findResp & R1_ERROR)
+      {
+        print_Str("R1 error: ");
+        sd_PrintR1(findResp);
+      }
+      else
+      {
+        print_Str(" error ");
+        sd_PrintReadError(findResp);
+      }
+    }
+    else if (numOfWrtnBlcks == 0)
+      print_Str("\n\r No blocks written");
+    else
+    {
+      print_Str("\n\r Last written block = ");
+      print_Dec(START_BLK_NUM_FLWB + numOfWrtnBlcks - 1);
+    }
+    print_Str("\n\r Done\n\r");
+
+    #endif
+    //
+    // END TEST                                    TEST_FIND_LAST_WRITTEN_BLOCK
+    // ------------------------------------------------------------------------
   }
 
   // This is just something to do after SD card testing has completed.